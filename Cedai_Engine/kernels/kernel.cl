@@ -3,6 +3,8 @@
 
 #pragma OPENCL EXTENSION cl_khr_gl_sharing : enable
 
+#include "render_math.h"
+
 typedef struct
 {
 	float radius;
@@ -10,92 +12,116 @@ typedef struct
 	uint4 color;
 } Sphere;
 
-enum primitive_type { NONE, SPHERE, LIGHT, POLYGON };
-
-// CONFIG AND CONSTANTS
-
-#ifdef HALF_RESOLUTION
-#	define DITHER
-#endif
-
-#define DROP_OFF 1000
+// matches cd::BvhNode (Bvh.hpp), min.w = first child or primitive, max.w = primitive count (0 = interior)
+typedef struct
+{
+	float4 min;
+	float4 max;
+} BvhNode;
 
-#define LIGHT_RADIUS 3
-#define LIGHT_W PI / 4.37499f
+// matches cd::GpuInstance (Instance.hpp), affine transforms as 3 rows
+typedef struct
+{
+	float4 world_to_object[3];
+	float4 object_to_world[3];
+	int4 offsets; // x = first vertex, y = first bottom level bvh node, z / w = root of the camera / shadow level
+} Instance;
 
-#define AMBIENT 0.2f
-#define LIGHT_STEP 0.2f
+// the instanced meshes: a top level bvh over the instances, a bottom level bvh per skinned or static mesh
+typedef struct
+{
+	__global const float4* vertices;
+	__global const uint4* triangles; // vertex indices (xyz) and triangle (w) of each bottom level leaf slot, shared by every mesh
+	__global const BvhNode* blas_nodes;
+	__global const Instance* instances; // in top level leaf order
+	__global const BvhNode* tlas_nodes;
+	int instance_count;
+} Scene;
 
-#define BACKGROUND_OFFSET 0.3f
-#define BACKGROUND_MULTIPLIER 0.5f
+enum primitive_type { NONE, SPHERE, LIGHT, POLYGON };
 
-#define PI 3.14159265359f
+#define BVH_STACK_SIZE 32 /* nodes pending per traversal, enough for a depth 32 tree (BVH_MAX_DEPTH in Bvh.hpp) */
+
+// counters are only compiled into the debug kernel
+#ifdef KERNEL_COUNTERS
+#	define COUNT(counter) counts[counter]++
+#	define COUNTS_PARAM , uint* counts
+#	define COUNTS_ARG , counts
+#else
+#	define COUNT(counter)
+#	define COUNTS_PARAM
+#	define COUNTS_ARG
+#endif
 
 // DECLARATIONS
 
-float sphere_intersect(float3 ray_o, float3 ray_d, float3 center, float radius);
-float triangle_intersect(float3 O, float3 D, float3 V0, float3 V1, float3 V2);
-
-float diffuse_sphere(float3 normal, float3 intersection, float3 light);
-float diffuse_polygon(float3 normal, float3 intersection, float3 light_pos, float3 ray_d);
-float ceiling(float value, float multiple);
-bool shadow(float3 intersection, float3 light, int s_index, int p_index, const int sphere_count, const int polygon_count,
-			__constant Sphere* __restrict spheres, __constant float4* __restrict vertices);
+bool shadow(float3 intersection, float3 light, int s_index, int i_index, int p_index, const int sphere_count,
+			__constant Sphere* __restrict spheres, const Scene* scene COUNTS_PARAM);
+int trace_instances(float3 ray_o, float3 ray_d, float* min_t, int* triangle, bool any_hit, int skip_instance, int skip_triangle,
+					const Scene* scene COUNTS_PARAM);
+int trace_mesh(float3 ray_o, float3 ray_d, float* min_t, bool any_hit, int skip_triangle, int root,
+			   __global const float4* vertices, __global const uint4* triangles, __global const BvhNode* nodes COUNTS_PARAM);
+float3 transform_point(const float4* m, float3 p);
+float3 transform_direction(const float4* m, float3 d);
 int luminance(uchar4 color);
+#ifdef KERNEL_COUNTERS
+void add_counts(uint* counts, __local uint* group_counts, __global uint* counters);
+uchar4 heat_color(float heat);
+#endif
 
 void draw(__write_only image2d_t output, uchar4 color, int2 coord, bool no_color_found);
 uchar4 background_color(float3 ray_d);
 
-typedef uint Packed;
-
-Packed pack(uint4 convert) {
-	Packed packed = { 0 };
-	packed |= (convert.x & 0x000000FF);
-	packed |= (convert.y & 0x000000FF) << 8;
-	packed |= (convert.z & 0x000000FF) << 16;
-	packed |= (convert.w & 0x000000FF) << 24;
-	return packed;
-}
-
-uint4 unpack(Packed packed) {
-	uint4 unpacked;
-	unpacked.x = (packed & 0x000000FF);
-	unpacked.y = (packed & 0x0000FF00) >> 8;;
-	unpacked.z = (packed & 0x00FF0000) >> 16;
-	unpacked.w = (packed & 0xFF000000) >> 24;
-	return unpacked;
-}
-
 // ENTRY POINT
 
 __attribute__((work_group_size_hint(WG_SIZE, WG_SIZE, 1)))
 __kernel void render(// inputs
 					 const float16 view, const float3 ray_o, const float time,
-					 const int sphere_count, const int light_count, const int polygon_count,
+					 const int sphere_count, const int light_count, const int instance_count,
 					 // buffers
 					 __constant Sphere* __restrict spheres,
-					 __constant float4* __restrict vertices,
+					 __global const float4* __restrict vertices, // every skinned mesh, then the static meshes
 					 __constant uchar4* __restrict polygon_colors,
 					 // output
-					 __write_only image2d_t output)
+					 __write_only image2d_t output,
+					 // acceleration structures
+					 __global const uint4* __restrict triangles,
+					 __global const BvhNode* __restrict blas_nodes,
+					 __global const Instance* __restrict instances,
+					 __global const BvhNode* __restrict tlas_nodes
+#ifdef KERNEL_COUNTERS
+					 // debug
+					 , __global uint* counters, __global uint* pixel_cost, const uint heatmap_max_cost
+#endif
+					 )
 {
 	const int2 coord = (int2)(get_global_id(0), get_global_id(1));
 	const int2 dim = (int2)(get_global_size(0), get_global_size(1));
 
+#ifdef KERNEL_COUNTERS
+	__local uint group_counts[COUNTER_COUNT]; // local variables must be declared at kernel scope
+	uint counts[COUNTER_COUNT] = { 0 };
+	COUNT(COUNTER_RAYS);
+#endif
+
 	// create a camera ray
 	const float3 uv = (float3)(dim.x, (float)coord.x - (float)dim.x / 2, (float)dim.y / 2 - coord.y);
 	const float3 ray_d = fast_normalize((float3)(uv.x * view.s0 + uv.y * view.s4 + uv.z * view.s8,
 												 uv.x * view.s1 + uv.y * view.s5 + uv.z * view.s9,
 												 uv.x * view.s2 + uv.y * view.s6 + uv.z * view.sA));
 
+	const Scene scene = { vertices, triangles, blas_nodes, instances, tlas_nodes, instance_count };
+
 	// check for intersections
 	float min_t = DROP_OFF; // drop off distance
 	int index = 0;
+	int instance = -1;
 	enum primitive_type primitive_found = NONE;
 
 	// spheres
 	for (int s = 0; s < sphere_count; s++) {
 		Sphere sphere = spheres[s];
+		COUNT(COUNTER_SPHERE_TESTS);
 		float t = sphere_intersect(ray_o, ray_d, sphere.pos, sphere.radius);
 		if (0 < t && t < min_t) {
 			primitive_found = SPHERE;
@@ -107,6 +133,7 @@ __kernel void render(// inputs
 	float3 light_offset = (float3)(LIGHT_RADIUS * cos(LIGHT_W * time), LIGHT_RADIUS * sin(LIGHT_W * time), 0);
 	for (int l = sphere_count; l < sphere_count + light_count; l++) {
 		Sphere light = spheres[l];
+		COUNT(COUNTER_SPHERE_TESTS);
 		float t = sphere_intersect(ray_o, ray_d, light.pos + light_offset * (l % 2 * 2 - 1), light.radius);
 		if (0 < t && t < min_t) {
 			primitive_found = LIGHT;
@@ -115,13 +142,12 @@ __kernel void render(// inputs
 	}	}
 
 	// polygons
-	for (int p = 0; p < polygon_count; p++) {
-		float t = triangle_intersect(ray_o, ray_d, vertices[p * 3].xyz, vertices[p * 3 + 1].xyz, vertices[p * 3 + 2].xyz);
-		if (0 < t && t < min_t) {
-			primitive_found = POLYGON;
-			min_t = t;
-			index = p;
-	}	}
+	int triangle;
+	instance = trace_instances(ray_o, ray_d, &min_t, &triangle, false, -1, -1, &scene COUNTS_ARG);
+	if (0 <= instance) {
+		primitive_found = POLYGON;
+		index = triangle;
+	}
 	
 	uchar4 color = (uchar4)(0, 0, 0, 0);
 
@@ -140,7 +166,7 @@ __kernel void render(// inputs
 
 		for (int l = sphere_count; l < sphere_count + light_count; l++) {
 			float3 light_pos = spheres[l].pos + light_offset * (l % 2 * 2 - 1);
-			bool in_shadow = shadow(intersection, light_pos, index, -1, sphere_count, polygon_count, spheres, vertices);
+			bool in_shadow = shadow(intersection, light_pos, index, -1, -1, sphere_count, spheres, &scene COUNTS_ARG);
 			if (!in_shadow)
 				light += diffuse_sphere(intersection - spheres[index].pos, intersection, spheres[l].pos + light_offset * (l % 2 * 2 - 1));
 		}
@@ -151,103 +177,160 @@ __kernel void render(// inputs
 	} else if (primitive_found == POLYGON) {
 		float light = AMBIENT;
 		float3 intersection = mad(min_t, ray_d, ray_o);
-		float3 v0 = vertices[index * 3].xyz;
-		float3 v1 = vertices[index * 3 + 1].xyz;
-		float3 v2 = vertices[index * 3 + 2].xyz;
+		const Instance hit = instances[instance];
+		__global const float4* mesh = vertices + hit.offsets.x;
+		const uint4 tri = triangles[index];
+		float3 v0 = transform_point(hit.object_to_world, mesh[tri.x].xyz);
+		float3 v1 = transform_point(hit.object_to_world, mesh[tri.y].xyz);
+		float3 v2 = transform_point(hit.object_to_world, mesh[tri.z].xyz);
 
 		for (int l = sphere_count; l < sphere_count + light_count; l++) {
 			float3 light_pos = spheres[l].pos + light_offset * (l % 2 * 2 - 1);
-			bool in_shadow = shadow(intersection, light_pos, -1, index, sphere_count, polygon_count, spheres, vertices);
+			bool in_shadow = shadow(intersection, light_pos, -1, instance, index, sphere_count, spheres, &scene COUNTS_ARG);
 			if (!in_shadow)
 				light += diffuse_polygon(cross(v1 - v0, v2 - v0), intersection, light_pos, ray_d);
 		}
 		light = clamp(light, 0.0f, 1.0f);
-		color = convert_uchar4(convert_float4(polygon_colors[index]) * light);
+		color = convert_uchar4(convert_float4(polygon_colors[tri.w]) * light);
+	}
+
+#ifdef KERNEL_COUNTERS
+	// cost of the pixel = primitives and nodes tested for every ray it cast
+	uint cost = counts[COUNTER_SPHERE_TESTS] + counts[COUNTER_TRIANGLE_TESTS] + counts[COUNTER_BVH_NODES];
+	pixel_cost[coord.y * dim.x + coord.x] = cost;
+	add_counts(counts, group_counts, counters);
+
+	if (heatmap_max_cost) {
+		color = heat_color((float)cost / heatmap_max_cost);
+		primitive_found = POLYGON; // no background dither
 	}
+#endif
 
 	// write pixel to the output image
 	draw(output, color, coord, primitive_found == NONE);
 }
 
-// INTERSECTION FUNCTIONS
+// SHADOW FUNCTIONS
 
-float sphere_intersect(float3 ray_o, float3 ray_d, float3 center, float radius)
-{
-	// a = P1 . P1 = 1 (assuming ray_d is normalized)
-	float3 d = center - ray_o;
-	float b = dot(d, ray_d);
-	float c = dot(d, d) - radius * radius;
+bool shadow(float3 intersection, float3 light, int s_index, int i_index, int p_index, const int sphere_count,
+			__constant Sphere* __restrict spheres, const Scene* scene COUNTS_PARAM) {
+	COUNT(COUNTER_SHADOW_RAYS);
+	float3 ray_d = fast_normalize(light - intersection);
+	float3 ray_o = intersection;
 
-	float discriminant = b * b - c;
-	if (discriminant < 0) return -1;
+	// spheres
+	for (int s = 0; s < sphere_count; s++) {
+		if (s == s_index) continue;
+		Sphere sphere = spheres[s];
+		COUNT(COUNTER_SPHERE_TESTS);
+		float t = sphere_intersect(ray_o, ray_d, sphere.pos, sphere.radius);
+		if (0 < t && t < 100) return true;
+	}
 
-	float t = b - native_sqrt(discriminant);
-	return 0 < t ? t : -1;
+	// polygons, any hit in front of the surface
+	float max_t = MAXFLOAT;
+	int triangle;
+	return 0 <= trace_instances(ray_o, ray_d, &max_t, &triangle, true, i_index, p_index, scene COUNTS_ARG);
 }
 
-float triangle_intersect(float3 O, float3 D, float3 V0, float3 V1, float3 V2)
-{
-	// M�ller-Trumbore algorithm. we use Cramer's rule to find [t,u,v]
-	// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
-	// returns -1 for no intersection, otherwise returns t (where intersection = O + tD)
-
-	float3 E1 = V1 - V0;
-	float3 E2 = V2 - V0;
-	float3 P = cross(D, E2);
+// TRAVERSAL FUNCTIONS
 
-	float inv_det0 = native_recip(dot(P, E1));
-	float3 T = O - V0;
-
-	float u = dot(T, P) * inv_det0;
-	if (u < 0 || 1 < u) return -1;
-
-	float3 Q = cross(T, E1);
-	float v = dot(Q, D) * inv_det0;
+// closest polygon nearer than min_t (any_hit: the first found) over every instance, returns its instance or -1
+// and its bottom level leaf slot in triangle
+int trace_instances(float3 ray_o, float3 ray_d, float* min_t, int* triangle, bool any_hit, int skip_instance, int skip_triangle,
+					const Scene* scene COUNTS_PARAM)
+{
+	if (scene->instance_count == 0) return -1;
+
+	const float3 inv_d = 1.0f / ray_d;
+	int stack[BVH_STACK_SIZE];
+	int top = 0;
+	int hit = -1;
+	stack[top++] = 0;
+
+	while (top) {
+		const BvhNode node = scene->tlas_nodes[stack[--top]];
+		COUNT(COUNTER_BVH_NODES);
+		if (aabb_intersect(ray_o, inv_d, node.min.xyz, node.max.xyz, *min_t) < 0) continue;
+
+		const int first = as_int(node.min.w);
+		const int count = as_int(node.max.w);
+		if (count == 0) {
+			if (top + 2 <= BVH_STACK_SIZE) {
+				stack[top++] = first + 1;
+				stack[top++] = first;
+			}
+			continue;
+		}
 
-	return v < 0 || 1 < u + v ? -1 : dot(Q, E2) * inv_det0;
+		// each instance is traced in its own space, t is the same in both as the transforms are affine. shadow rays trace the
+		// shadow level, except from the instance they leave, whose surface is the camera level
+		for (int i = first; i < first + count; i++) {
+			const Instance instance = scene->instances[i];
+			const float3 o = transform_point(instance.world_to_object, ray_o);
+			const float3 d = transform_direction(instance.world_to_object, ray_d);
+			const int root = any_hit && i != skip_instance ? instance.offsets.w : instance.offsets.z;
+			const int t = trace_mesh(o, d, min_t, any_hit, i == skip_instance ? skip_triangle : -1, root,
+				scene->vertices + instance.offsets.x, scene->triangles, scene->blas_nodes + instance.offsets.y COUNTS_ARG);
+			if (0 <= t) {
+				hit = i;
+				*triangle = t;
+				if (any_hit) return hit;
+	}	}	}
+	return hit;
 }
 
-// LIGHTING FUNCTIONS
-
-float diffuse_sphere(float3 normal, float3 intersection, float3 light)
+// leaf slot of the closest triangle of one mesh nearer than min_t (any_hit: the first found), -1 for none
+int trace_mesh(float3 ray_o, float3 ray_d, float* min_t, bool any_hit, int skip_triangle, int root,
+			   __global const float4* vertices, __global const uint4* triangles, __global const BvhNode* nodes COUNTS_PARAM)
 {
-	return clamp(dot(fast_normalize(normal), fast_normalize(light - intersection)), 0.0f, 1.0f);
+	const float3 inv_d = 1.0f / ray_d;
+	int stack[BVH_STACK_SIZE];
+	int top = 0;
+	int hit = -1;
+	stack[top++] = root;
+
+	while (top) {
+		const BvhNode node = nodes[stack[--top]];
+		COUNT(COUNTER_BVH_NODES);
+		if (aabb_intersect(ray_o, inv_d, node.min.xyz, node.max.xyz, *min_t) < 0) continue;
+
+		const int first = as_int(node.min.w);
+		const int count = as_int(node.max.w);
+		if (count == 0) {
+			if (top + 2 <= BVH_STACK_SIZE) {
+				stack[top++] = first + 1;
+				stack[top++] = first;
+			}
+			continue;
+		}
+
+		for (int p = first; p < first + count; p++) {
+			if (p == skip_triangle) continue;
+			const uint4 tri = triangles[p];
+			COUNT(COUNTER_TRIANGLE_TESTS);
+			float t = triangle_intersect(ray_o, ray_d, vertices[tri.x].xyz, vertices[tri.y].xyz, vertices[tri.z].xyz);
+			if (0 < t && t < *min_t) {
+				*min_t = t;
+				hit = p;
+				if (any_hit) return hit;
+	}	}	}
+	return hit;
 }
 
-float diffuse_polygon(float3 normal, float3 intersection, float3 light_pos, float3 ray_d)
+float3 transform_point(const float4* m, float3 p)
 {
-	float3 light_to_int = intersection - light_pos;
-	float light = fabs(dot(fast_normalize(normal), fast_normalize(light_to_int)));
-	return sign(dot(normal, light_to_int)) == sign(dot(normal, ray_d)) ? light : 0;
+	const float4 h = (float4)(p, 1);
+	return (float3)(dot(m[0], h), dot(m[1], h), dot(m[2], h));
 }
 
-float ceiling(float value, float multiple)
+float3 transform_direction(const float4* m, float3 d)
 {
-	return ceil(value/multiple) * multiple;
+	const float4 h = (float4)(d, 0);
+	return (float3)(dot(m[0], h), dot(m[1], h), dot(m[2], h));
 }
 
-bool shadow(float3 intersection, float3 light, int s_index, int p_index, const int sphere_count, const int polygon_count,
-			__constant Sphere* __restrict spheres, __constant float4* __restrict vertices) {
-	float3 ray_d = fast_normalize(light - intersection);
-	float3 ray_o = intersection;
-
-	// spheres
-	for (int s = 0; s < sphere_count; s++) {
-		if (s == s_index) continue;
-		Sphere sphere = spheres[s];
-		float t = sphere_intersect(ray_o, ray_d, sphere.pos, sphere.radius);
-		if (0 < t && t < 100) return true;
-	}
-
-	// polygons
-	for (int p = 0; p < polygon_count; p++) {
-		if (p == p_index) continue;
-		float t = triangle_intersect(ray_o, ray_d, vertices[p * 3].xyz, vertices[p * 3 + 1].xyz, vertices[p * 3 + 2].xyz);
-		if (0 < t) return true;
-	}
-
-	return false;
-}
+// COLOR FUNCTIONS
 
 int luminance(uchar4 color) {
 	// from https://stackoverflow.com/questions/596216/formula-to-determine-brightness-of-rgb-color
@@ -297,6 +380,44 @@ uchar4 background_color(float3 ray_d)
 	return (uchar4)(convert_uchar3(color * 255), 0);
 }
 
+#ifdef KERNEL_COUNTERS
+
+// DEBUG FUNCTIONS
+
+void add_counts(uint* counts, __local uint* group_counts, __global uint* counters)
+{
+	// sum the work group in local memory so only one work item per counter touches global memory
+	const uint local_id = get_local_id(1) * get_local_size(0) + get_local_id(0);
+	const uint local_size = get_local_size(0) * get_local_size(1);
+
+	for (uint c = local_id; c < COUNTER_COUNT; c += local_size)
+		group_counts[c] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int c = 0; c < COUNTER_COUNT; c++) {
+		if (counts[c]) atomic_add(&group_counts[c], counts[c]);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// 64 bit total as (low, high), carry into high when low wraps
+	for (uint c = local_id; c < COUNTER_COUNT; c += local_size) {
+		uint add = group_counts[c];
+		uint old = atomic_add(&counters[c * 2], add);
+		if (old + add < old)
+			atomic_inc(&counters[c * 2 + 1]);
+	}
+}
+
+uchar4 heat_color(float heat)
+{
+	// blue -> cyan -> green -> yellow -> red, white past the maximum
+	if (1 < heat) return (uchar4)(255, 255, 255, 255);
+	float3 color = clamp((float3)(4 * heat - 2, 2 - fabs(4 * heat - 2), 2 - 4 * heat), 0.0f, 1.0f);
+	return (uchar4)(convert_uchar3(color * 255), 255);
+}
+
+#endif // KERNEL_COUNTERS
+
 /*
 constant vs. global: https://github.com/RadeonOpenCompute/ROCm/issues/203
 */
@@ -0,0 +1,182 @@
+/*
+Render constants and the intersection, lighting and colour packing routines shared by kernel.cl and the host.
+This header compiles as OpenCL C (included by the kernel at build time) and as C++ (glm types)
+so the routines can be run, checked and benchmarked on the cpu.
+*/
+
+#ifndef RENDER_MATH_H
+#define RENDER_MATH_H
+
+// CONFIG AND CONSTANTS (host code should include tools/Config.hpp first for HALF_RESOLUTION)
+
+#ifdef HALF_RESOLUTION
+#	define DITHER
+#endif
+
+#define DROP_OFF 1000
+
+#define LIGHT_RADIUS 3
+#define LIGHT_W PI / 4.37499f
+
+#define AMBIENT 0.2f
+#define LIGHT_STEP 0.2f
+
+#define BACKGROUND_OFFSET 0.3f
+#define BACKGROUND_MULTIPLIER 0.5f
+
+#define PI 3.14159265359f
+
+#ifdef __OPENCL_VERSION__
+
+#	define RM_FUNC
+
+#else // __OPENCL_VERSION__
+
+#	include <glm/glm.hpp>
+#	include <cmath>
+#	include <cstdint>
+
+#	define RM_FUNC inline
+
+namespace cd {
+namespace rm {
+
+	// opencl vector types
+
+	typedef glm::vec2 float2;
+	typedef glm::vec3 float3;
+	typedef glm::vec4 float4;
+	typedef glm::ivec2 int2;
+	typedef glm::uvec4 uint4;
+	typedef uint32_t uint;
+
+	// opencl built-in functions (precise versions on the host)
+
+	using glm::dot;
+	using glm::cross;
+	using glm::clamp;
+	using glm::sign;
+	using glm::min;
+	using glm::max;
+	using std::fabs;
+	using std::ceil;
+
+	inline float native_sqrt(float x) { return std::sqrt(x); }
+	inline float native_recip(float x) { return 1.0f / x; }
+	inline float3 fast_normalize(float3 v) { return glm::normalize(v); }
+
+#endif // __OPENCL_VERSION__
+
+// INTERSECTION FUNCTIONS
+
+RM_FUNC float sphere_intersect(float3 ray_o, float3 ray_d, float3 center, float radius)
+{
+	// a = P1 . P1 = 1 (assuming ray_d is normalized)
+	float3 d = center - ray_o;
+	float b = dot(d, ray_d);
+	float c = dot(d, d) - radius * radius;
+
+	float discriminant = b * b - c;
+	if (discriminant < 0) return -1;
+
+	float t = b - native_sqrt(discriminant);
+	return 0 < t ? t : -1;
+}
+
+RM_FUNC float triangle_intersect(float3 O, float3 D, float3 V0, float3 V1, float3 V2)
+{
+	// Moller-Trumbore algorithm. we use Cramer's rule to find [t,u,v]
+	// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
+	// returns -1 for no intersection, otherwise returns t (where intersection = O + tD)
+
+	float3 E1 = V1 - V0;
+	float3 E2 = V2 - V0;
+	float3 P = cross(D, E2);
+
+	float inv_det0 = native_recip(dot(P, E1));
+	float3 T = O - V0;
+
+	float u = dot(T, P) * inv_det0;
+	if (u < 0 || 1 < u) return -1;
+
+	float3 Q = cross(T, E1);
+	float v = dot(Q, D) * inv_det0;
+
+	return v < 0 || 1 < u + v ? -1 : dot(Q, E2) * inv_det0;
+}
+
+RM_FUNC float aabb_intersect(float3 ray_o, float3 inv_d, float3 lo, float3 hi, float max_t)
+{
+	// slab test. returns the distance the ray enters the box (0 when it starts inside),
+	// -1 when it misses or only enters beyond max_t
+	float3 t0 = (lo - ray_o) * inv_d;
+	float3 t1 = (hi - ray_o) * inv_d;
+	float3 t_near = min(t0, t1);
+	float3 t_far = max(t0, t1);
+
+	float enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0f));
+	float leave = min(min(t_far.x, t_far.y), min(t_far.z, max_t));
+	return enter <= leave ? enter : -1;
+}
+
+// LIGHTING FUNCTIONS
+
+RM_FUNC float diffuse_sphere(float3 normal, float3 intersection, float3 light)
+{
+	return clamp(dot(fast_normalize(normal), fast_normalize(light - intersection)), 0.0f, 1.0f);
+}
+
+RM_FUNC float diffuse_polygon(float3 normal, float3 intersection, float3 light_pos, float3 ray_d)
+{
+	float3 light_to_int = intersection - light_pos;
+	float light = fabs(dot(fast_normalize(normal), fast_normalize(light_to_int)));
+	return sign(dot(normal, light_to_int)) == sign(dot(normal, ray_d)) ? light : 0;
+}
+
+RM_FUNC float ceiling(float value, float multiple)
+{
+	return ceil(value/multiple) * multiple;
+}
+
+// PERFORMANCE COUNTERS (KERNEL_COUNTERS builds of the render kernel)
+
+// each counter is a (low, high) pair of uints in the counters buffer so totals can pass 2^32
+enum counter_index {
+	COUNTER_RAYS,			// primary rays (one per pixel)
+	COUNTER_SHADOW_RAYS,
+	COUNTER_SPHERE_TESTS,	// ray-sphere tests, including lights
+	COUNTER_TRIANGLE_TESTS,
+	COUNTER_BVH_NODES,		// acceleration structure nodes visited
+	COUNTER_COUNT
+};
+
+// COLOR PACKING
+
+typedef uint Packed;
+
+RM_FUNC Packed pack(uint4 convert)
+{
+	Packed packed = 0;
+	packed |= (convert.x & 0x000000FF);
+	packed |= (convert.y & 0x000000FF) << 8;
+	packed |= (convert.z & 0x000000FF) << 16;
+	packed |= (convert.w & 0x000000FF) << 24;
+	return packed;
+}
+
+RM_FUNC uint4 unpack(Packed packed)
+{
+	uint4 unpacked;
+	unpacked.x = (packed & 0x000000FF);
+	unpacked.y = (packed & 0x0000FF00) >> 8;
+	unpacked.z = (packed & 0x00FF0000) >> 16;
+	unpacked.w = (packed & 0xFF000000) >> 24;
+	return unpacked;
+}
+
+#ifndef __OPENCL_VERSION__
+} // namespace rm
+} // namespace cd
+#endif
+
+#endif // RENDER_MATH_H
@@ -0,0 +1,107 @@
+/*
+Linear blend skinning of the model vertices into one mesh of the vertex buffer read by the render kernel,
+then a refit of that mesh's bottom level bvh. One work item per unique vertex, the pose's bones start at bone_offset
+in the palette and the mesh's vertices at out_offset in the output. The refit is one work item per leaf, climbing
+towards the root: the second of two siblings to finish fits their parent.
+*/
+
+// matches cd::PackedVertex (Vertex.hpp), 16 bytes
+typedef struct
+{
+	ushort4 position; // fraction of the bind pose bounds * 65535
+	uchar4 bone_indices; // 255 = no bone
+	uchar4 bone_weights; // * 255, summing to 255 (or 0 for the bind position)
+} PackedVertex;
+
+// matches cd::BvhNode (Bvh.hpp), min.w = first child or primitive, max.w = primitive count (0 = interior)
+typedef struct
+{
+	float4 min;
+	float4 max;
+} BvhNode;
+
+float4 transform(float16 m, float4 v);
+
+// ENTRY POINTS
+
+__kernel void skin(__global const PackedVertex* __restrict vertices_in,
+				   __global const float16* __restrict bones, // global: the palette of many models can exceed constant memory
+				   __global float4* __restrict vertices_out,
+				   const int vertex_count, const int bone_offset, const int bone_count, const int out_offset,
+				   const float4 position_min, const float4 position_scale)
+{
+	const int v = get_global_id(0);
+	if (vertex_count <= v) return;
+
+	const PackedVertex vertex = vertices_in[v];
+	bones += bone_offset;
+	const float4 position = (float4)(position_min.xyz + convert_float3(vertex.position.xyz) * position_scale.xyz, 0);
+	const float4 unit_weights = convert_float4(vertex.bone_weights) * (1.0f / 255);
+	const int indices[4] = { vertex.bone_indices.x, vertex.bone_indices.y, vertex.bone_indices.z, vertex.bone_indices.w };
+	const float weights[4] = { unit_weights.x, unit_weights.y, unit_weights.z, unit_weights.w };
+
+	// weighted sum of the bone matrices, unassigned weight keeps the bind position
+	float16 animation = (float16)(0);
+	float weight_remaining = 1;
+	for (int b = 0; b < 4; b++) {
+		if (indices[b] < bone_count) {
+			animation += bones[indices[b]] * weights[b];
+			weight_remaining -= weights[b];
+	}	}
+	weight_remaining = clamp(weight_remaining, 0.0f, 1.0f);
+	animation += (float16)(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1) * weight_remaining;
+
+	// positions are stored with w = 0 so the translation (column 3) is added explicitly
+	vertices_out[out_offset + v] = transform(animation, position) + animation.sCDEF;
+}
+
+// one work item per leaf of every level of detail. parents (-1 at each root) and leaves are shared by every mesh, the
+// counters (one per node of every skinned mesh) count the children fitted and are back to 0 once the refit is done
+__kernel void refit(__global const float4* __restrict vertices, __global const uint4* __restrict triangles,
+					__global volatile BvhNode* nodes, __global const int* __restrict parents, __global const int* __restrict leaves,
+					__global volatile uint* counters,
+					const int vertex_offset, const int node_offset, const int leaf_count)
+{
+	const int l = get_global_id(0);
+	if (leaf_count <= l) return;
+	vertices += vertex_offset;
+	nodes += node_offset;
+	counters += node_offset;
+
+	int n = leaves[l];
+	BvhNode node = nodes[n];
+	float3 lo = (float3)(INFINITY);
+	float3 hi = (float3)(-INFINITY);
+	for (int t = as_int(node.min.w); t < as_int(node.min.w) + as_int(node.max.w); t++) {
+		const uint4 triangle = triangles[t];
+		const float3 v0 = vertices[triangle.x].xyz;
+		const float3 v1 = vertices[triangle.y].xyz;
+		const float3 v2 = vertices[triangle.z].xyz;
+		lo = fmin(lo, fmin(v0, fmin(v1, v2)));
+		hi = fmax(hi, fmax(v0, fmax(v1, v2)));
+	}
+
+	while (true) {
+		nodes[n].min = (float4)(lo, node.min.w);
+		nodes[n].max = (float4)(hi, node.max.w);
+
+		// the bounds are visible before the count, the first sibling to arrive leaves the parent to the second
+		n = parents[n];
+		if (n < 0) return;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+		if (atomic_inc(&counters[n]) == 0) return;
+		counters[n] = 0;
+		mem_fence(CLK_GLOBAL_MEM_FENCE);
+
+		node = nodes[n];
+		const int first = as_int(node.min.w);
+		lo = fmin(nodes[first].min.xyz, nodes[first + 1].min.xyz);
+		hi = fmax(nodes[first].max.xyz, nodes[first + 1].max.xyz);
+	}
+}
+
+// column major 4x4 (glm layout): column c = s[4c .. 4c + 3]
+float4 transform(float16 m, float4 v)
+{
+	return m.s0123 * v.x + m.s4567 * v.y + m.s89AB * v.z + m.sCDEF * v.w;
+}
@@ -1,3 +0,0 @@
-#version 430
-
-void main() {}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "Animator.hpp"
+
+#include "tools/Log.hpp"
+#include "tools/Trace.hpp"
+
+#include <cmath>
+
+// PUBLIC FUNCTIONS
+
+uint32_t Animator::addPlayer(const cd::CompressedClip *clip) {
+	// every player may need its own pose in the bone palette
+	if (players.size() == MAX_ANIMATED_MODELS) {
+		CD_ERROR("animator full: MAX_ANIMATED_MODELS = {} players", MAX_ANIMATED_MODELS);
+		throw std::runtime_error("animator add player");
+	}
+
+	cd::AnimationPlayer player;
+	player.clip = clip;
+	player.cursors.resize(clip->tracks.size(), 0);
+	players.push_back(std::move(player));
+	playerPoses.push_back(0);
+	return (uint32_t)players.size() - 1;
+}
+
+void Animator::seek(uint32_t id, double time) {
+	cd::AnimationPlayer &player = players[id];
+	player.time = time;
+	for (size_t t = 0; t < player.cursors.size(); t++)
+		player.cursors[t] = player.clip->FindKey(player.clip->tracks[t], time);
+}
+
+void Animator::update(double seconds) {
+	for (cd::AnimationPlayer &player : players) {
+		if (!player.playing) continue;
+
+		double duration = player.clip->duration;
+		player.time += seconds * player.speed;
+		if (player.loop && duration > 0) {
+			player.time = fmod(player.time, duration);
+			if (player.time < 0) player.time += duration;
+		} else if (player.time < 0 || duration < player.time) {
+			player.time = player.time < 0 ? 0 : duration;
+			player.playing = false;
+		}
+	}
+}
+
+uint32_t Animator::evaluate(glm::mat4 *palette) {
+	CD_ZONE("Animator::evaluate");
+	poses.clear();
+
+	for (size_t p = 0; p < players.size(); p++) {
+		cd::AnimationPlayer &player = players[p];
+		double time = timeStep > 0 ? std::round(player.time / timeStep) * timeStep : player.time;
+
+		// few players, a linear search is cheaper than hashing
+		uint32_t pose = 0;
+		while (pose < poses.size() && !(poses[pose].clip == player.clip && poses[pose].time == time))
+			pose++;
+		playerPoses[p] = pose;
+		if (pose < poses.size())
+			continue;
+
+		poses.push_back({ player.clip, time });
+		player.clip->Sample(time, palette + pose * MAX_BONES, player.cursors.data());
+	}
+	return (uint32_t)poses.size();
+}
+
+void Animator::cleanUp() {
+	players.clear();
+	poses.clear();
+	playerPoses.clear();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "model/CompressedClip.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace cd {
+	// playback state of one clip, shared by every instance that uses the player
+	struct AnimationPlayer {
+		const CompressedClip *clip = nullptr;
+		double time = 0;			// seconds into the clip
+		float speed = 1;			// negative plays backwards
+		bool loop = true;
+		bool playing = true;
+		std::vector<uint32_t> cursors; // key of each track at the last evaluation
+	};
+}
+
+/*
+Owns the animation players of every animated instance. Each frame update() advances all players and
+evaluate() samples them into the bone palette in one pass. Players showing the same clip at the same
+time share one pose, which is sampled (and later skinned) once. Players remember the key each track
+was last sampled at, so steady playback finds its keys in constant time and only a seek or loop wrap
+falls back to a binary search.
+*/
+class Animator {
+public:
+	uint32_t addPlayer(const cd::CompressedClip *clip); // returns the player id
+	inline cd::AnimationPlayer &getPlayer(uint32_t id) { return players[id]; }
+
+	// > 0 evaluates at the nearest multiple of the step so more players share poses (POSE_CACHE)
+	inline void setTimeStep(double step) { timeStep = step; }
+
+	void seek(uint32_t id, double time);
+	void update(double seconds); // advances every playing player
+
+	// pose p is written to palette + p * MAX_BONES (mapped memory of the current BonePalette slot), returns the pose count
+	uint32_t evaluate(glm::mat4 *palette);
+	inline uint32_t getPose(uint32_t player) const { return playerPoses[player]; }
+	inline double getPoseTime(uint32_t pose) const { return poses[pose].time; }
+
+	void cleanUp();
+
+private:
+	struct Pose {
+		const cd::CompressedClip *clip;
+		double time;
+	};
+
+	std::vector<cd::AnimationPlayer> players;
+	std::vector<Pose> poses; // of the last evaluate
+	std::vector<uint32_t> playerPoses;
+	double timeStep = 0;
+};
@@ -0,0 +1,77 @@
+#include "BonePalette.hpp"
+
+#include "tools/Log.hpp"
+#include "tools/Trace.hpp"
+
+#include <algorithm>
+
+static_assert(FRAMES_IN_FLIGHT <= BONE_PALETTE_FRAMES, "a palette slot would be rewritten while a frame in flight may still use it");
+
+// PUBLIC FUNCTIONS
+
+void BonePalette::init(const cl::Context &context, const cl::CommandQueue &queue, uint32_t capacity) {
+	this->queue = queue;
+	this->capacity = capacity;
+	size_t slotBytes = sizeof(glm::mat4) * capacity;
+	cl_int result;
+
+	pinned = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, slotBytes * BONE_PALETTE_FRAMES, NULL, &result);
+	if (result) {
+		CD_ERROR("pinned bone palette create error: {}", result);
+		throw std::runtime_error("bone palette init");
+	}
+
+	// stays mapped until cleanUp, the mapped pointer is the source of every upload
+	mapped = (glm::mat4 *)this->queue.enqueueMapBuffer(pinned, CL_TRUE, CL_MAP_WRITE, 0, slotBytes * BONE_PALETTE_FRAMES, NULL, NULL, &result);
+	if (result) {
+		CD_ERROR("bone palette map error: {}", result);
+		throw std::runtime_error("bone palette init");
+	}
+	for (uint32_t m = 0; m < capacity * BONE_PALETTE_FRAMES; m++)
+		mapped[m] = glm::mat4(1.0f);
+
+	for (cl::Buffer &buffer : deviceBuffers) {
+		buffer = cl::Buffer(context, CL_MEM_READ_ONLY, slotBytes, NULL, &result);
+		if (result) {
+			CD_ERROR("bone palette create error: {}", result);
+			throw std::runtime_error("bone palette init");
+		}
+	}
+	CD_INFO("bone palette bytes = {} pinned + {} device", slotBytes * BONE_PALETTE_FRAMES, slotBytes * BONE_PALETTE_FRAMES);
+}
+
+uint32_t BonePalette::allocate(uint32_t boneCount) {
+	if (capacity < allocated + boneCount) {
+		CD_ERROR("bone palette full: {} of {} matrices used, {} requested", allocated, capacity, boneCount);
+		throw std::runtime_error("bone palette allocate");
+	}
+	uint32_t offset = allocated;
+	allocated += boneCount;
+	return offset;
+}
+
+glm::mat4 *BonePalette::beginFrame() {
+	CD_ZONE("BonePalette::beginFrame");
+	current = frame++ % BONE_PALETTE_FRAMES;
+
+	// normally complete already, BONE_PALETTE_FRAMES frames have passed since this slot was uploaded
+	if (uploads[current]())
+		uploads[current].wait();
+	return mapped + current * capacity;
+}
+
+cl::Event BonePalette::endFrame(uint32_t boneCount) {
+	// only the used range, from pinned memory so the transfer doesn't need a staging copy
+	boneCount = std::min(boneCount, allocated);
+	queue.enqueueWriteBuffer(deviceBuffers[current], CL_FALSE, 0, sizeof(glm::mat4) * boneCount,
+		mapped + current * capacity, NULL, &uploads[current]);
+	return uploads[current];
+}
+
+void BonePalette::cleanUp() {
+	if (!mapped) return;
+	queue.finish();
+	queue.enqueueUnmapMemObject(pinned, mapped);
+	queue.finish();
+	mapped = nullptr;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "tools/Config.hpp"
+
+#include <CL/cl.hpp>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+
+/*
+Bone matrices of every animated model for the skinning kernel. The host side is a pinned buffer mapped once
+at init with BONE_PALETTE_FRAMES slots: the animation system writes each frame's matrices straight into the
+current slot and the slot is uploaded to its own device buffer with a non-blocking dma transfer. A slot is only
+written again once its previous upload has completed, which with BONE_PALETTE_FRAMES >= FRAMES_IN_FLIGHT
+has already happened so neither the host nor the driver waits.
+*/
+class BonePalette {
+public:
+	void init(const cl::Context &context, const cl::CommandQueue &queue, uint32_t capacity);
+
+	uint32_t allocate(uint32_t boneCount); // offset of a model's matrices in every slot
+
+	glm::mat4 *beginFrame(); // mapped memory of the next slot
+	cl::Event endFrame(uint32_t boneCount); // uploads the first boneCount matrices of the slot, skinning waits on the returned event
+	inline const cl::Buffer &getBuffer() { return deviceBuffers[current]; }
+
+	void cleanUp();
+
+private:
+	cl::CommandQueue queue;
+
+	cl::Buffer pinned; // BONE_PALETTE_FRAMES * capacity matrices, CL_MEM_ALLOC_HOST_PTR
+	glm::mat4 *mapped = nullptr;
+	cl::Buffer deviceBuffers[BONE_PALETTE_FRAMES];
+	cl::Event uploads[BONE_PALETTE_FRAMES];
+
+	uint32_t capacity = 0;
+	uint32_t allocated = 0;
+	uint32_t current = 0;
+	uint64_t frame = 0;
+};
@@ -3,6 +3,7 @@
 #define GLM_FORCE_RADIANS
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/rotate_vector.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <iomanip>
 #include <math.h>
@@ -10,12 +11,24 @@
 #include "model/Model_Loader.hpp"
 #include "tools/Inputs.hpp"
 #include "tools/Log.hpp"
+#include "tools/Benchmark.hpp"
+#include "tools/GoldenTest.hpp"
+#include "tools/ReferenceRenderer.hpp"
+#include "tools/Profiler.hpp"
+#include "tools/Trace.hpp"
 
 //#define PRINT_FPS
 
 using namespace std::chrono;
 
-#define MAIZE_FILE "../assets/maize_v1.bin"
+#define MAIZE_FILE "../assets/maize_v4.bin" /* converted from maize_v1.bin: packed, lz sections, prebaked bvh, levels of detail */
+#define CROWD_SIZE 7			/* maize instances */
+#define CROWD_SPACING 8.0f		/* between rows */
+#define CROWD_TIME_OFFSET 0.35	/* s, animation offset of each player */
+#define PROP_FILE "../assets/cave_static_v4.bin" /* converted from cave_v0.bin with --static */
+#define PROP_COUNT 4			/* static rocks in a row in front of the crowd */
+#define PROP_DISTANCE 14.0f		/* in front of the crowd */
+#define PROP_SCALE 2.0f
 
 // MAIN FUNCTIONS
 
@@ -34,7 +47,12 @@ int main() {
 void Cedai::Run() {
 	init();
 
+#	ifdef GOLDEN_TEST
+	if (!goldenTest())
+		throw std::runtime_error("golden image test failed");
+#	else
 	loop();
+#	endif
 
 	//cleanUp();
 }
@@ -49,6 +67,10 @@ void Cedai::init() {
 	Log::Init();
 	CD_INFO("Logger initialised");
 
+#	ifdef BENCHMARK_RENDER_MATH
+	cd::benchmarkRenderMath();
+#	endif
+
 #	ifndef CD_PLATFORM_WINDOWS
 #	ifndef CD_PLATFORM_LINUX
 	CD_ERROR("Unsupported platform: only windows and linux are supported at this time.");
@@ -60,16 +82,38 @@ void Cedai::init() {
 	windowHeight = INIT_SCREEN_HEIGHT;
 
 	interface.init(this, windowWidth, windowHeight);
+	glTimer.init();
 	CD_INFO("Interface initialised.");
 
 	createPrimitives();
-	vertexProcessor.init(&interface, maize.vertices, maize.GetBoneTransforms());
-	CD_INFO("Pimitive processing program initialised.");
-
-	renderer.init(windowWidth, windowHeight, &interface, &vertexProcessor,
+	renderer.init(windowWidth, windowHeight, &interface,
 		spheres, lights, cl_polygonColors);
 	CD_INFO("Renderer initialised.");
 
+	// one palette pose per player
+	bonePalette.init(renderer.getContext(), renderer.getQueue(), MAX_BONES * MAX_ANIMATED_MODELS);
+	bonePalette.allocate(MAX_BONES * MAX_ANIMATED_MODELS);
+
+	vertexProcessor.init(&renderer, maize);
+	uint32_t propMesh = vertexProcessor.addStaticMesh(prop, propFirstColor);
+	uint32_t cachedMeshes = 0;
+#	ifdef POSE_CACHE
+	animator.setTimeStep(1.0 / POSE_CACHE_RATE);
+	poseCache.init(&maize.animation, vertexProcessor.getMeshBytes());
+	cachedMeshes = poseCache.getEntryCount();
+#	endif
+	vertexProcessor.createMeshes(cachedMeshes);
+
+	// static instances never move, their top level entries are made once
+	for (cd::StaticInstance &instance : staticInstances) {
+		instance.mesh = propMesh;
+		staticGpuInstances.emplace_back(instance.transform, vertexProcessor.staticVertexOffset(instance.mesh),
+			vertexProcessor.staticNodeOffset(instance.mesh));
+		staticBounds.push_back(prop.bounds.transformed(instance.transform));
+	}
+	renderer.setMeshes(vertexProcessor.getVertexBuffer(), vertexProcessor.getTriangleBuffer(), vertexProcessor.getNodeBuffer());
+	CD_INFO("Pimitive processing program initialised.");
+
 	view[0][0] = 1; view[1][1] = 1; view[2][2] = 1;
 	CD_INFO("Engine initialised.");
 	quit = false;
@@ -78,20 +122,27 @@ void Cedai::init() {
 
 void Cedai::loop() {
 	time_point<high_resolution_clock> timeStart = high_resolution_clock::now();
+	uint64_t frame = 0;
+	double timePrev = 0;
 
+	// frame N is queued on the gpu, then game logic for frame N + 1 runs while the gpu works, then
+	// frame N + 1 - FRAMES_IN_FLIGHT is drawn. each frame slot has its own vertex buffer and output texture
 	while (!quit && !interface.WindowCloseCheck()) {
+		CD_ZONE("frame");
+		uint32_t slot = frame++ % FRAMES_IN_FLIGHT;
+
 		// window resize check
 #		ifdef RESIZABLE
 		resizeCheck();
 #		endif
 		
 		// 1) transform vertices
-		vertexProcessor.vertexProcess(maize.GetBoneTransforms());
-		vertexProcessor.vertexBarrier();
+		std::vector<cl::Event> verticesReady;
+		skinModels(slot, verticesReady);
 		
 		// 2) queue a render operation
 		double time = duration<double, seconds::period>(high_resolution_clock::now() - timeStart).count();
-		renderer.renderQueue(view, (float)time);
+		renderer.renderQueue(view, (float)time, slot, verticesReady);
 
 		// input handling
 		interface.PollEvents();
@@ -100,26 +151,125 @@ void Cedai::loop() {
 
 		// game logic
 		processInputs();
-		updateAnimation(time);
+		updateAnimation(time - timePrev);
+		timePrev = time;
 		fpsHandle();
 
-		renderer.renderBarrier();
-		// 3) draw to window
-		interface.drawRun();
-		interface.drawBarrier();
+		// 3) draw the oldest frame in flight to the window
+		int presentSlot = renderer.renderBarrier();
+		if (presentSlot >= 0) {
+			glTimer.begin(cd::stage_draw, Profiler::Frame() + 1 - FRAMES_IN_FLIGHT);
+			interface.drawRun(presentSlot);
+			glTimer.end(cd::stage_draw);
+			interface.drawBarrier();
+		}
+
+		glTimer.nextFrame();
+#		ifdef POSE_CACHE
+		poseCache.nextFrame();
+#		endif
+		Profiler::NextFrame();
+		Trace::EndFrame();
 	}
 }
 
 void Cedai::cleanUp() {
 	CD_INFO("Average fps = {}", fpsSum / fpsCount);
+	Trace::Write(); // if closed before the trace window ended
 
-	renderer.cleanUp();
 	vertexProcessor.cleanUp();
+#	ifdef POSE_CACHE
+	poseCache.cleanUp();
+#	endif
+	animator.cleanUp();
+	bonePalette.cleanUp();
+	renderer.cleanUp();
+	glTimer.cleanUp();
 	interface.cleanUp();
 
 	CD_INFO("Finished cleaning.");
 }
 
+bool Cedai::goldenTest() {
+	CD_INFO("running golden image tests...");
+
+	cd::ReferenceScene scene;
+	scene.spheres = spheres;
+	scene.lights = lights;
+
+	std::vector<glm::u8vec4> image, reference;
+	std::vector<glm::vec4> meshVertices;
+	uint32_t players = 0;
+	for (const cd::ModelInstance &instance : instances)
+		players = std::max(players, instance.player + 1);
+	int failures = 0;
+
+	for (const cd::GoldenCase &test : cd::goldenCases()) {
+		// camera
+		viewerPosition = test.position;
+		viewerForward = glm::normalize(test.target - test.position);
+		viewerCross = glm::normalize(glm::cross(test.up, viewerForward));
+		viewerUp = glm::cross(viewerForward, viewerCross);
+		updateView();
+
+		// animation, the crowd keeps its offsets from the first player
+		for (uint32_t player = 0; player < players; player++)
+			animator.seek(player, test.animationTime + player * CROWD_TIME_OFFSET);
+
+		// opencl render (not pipelined)
+		std::vector<cl::Event> verticesReady;
+		fullDetail = true;
+		skinModels(0, verticesReady);
+		fullDetail = false;
+		renderer.renderQueue(view, test.time, 0, verticesReady);
+		renderer.renderFinish();
+		interface.readDrawTexture(image, 0);
+
+		// cpu reference of the same (skinned) scene with every instance in world space
+		scene.vertices.clear();
+		scene.polygonColors.clear();
+		for (size_t i = 0; i < instances.size(); i++) {
+			vertexProcessor.readVertices(meshVertices, instanceMeshes[i]);
+			for (const glm::uvec3 &triangle : maize.indices) {
+				for (int corner = 0; corner < 3; corner++)
+					scene.vertices.push_back(instances[i].transform * glm::vec4(glm::vec3(meshVertices[triangle[corner]]), 1));
+			}
+			scene.polygonColors.insert(scene.polygonColors.end(), cl_polygonColors.begin(), cl_polygonColors.begin() + maize.indices.size());
+		}
+		for (const cd::StaticInstance &instance : staticInstances) {
+			for (const glm::uvec3 &triangle : prop.indices) {
+				for (int corner = 0; corner < 3; corner++)
+					scene.vertices.push_back(instance.transform * glm::vec4(glm::vec3(prop.vertices[triangle[corner]]), 1));
+			}
+			scene.polygonColors.insert(scene.polygonColors.end(), cl_polygonColors.begin() + propFirstColor,
+				cl_polygonColors.begin() + propFirstColor + prop.indices.size());
+		}
+		cd::renderReference(scene, view, test.time, windowWidth, windowHeight, reference);
+
+		if (!cd::checkGolden(test.name, image, reference, windowWidth, windowHeight))
+			failures++;
+	}
+
+	// the images trace level 0 as the reference renders the full mesh, the selection is checked on its own: coarser
+	// levels as the projected scale shrinks, from level 0 up close to the coarsest far away
+	uint32_t lodCount = vertexProcessor.lodCount(), previous = 0;
+	bool lodsPass = lodCount > 1 && vertexProcessor.selectLod(1e9f) == 0 && vertexProcessor.selectLod(0) == lodCount - 1;
+	for (float pixelsPerUnit = 1e4f; pixelsPerUnit > 1e-4f && lodsPass; pixelsPerUnit *= 0.5f) {
+		uint32_t lod = vertexProcessor.selectLod(pixelsPerUnit);
+		lodsPass = previous <= lod;
+		previous = lod;
+	}
+	if (lodsPass) {
+		CD_INFO("golden test 'lod selection' passed: {} levels", lodCount);
+	} else {
+		CD_WARN("golden test 'lod selection' FAILED: {} levels, a model with levels of detail is needed", lodCount);
+		failures++;
+	}
+
+	CD_INFO("golden image tests finished: {} of {} failed", failures, cd::goldenCases().size() + 1);
+	return failures == 0;
+}
+
 // INITIALIZATION
 
 void Cedai::createPrimitives() {
@@ -152,17 +302,44 @@ void Cedai::createPrimitives() {
 
 	CD_INFO("loading model(s)...");
 
-	cd::LoadModelv1(MAIZE_FILE, maize);
-	for (int p = 0; p < maize.vertices.size() / 3; p++)
+	cd::LoadModel(MAIZE_FILE, maize);
+
+	// the original in the middle of rows of copies, both copies in a row share a player so they are skinned once
+	for (int i = 0; i < CROWD_SIZE; i++) {
+		int row = (i + 1) / 2;
+		float side = i % 2 ? 1.0f : -1.0f;
+		cd::ModelInstance instance;
+		instance.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0, side * row * CROWD_SPACING, 0))
+			* glm::rotate(glm::mat4(1.0f), side * row * 0.3f, glm::vec3(0, 0, 1));
+		if (i == 0 || i % 2) {
+			instance.player = animator.addPlayer(&maize.animation);
+			animator.seek(instance.player, instance.player * CROWD_TIME_OFFSET);
+		} else {
+			instance.player = instances.back().player;
+		}
+		instances.push_back(instance);
+	}
+	for (size_t p = 0; p < maize.indices.size(); p++)
 		cl_polygonColors.push_back(cl_uchar4{ { 200, 200, 200, 255 } });
 
-	if (maize.vertices.size() != cl_polygonColors.size() * 3)
-		CD_WARN("Cedai model init warning: unequal number of vertices for the number of polygons");
+	// static props, standing on the ground under the crowd
+	cd::LoadStaticModel(PROP_FILE, prop);
+	for (int i = 0; i < PROP_COUNT; i++) {
+		cd::StaticInstance instance;
+		float y = (i - (PROP_COUNT - 1) / 2.0f) * CROWD_SPACING;
+		instance.transform = glm::translate(glm::mat4(1.0f), glm::vec3(PROP_DISTANCE, y, maize.bounds.min.z - prop.bounds.min.z * PROP_SCALE))
+			* glm::rotate(glm::mat4(1.0f), (float)i, glm::vec3(0, 0, 1)) * glm::scale(glm::mat4(1.0f), glm::vec3(PROP_SCALE));
+		staticInstances.push_back(instance);
+	}
+	propFirstColor = (uint32_t)cl_polygonColors.size();
+	for (size_t p = 0; p < prop.indices.size(); p++)
+		cl_polygonColors.push_back(cl_uchar4{ { 150, 130, 110, 255 } });
 
 	CD_INFO("model(s) loaded.");
 
 	CD_INFO("number of vertices = {}", maize.vertices.size());
 	CD_INFO("number of polygons = {}", cl_polygonColors.size());
+	CD_INFO("number of instances = {} animated, {} static", instances.size(), staticInstances.size());
 }
 
 // GAME LOGIC
@@ -172,6 +349,7 @@ void Cedai::resizeCheck() {
 		CD_WARN("window resizing...");
 		windowResized = false;
 
+		renderer.renderFinish();
 		interface.resize(windowWidth, windowHeight);
 		renderer.resize(windowWidth, windowHeight, &interface);
 	}
@@ -179,6 +357,8 @@ void Cedai::resizeCheck() {
 }
 
 void Cedai::processInputs() {
+	CD_ZONE("Cedai::processInputs");
+
 	// get time difference
 	static time_point<high_resolution_clock> timePrev = high_resolution_clock::now();
 	double timeDif = duration<double, seconds::period>(high_resolution_clock::now() - timePrev).count();
@@ -225,18 +405,86 @@ void Cedai::processInputs() {
 		viewerPosition += viewerUp * glm::vec3(inputs & CD_INPUTS::UP ? strafeSpeed * timeDif : -strafeSpeed * timeDif);
 
 	updateView();
+
+	// DEBUG VIEWS
+
+#	ifdef KERNEL_COUNTERS
+	static bool heatmap = false;
+	static bool heatmapHeld = false;
+	if ((bool)(inputs & CD_INPUTS::HEATMAP) && !heatmapHeld) {
+		heatmap = !heatmap;
+		renderer.setHeatmap(heatmap);
+	}
+	heatmapHeld = inputs & CD_INPUTS::HEATMAP;
+#	endif
 }
 
-void Cedai::updateAnimation(double time) {
-	double relativeTime = fmod(time, maize.animation.duration);
+void Cedai::updateAnimation(double seconds) {
+	CD_ZONE("Cedai::updateAnimation");
+	animator.update(seconds);
+}
 
-	// figure out which frame we're on
-	for (int f = 0; f < maize.animation.keyframes.size() - 1; f++) {
-		if (maize.animation.keyframes[f].time <= relativeTime && relativeTime < maize.animation.keyframes[f + 1].time) {
-			maize.keyFrameIndex = f;
-			break;
+void Cedai::skinModels(uint32_t slot, std::vector<cl::Event> &verticesReady) {
+	// players at the same time share a pose, each pose is skinned into one mesh
+	uint32_t poseCount = animator.evaluate(bonePalette.beginFrame());
+	cl::Event bonesReady = bonePalette.endFrame(poseCount * MAX_BONES);
+
+	std::vector<uint32_t> poseMeshes(poseCount);
+	for (uint32_t pose = 0; pose < poseCount; pose++) {
+#		ifdef POSE_CACHE
+		// player times are snapped to cached poses, which are only skinned the first time they are seen
+		uint32_t cached = poseCache.pose(animator.getPoseTime(pose));
+		uint32_t entry;
+		cl::Event ready;
+		if (poseCache.find(cached, entry, ready)) {
+			poseMeshes[pose] = vertexProcessor.cachedMesh(entry);
+			if (ready())
+				verticesReady.push_back(ready);
+			continue;
+		}
+		if (poseCache.insert(cached, entry)) {
+			poseMeshes[pose] = vertexProcessor.cachedMesh(entry);
+			vertexProcessor.vertexProcess(bonePalette.getBuffer(), pose * MAX_BONES, bonesReady, poseMeshes[pose], verticesReady);
+			poseCache.skinned(cached, verticesReady.back());
+			continue;
 		}
+#		endif
+
+		poseMeshes[pose] = vertexProcessor.liveMesh(slot, pose);
+		vertexProcessor.vertexProcess(bonePalette.getBuffer(), pose * MAX_BONES, bonesReady, poseMeshes[pose], verticesReady);
 	}
+
+	// the kernel's focal length is the image width in pixels
+#	ifdef HALF_RESOLUTION
+	float focalLength = windowWidth / 2.0f;
+#	else
+	float focalLength = (float)windowWidth;
+#	endif
+
+	// instances reference the mesh of their player's pose, and the level of detail of their projected size
+	std::vector<cd::GpuInstance> gpuInstances;
+	std::vector<cd::Aabb> bounds;
+	instanceMeshes.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); i++) {
+		uint32_t mesh = poseMeshes[animator.getPose(instances[i].player)];
+		instanceMeshes[i] = mesh;
+		bounds.push_back(maize.bounds.transformed(instances[i].transform));
+
+		// model units to pixels at the nearest point of the bounds, the largest axis scale of the transform
+		const glm::mat4 &transform = instances[i].transform;
+		float scale = glm::max(glm::length(glm::vec3(transform[0])),
+			glm::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		float distance = glm::length(glm::max(glm::vec3(0), glm::max(bounds.back().min - viewerPosition, viewerPosition - bounds.back().max)));
+		uint32_t lod = fullDetail || distance == 0 ? 0 : vertexProcessor.selectLod(focalLength * scale / distance);
+		uint32_t shadowLod = fullDetail ? 0 : std::min(lod + LOD_SHADOW_BIAS, vertexProcessor.lodCount() - 1);
+
+		gpuInstances.emplace_back(transform, vertexProcessor.vertexOffset(mesh), vertexProcessor.nodeOffset(mesh),
+			vertexProcessor.lodRoot(lod), vertexProcessor.lodRoot(shadowLod));
+	}
+	// static meshes are never skinned or refit, only the top level bvh over them is rebuilt with the rest
+	gpuInstances.insert(gpuInstances.end(), staticGpuInstances.begin(), staticGpuInstances.end());
+	bounds.insert(bounds.end(), staticBounds.begin(), staticBounds.end());
+	renderer.setInstances(slot, gpuInstances, bounds);
 }
 
 // HELPER
@@ -276,8 +524,16 @@ void Cedai::fpsHandle() {
 #		ifdef PRINT_FPS
 		CD_TRACE("fps = {}", fps);
 #		endif
-#		ifdef DEBUG
-		interface.showFPS(fps);
+		std::string stats;
+#		ifdef PROFILE_GPU
+		Profiler::LogSummary();
+		stats = Profiler::Summary();
+#		endif
+#		ifdef KERNEL_COUNTERS
+		renderer.logCounters();
+#		endif
+#		if defined(DEBUG) || defined(PROFILE_GPU)
+		interface.showFPS(fps, stats);
 #		endif
 
 		fpsSum += fps;
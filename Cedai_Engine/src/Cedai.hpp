@@ -11,7 +11,13 @@ the number of polygons rendered depends on the number of polygon colors passed t
 
 #include "Renderer.hpp"
 #include "PrimitiveProcessor.hpp"
+#include "BonePalette.hpp"
+#include "Animator.hpp"
+#include "PoseCache.hpp"
+#include "tools/GLTimer.hpp"
 #include "model/AnimatedModel.hpp"
+#include "model/StaticModel.hpp"
+#include "model/Instance.hpp"
 #include "model/Sphere.hpp"
 
 #include <glm/glm.hpp>
@@ -31,9 +37,17 @@ private:
 	void loop();
 	void cleanUp();
 
+	bool goldenTest();
+
 	Interface interface;
 	Renderer renderer;
 	PrimitiveProcessor vertexProcessor;
+	BonePalette bonePalette;
+	Animator animator;
+#	ifdef POSE_CACHE
+	PoseCache poseCache;
+#	endif
+	GLTimer glTimer;
 
 	bool quit = false;
 	bool windowResized = false;
@@ -43,6 +57,15 @@ private:
 	float view[4][4] = { 0 };
 
 	AnimatedModel maize;
+	std::vector<cd::ModelInstance> instances;
+	std::vector<uint32_t> instanceMeshes; // PrimitiveProcessor mesh of each instance in the last frame
+	bool fullDetail = false; // every instance traces level of detail 0, as the golden test's reference renders the full mesh
+
+	StaticModel prop;
+	uint32_t propFirstColor = 0; // of its triangles in the polygon colors
+	std::vector<cd::StaticInstance> staticInstances;
+	std::vector<cd::GpuInstance> staticGpuInstances; // after init, appended to the animated instances every frame
+	std::vector<cd::Aabb> staticBounds;
 
 	std::vector<cd::Sphere> spheres;
 	std::vector<cd::Sphere> lights;
@@ -67,7 +90,8 @@ private:
 
 	void resizeCheck();
 	void processInputs();
-	void updateAnimation(double time);
+	void updateAnimation(double seconds);
+	void skinModels(uint32_t slot, std::vector<cl::Event> &verticesReady);
 
 	void updateView();
 	void printViewData();
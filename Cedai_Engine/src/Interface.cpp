@@ -2,6 +2,7 @@
 
 #include "Cedai.hpp"
 #include "tools/Log.hpp"
+#include "tools/Trace.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -70,8 +71,8 @@ void Interface::init(Cedai *application, int window_width, int window_height) {
 	glfwGetCursorPos(window, &mousePosPrev[0], &mousePosPrev[1]); // get mouse position
 
 	// set up opengl draw program
-	cd::createProgramGL(drawPipeline.programHandle, VERT_PATH, FRAG_PATH, false);
-	createDrawTexture();
+	cd::createProgramGL(drawPipeline.programHandle, VERT_PATH, FRAG_PATH);
+	createDrawTextures();
 	setProgramIO();
 	cd::checkErrorsGL("draw program create");
 
@@ -79,13 +80,16 @@ void Interface::init(Cedai *application, int window_width, int window_height) {
 	mapKeys();
 }
 
-GLuint Interface::getTexHandle() { return drawPipeline.texHandle; }
+GLuint Interface::getTexHandle(uint32_t slot) { return drawPipeline.texHandles[slot]; }
 GLenum Interface::getTexTarget() { return drawPipeline.texTarget; }
 GLFWwindow* Interface::getWindow() { return window; }
 
-void Interface::drawRun() {
+void Interface::drawRun(uint32_t slot) {
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(drawPipeline.texTarget, drawPipeline.texHandles[slot]);
+
 	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
 	glVertexAttribPointer(vertexLocation, 2, GL_FLOAT, GL_FALSE, 0, 0);
 	glEnableVertexAttribArray(vertexLocation);
@@ -97,10 +101,19 @@ void Interface::drawRun() {
 }
 
 void Interface::drawBarrier() {
-	glFinish();
+	CD_ZONE("Interface::drawBarrier");
+	// no glFinish, the swap only queues the frame and later frames are already in flight
 	glfwSwapBuffers(window);
 }
 
+void Interface::readDrawTexture(std::vector<glm::u8vec4> &pixels, uint32_t slot) {
+	pixels.resize(windowWidth * windowHeight);
+	glBindTexture(drawPipeline.texTarget, drawPipeline.texHandles[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(drawPipeline.texTarget, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, pixels.data());
+	cd::checkErrorsGL("read draw texture");
+}
+
 void Interface::MinimizeCheck() {
 	int width = 0, height = 0;
 	while (width == 0 || height == 0) {
@@ -109,9 +122,9 @@ void Interface::MinimizeCheck() {
 	}
 }
 
-void Interface::showFPS(int fps) {
+void Interface::showFPS(int fps, const std::string &stats) {
 	std::string title = WINDOW_TITLE;
-	title += " fps: " + std::to_string(fps);
+	title += " fps: " + std::to_string(fps) + stats;
 	glfwSetWindowTitle(window, title.c_str());
 }
 
@@ -150,21 +163,19 @@ void Interface::resize(int &window_width, int &window_height) {
 	window_width = windowWidth;
 	window_height = windowHeight;
 
-	//glBindTexture(drawPipeline.texTarget, drawPipeline.texHandle);
-	glDeleteTextures(1, &drawPipeline.texHandle);
-	drawPipeline.texHandle = -1;
-	createDrawTexture();
+	glDeleteTextures(FRAMES_IN_FLIGHT, drawPipeline.texHandles);
+	createDrawTextures();
 }
 
 void Interface::cleanUp() {
-	glDeleteTextures(1, &drawPipeline.texHandle);
+	glDeleteTextures(FRAMES_IN_FLIGHT, drawPipeline.texHandles);
 	glfwDestroyWindow(window);
 	glfwTerminate();
 }
 
 // OPENGL HELPER FUNCTIONS
 
-void cd::createProgramGL(GLuint &program, std::string vertPath, std::string fragPath, bool defineBones) {
+void cd::createProgramGL(GLuint &program, std::string vertPath, std::string fragPath) {
 	program = glCreateProgram();
 
 	GLuint vert = glCreateShader(GL_VERTEX_SHADER);
@@ -173,15 +184,6 @@ void cd::createProgramGL(GLuint &program, std::string vertPath, std::string frag
 	std::string vertSrc = cd::readFile(vertPath.c_str());
 	std::string fragSrc = cd::readFile(fragPath.c_str());
 
-	// define bone array size
-	if (0) {
-		// find the #version line
-		char c = '\0';
-		while (c != '\0') {
-
-		}
-	}
-
 	GLchar const* vertString[] = { vertSrc.c_str() };
 	GLchar const* fragString[] = { fragSrc.c_str() };
 
@@ -285,20 +287,24 @@ void Interface::mapKeys() {
 
 	keyBindings[GLFW_KEY_Z] = CD_INPUTS::INTERACTL;
 	keyBindings[GLFW_KEY_X] = CD_INPUTS::INTERACTR;
+
+	keyBindings[GLFW_KEY_H] = CD_INPUTS::HEATMAP;
 }
 
-void Interface::createDrawTexture() {
-	// create output texture for opencl to write to
-	glGenTextures(1, &drawPipeline.texHandle);
+void Interface::createDrawTextures() {
+	// create output textures for opencl to write to (opencl renders into one while another is drawn)
+	glGenTextures(FRAMES_IN_FLIGHT, drawPipeline.texHandles);
 	drawPipeline.texTarget = GL_TEXTURE_2D;
-	glBindTexture(drawPipeline.texTarget, drawPipeline.texHandle);
+	for (GLuint texHandle : drawPipeline.texHandles) {
+		glBindTexture(drawPipeline.texTarget, texHandle);
 
-	glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(drawPipeline.texTarget, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glTexImage2D(drawPipeline.texTarget, 0, GL_RGBA8UI, windowWidth, windowHeight, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+		glTexImage2D(drawPipeline.texTarget, 0, GL_RGBA8UI, windowWidth, windowHeight, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+	}
 	glUniform1i(glGetUniformLocation(drawPipeline.programHandle, "srcTex"), 0);
 	cd::checkErrorsGL("texture gen");
 }
@@ -5,15 +5,17 @@
 
 #include <GL/gl3w.h>
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 #include <map>
 #include <string>
+#include <vector>
 
  // opengl functions
 
 class Cedai;
 
 namespace cd {
-	void createProgramGL(GLuint &program, std::string vertPath, std::string fragPath, bool defineBones);
+	void createProgramGL(GLuint &program, std::string vertPath, std::string fragPath);
 	void checkErrorsGL(std::string desc);
 	std::string readFile(const std::string& filename);
 }
@@ -22,17 +24,19 @@ class Interface {
 public:
 	void init(Cedai *application, int window_width, int window_height);
 
-	GLuint getTexHandle();
+	GLuint getTexHandle(uint32_t slot); // one output texture per frame in flight
 	GLenum getTexTarget();
 	GLFWwindow* getWindow();
 
-	void drawRun();
+	void drawRun(uint32_t slot);
 	void drawBarrier();
 
+	void readDrawTexture(std::vector<glm::u8vec4> &pixels, uint32_t slot);
+
 	void MinimizeCheck();
 	inline void PollEvents() { glfwPollEvents(); };
 	inline int WindowCloseCheck() { return glfwWindowShouldClose(window); };
-	void showFPS(int fps);
+	void showFPS(int fps, const std::string &stats = "");
 
 	unsigned int GetKeyInputs();
 	void GetMouseChange(double& mouseX, double& mouseY);
@@ -48,7 +52,7 @@ private:
 	int windowWidth = 0, windowHeight = 0;
 
 	struct drawPipeline {
-		GLuint texHandle = -1;
+		GLuint texHandles[FRAMES_IN_FLIGHT];
 		GLenum texTarget;
 		GLuint programHandle;
 	} drawPipeline;
@@ -61,6 +65,6 @@ private:
 
 	void mapKeys();
 
-	void createDrawTexture();
+	void createDrawTextures();
 	void setProgramIO();
 };
\ No newline at end of file
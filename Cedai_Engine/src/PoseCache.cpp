@@ -0,0 +1,76 @@
+#include "PoseCache.hpp"
+
+#include "tools/Log.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// PUBLIC FUNCTIONS
+
+void PoseCache::init(const cd::CompressedClip *clip, size_t poseBytes) {
+	this->clip = clip;
+	poseCount = (uint32_t)std::ceil(clip->duration * POSE_CACHE_RATE) + 1;
+	poseEntries.assign(poseCount, -1);
+
+	uint32_t entryCount = (uint32_t)std::min<size_t>(POSE_CACHE_BUDGET / poseBytes, poseCount);
+	entries.resize(entryCount);
+	CD_INFO("pose cache: {} of {} poses in {} bytes", entryCount, poseCount, entryCount * poseBytes);
+	if (entryCount == 0)
+		CD_WARN("POSE_CACHE_BUDGET holds no pose of {} bytes, skinning live", poseBytes);
+}
+
+uint32_t PoseCache::pose(double time) const {
+	return std::min((uint32_t)std::lround(std::max(time, 0.0) * POSE_CACHE_RATE), poseCount - 1);
+}
+
+bool PoseCache::find(uint32_t pose, uint32_t &entry, cl::Event &ready) {
+	int32_t e = poseEntries[pose];
+	if (e < 0) return false;
+
+	// a frame in flight may still be skinning the pose, older frames have finished
+	entries[e].lastUse = frame;
+	entry = (uint32_t)e;
+	ready = frame < entries[e].skinnedFrame + FRAMES_IN_FLIGHT ? entries[e].ready : cl::Event();
+	hits++;
+	return true;
+}
+
+bool PoseCache::insert(uint32_t pose, uint32_t &entry) {
+	if (entries.empty()) {
+		live++;
+		return false;
+	}
+
+	// least recently used, only entries no frame in flight reads
+	Entry *oldest = &*std::min_element(entries.begin(), entries.end(),
+		[](const Entry &a, const Entry &b) { return a.lastUse < b.lastUse; });
+	if (frame < oldest->lastUse + FRAMES_IN_FLIGHT) {
+		live++;
+		return false;
+	}
+
+	if (oldest->pose >= 0)
+		poseEntries[oldest->pose] = -1;
+	oldest->pose = pose;
+	oldest->lastUse = frame;
+	entry = (uint32_t)(oldest - entries.data());
+	poseEntries[pose] = (int32_t)entry;
+	misses++;
+	return true;
+}
+
+void PoseCache::skinned(uint32_t pose, const cl::Event &ready) {
+	Entry &entry = entries[poseEntries[pose]];
+	entry.ready = ready;
+	entry.skinnedFrame = frame;
+}
+
+void PoseCache::nextFrame() {
+	frame++;
+}
+
+void PoseCache::cleanUp() {
+	CD_INFO("pose cache: {} hits, {} poses skinned, {} skinned live", hits, misses, live);
+	entries.clear();
+	poseEntries.clear();
+}
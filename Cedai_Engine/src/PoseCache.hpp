@@ -0,0 +1,49 @@
+#pragma once
+
+#include "tools/Config.hpp"
+#include "model/CompressedClip.hpp"
+
+#include <CL/cl.hpp>
+
+#include <vector>
+#include <cstdint>
+
+/*
+Which poses of an animated model are skinned into the PrimitiveProcessor's cached meshes, at POSE_CACHE_RATE
+poses per second of its clip. A pose is skinned (and its bottom level bvh refit) the first time it is drawn and
+afterwards instances showing it read the cached mesh directly, so steady playback does no skinning at all. When
+the budget holds fewer poses than the clip the least recently used entry is reused, unless every entry may still
+be read by a frame in flight, in which case the caller skins live.
+*/
+class PoseCache {
+public:
+	void init(const cd::CompressedClip *clip, size_t poseBytes); // poseBytes = skinned vertices + bvh of one pose
+	inline uint32_t getEntryCount() const { return (uint32_t)entries.size(); }
+
+	uint32_t pose(double time) const; // nearest cached pose
+
+	// entry of a cached pose, ready is null once the skinning has certainly completed
+	bool find(uint32_t pose, uint32_t &entry, cl::Event &ready);
+	bool insert(uint32_t pose, uint32_t &entry); // entry to skin the pose into, false = skin live
+	void skinned(uint32_t pose, const cl::Event &ready); // event of the skinning into the inserted entry
+
+	void nextFrame();
+	void cleanUp();
+
+private:
+	struct Entry {
+		cl::Event ready;
+		int32_t pose = -1;
+		uint64_t lastUse = 0; // frame
+		uint64_t skinnedFrame = 0;
+	};
+
+	const cd::CompressedClip *clip = nullptr;
+	uint32_t poseCount = 0;
+
+	std::vector<Entry> entries;
+	std::vector<int32_t> poseEntries; // entry of each pose, -1 when not cached
+
+	uint64_t frame = FRAMES_IN_FLIGHT; // every entry starts out reusable
+	uint64_t hits = 0, misses = 0, live = 0;
+};
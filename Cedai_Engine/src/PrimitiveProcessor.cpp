@@ -1,145 +1,259 @@
 #include "PrimitiveProcessor.hpp"
-#include "Interface.hpp"
+#include "Renderer.hpp"
 #include "tools/Log.hpp"
+#include "tools/Trace.hpp"
 
-#define VERT_PATH "shaders/primitive.vert"
-#define FRAG_PATH "shaders/primitive.frag"
+#include <algorithm>
+#include <cmath>
+
+#define SKINNING_PATH "kernels/skinning.cl"
+#define SKINNING_ENTRY "skin"
+#define REFIT_ENTRY "refit"
+#define SKINNING_WG_SIZE 64
 
 // PUBLIC FUNCTIONS
 
-void PrimitiveProcessor::init(Interface *interface, std::vector<cd::Vertex> &vertices, std::array<glm::mat4, MAX_BONES> bones) {
+void PrimitiveProcessor::init(Renderer *renderer, const AnimatedModel &model) {
 	CD_INFO("Initialising primitive processing program...");
-	vertexCount = vertices.size();
+	vertexCount = model.vertices.size();
+	queue = renderer->getQueue();
+	context = renderer->getContext();
 
 	// create program
-	cd::createProgramGL(program, VERT_PATH, FRAG_PATH, true);
-	setProgramIO(vertices);
-
-	// make dummy render target
-	createRasteriseTarget();
+	renderer->createKernel(SKINNING_PATH, kernel, SKINNING_ENTRY);
+	renderer->createKernel(SKINNING_PATH, refitKernel, REFIT_ENTRY);
+	buildBvh(model);
+
+	// the model's vertices are already packed
+	cl_int result;
+	vertexBufferIn = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cd::PackedVertex) * vertexCount,
+		(void *)model.vertices.data(), &result);
+	if (result) {
+		CD_ERROR("skinning input buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
 
-	// init vertex buffer data
-	vertexProcess(bones);
-	vertexBarrier();
+	kernel.setArg(0, vertexBufferIn);
+	kernel.setArg(3, (cl_int)vertexCount);
+	kernel.setArg(5, (cl_int)MAX_BONES);
+	const cd::Aabb &bounds = model.vertexBounds;
+	glm::vec3 scale = (bounds.max - bounds.min) * (1.0f / 65535.0f);
+	kernel.setArg(7, cl_float4{ { bounds.min.x, bounds.min.y, bounds.min.z, 0 } });
+	kernel.setArg(8, cl_float4{ { scale.x, scale.y, scale.z, 0 } });
+
+	parentBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32_t) * bvhParents.size(), bvhParents.data(), &result);
+	if (result) {
+		CD_ERROR("bvh parent buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
+	leafBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int32_t) * bvhLeaves.size(), bvhLeaves.data(), &result);
+	if (result) {
+		CD_ERROR("bvh leaf buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
+	refitKernel.setArg(3, parentBuffer);
+	refitKernel.setArg(4, leafBuffer);
+	refitKernel.setArg(8, (cl_int)bvhLeaves.size());
+
+	// round up to whole work groups, the kernels ignore the extra work items
+	uint32_t groups = (vertexCount + SKINNING_WG_SIZE - 1) / SKINNING_WG_SIZE;
+	global_work = cl::NDRange(groups * SKINNING_WG_SIZE);
+	groups = ((uint32_t)bvhLeaves.size() + SKINNING_WG_SIZE - 1) / SKINNING_WG_SIZE;
+	refitWork = cl::NDRange(groups * SKINNING_WG_SIZE);
 }
 
-void PrimitiveProcessor::vertexProcess(std::array<glm::mat4, MAX_BONES> bones) {
+uint32_t PrimitiveProcessor::addStaticMesh(const StaticModel &model, uint32_t firstColor) {
+	staticMeshes.push_back({ (uint32_t)staticVertices.size(), (uint32_t)staticNodes.size() });
+	staticVertices.insert(staticVertices.end(), model.vertices.begin(), model.vertices.end());
 
-	// setup the program
+	// the leaves already index the triangles in order, their slots follow every triangle before them
+	int32_t slotBase = (int32_t)bvhTriangles.size();
+	for (cd::BvhNode node : model.bvh) {
+		node.first += node.count == 0 ? 0 : slotBase;
+		staticNodes.push_back(node);
+	}
+	for (uint32_t t = 0; t < model.indices.size(); t++)
+		bvhTriangles.push_back(glm::uvec4(model.indices[t], firstColor + t));
 
-	// TODO disable writes to color buffer
-	//glDrawBuffer(GL_NONE);
-	//glReadBuffer(GL_NONE);
+	CD_INFO("static mesh {}: {} vertices, {} triangles, {} nodes", staticMeshes.size() - 1, model.vertices.size(),
+		model.indices.size(), model.bvh.size());
+	return (uint32_t)staticMeshes.size() - 1;
+}
 
-	glUseProgram(program);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+void PrimitiveProcessor::createMeshes(uint32_t cachedMeshes) {
+	meshCount = cachedMesh(cachedMeshes);
+	cl_int result;
 
-	glBindVertexArray(vertexArray);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferIn);
-	setVertexAttributes();
+	triangleBuffer = cl::Buffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(glm::uvec4) * bvhTriangles.size(), bvhTriangles.data(), &result);
+	if (result) {
+		CD_ERROR("bvh triangle buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
 
-	updateUniforms(bones);
-	glFinish();
+	// the static vertices are written once after the skinned meshes
+	size_t skinnedVertices = (size_t)vertexCount * meshCount;
+	vertexBufferOut = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(glm::vec4) * (skinnedVertices + staticVertices.size()), NULL, &result);
+	if (result) {
+		CD_ERROR("skinned vertex buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
+	if (!staticVertices.empty())
+		queue.enqueueWriteBuffer(vertexBufferOut, CL_TRUE, sizeof(glm::vec4) * skinnedVertices, sizeof(glm::vec4) * staticVertices.size(),
+			staticVertices.data());
+
+	// every mesh starts as the bind pose topology, refits only rewrite the bounds. the static bvhs follow as they are
+	std::vector<cd::BvhNode> nodes;
+	nodes.reserve(bvhTemplate.size() * meshCount + staticNodes.size());
+	for (uint32_t m = 0; m < meshCount; m++)
+		nodes.insert(nodes.end(), bvhTemplate.begin(), bvhTemplate.end());
+	nodes.insert(nodes.end(), staticNodes.begin(), staticNodes.end());
+	nodeBuffer = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cd::BvhNode) * nodes.size(), nodes.data(), &result);
+	if (result) {
+		CD_ERROR("bvh node buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
 
-	// run
+	// refits leave their counters at 0 for the next
+	std::vector<cl_uint> counters(bvhTemplate.size() * meshCount, 0);
+	counterBuffer = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * counters.size(), counters.data(), &result);
+	if (result) {
+		CD_ERROR("bvh refit counter buffer create error: {}", result);
+		throw std::runtime_error("primitive processor init");
+	}
 
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, vertexCount);
-	cd::checkErrorsGL("GL process primitives");
+	kernel.setArg(2, vertexBufferOut);
+	refitKernel.setArg(0, vertexBufferOut);
+	refitKernel.setArg(1, triangleBuffer);
+	refitKernel.setArg(2, nodeBuffer);
+	refitKernel.setArg(5, counterBuffer);
+	CD_INFO("skinned meshes = {} ({} cached), bytes = {}", meshCount, cachedMeshes,
+		sizeof(cd::PackedVertex) * vertexCount + getMeshBytes() * meshCount);
+	CD_INFO("static meshes = {}, bytes = {}", staticMeshes.size(),
+		sizeof(glm::vec4) * staticVertices.size() + sizeof(cd::BvhNode) * staticNodes.size());
+
+	// the host copies are no longer needed
+	staticVertices = std::vector<glm::vec4>();
+	staticNodes = std::vector<cd::BvhNode>();
 }
 
-void PrimitiveProcessor::vertexBarrier() {
-	glFinish();
+void PrimitiveProcessor::vertexProcess(const cl::Buffer &bones, uint32_t boneOffset, const cl::Event &bonesReady, uint32_t mesh,
+		std::vector<cl::Event> &events) {
+	CD_ZONE("PrimitiveProcessor::vertexProcess");
+
+	kernel.setArg(1, bones);
+	kernel.setArg(4, (cl_int)boneOffset);
+	kernel.setArg(6, (cl_int)vertexOffset(mesh));
+	std::vector<cl::Event> waitBones = { bonesReady };
+	cl::Event skinned;
+	queue.enqueueNDRangeKernel(kernel, 0, global_work, cl::NDRange(SKINNING_WG_SIZE), &waitBones, &skinned);
+
+	refitKernel.setArg(6, (cl_int)vertexOffset(mesh));
+	refitKernel.setArg(7, (cl_int)nodeOffset(mesh));
+	std::vector<cl::Event> waitSkin = { skinned };
+	cl::Event refit;
+	queue.enqueueNDRangeKernel(refitKernel, 0, refitWork, cl::NDRange(SKINNING_WG_SIZE), &waitSkin, &refit);
+	events.push_back(skinned);
+	events.push_back(refit);
 }
 
-void PrimitiveProcessor::cleanUp() {
-	glDeleteRenderbuffers(1, &renderbuffer);
-	glDeleteFramebuffers(1, &framebuffer);
-	glDeleteBuffers(1, &vertexBufferOut);
+void PrimitiveProcessor::readVertices(std::vector<glm::vec4> &vertices, uint32_t mesh) {
+	vertices.resize(vertexCount);
+	queue.enqueueReadBuffer(vertexBufferOut, CL_TRUE, sizeof(glm::vec4) * vertexOffset(mesh), sizeof(glm::vec4) * vertexCount, vertices.data());
 }
 
-// PRIVATE FUNCTIONS
-
-void PrimitiveProcessor::createRasteriseTarget() {
-	glGenFramebuffers(1, &framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-	glGenRenderbuffers(1, &renderbuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
-
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGB, 1, 1);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
-
-	GLenum drawBuffers[] = { GL_NONE };
-	glDrawBuffers(1, drawBuffers);
-
-	GLenum result = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-	if (result != GL_FRAMEBUFFER_COMPLETE) {
-		CD_ERROR("primitive pipeline framebuffer create error: {}", result);
-		throw std::runtime_error("pimitive pipeline init");
-	}
-	cd::checkErrorsGL("rasterize target create");
-
-	// switch back to window frambuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+uint32_t PrimitiveProcessor::selectLod(float pixelsPerUnit) const {
+	uint32_t lod = 0;
+	while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+		lod++;
+	return lod;
 }
 
-void PrimitiveProcessor::setProgramIO(std::vector<cd::Vertex> &vertices) {
-
-	// vertex input
-
-	glGenVertexArrays(1, &vertexArray);
-	glBindVertexArray(vertexArray);
-
-	glGenBuffers(1, &vertexBufferIn);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBufferIn);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cd::Vertex) * vertexCount, vertices.data(), GL_STATIC_DRAW);
-
-	setVertexAttributes();
-
-	// vertex output TODO use transform feedback
-
-	glGenBuffers(1, &vertexBufferOut);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, vertexBufferOut);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(glm::vec4) * vertexCount, NULL, GL_DYNAMIC_COPY);
-
-	GLuint vertexOutIndex = 0;
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, vertexOutIndex, vertexBufferOut);
-
-	cd::checkErrorsGL("primitive pipeline set io");
+void PrimitiveProcessor::cleanUp() {
+	queue.finish();
 }
 
-void PrimitiveProcessor::setVertexAttributes() {
-	std::array<size_t, 3> offsets = cd::Vertex::getOffsets();
-	size_t stride = sizeof(glm::vec4) + sizeof(glm::ivec4) + sizeof(glm::vec4);
-
-	// position
-	const GLuint positionLocation = 0;
-	glVertexAttribPointer(positionLocation, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsets[0]);
-	glEnableVertexAttribArray(positionLocation);
-
-	// bone indices
-	const GLuint indicesLocation = 1;
-	glVertexAttribIPointer(indicesLocation, 4, GL_INT, stride, (void*)offsets[1]);
-	glEnableVertexAttribArray(indicesLocation);
-
-	// bone weights
-	const GLuint weightsLocation = 2;
-	glVertexAttribPointer(weightsLocation, 4, GL_FLOAT, GL_FALSE, stride, (void*)offsets[2]); // TODO normalize
-	glEnableVertexAttribArray(weightsLocation);
-}
+// PRIVATE FUNCTIONS
 
-void PrimitiveProcessor::updateUniforms(std::array<glm::mat4, MAX_BONES> bones) {
-	GLint location = glGetUniformLocation(program, "bones");
-	if (location != -1)
-		glUniformMatrix4fv(location, BONES_GL, GL_FALSE, (const GLfloat*)bones.data()); // TODO use uniform buffer object (50 * vec4...) large number of uniforms changing in bulk
-	else
-		CD_WARN("PrimitiveProcessor::updateUniforms invalid bone transform write");
+void PrimitiveProcessor::buildBvh(const AnimatedModel &model) {
+	bvhTemplate.clear();
+	bvhTriangles.clear();
+	bvhParents.clear();
+	bvhLeaves.clear();
+	lods.clear();
+	std::vector<cd::BvhNode> nodes;
+	std::vector<uint32_t> order;
+
+	for (uint32_t level = 0; level <= model.lods.size(); level++) {
+		cd::Span<glm::uvec3> indices = level == 0 ? model.indices : model.lods[level - 1].indices;
+		const char *source = level == 0 ? buildLevel(model, indices, model.bvh, model.clusters, nodes, order)
+			: buildLevel(model, indices, model.lods[level - 1].bvh, cd::Span<cd::TriangleCluster>(), nodes, order);
+
+		// after the finer levels: child indices move by the nodes and leaf slots by the triangles before it
+		int32_t nodeBase = (int32_t)bvhTemplate.size(), slotBase = (int32_t)bvhTriangles.size();
+		for (cd::BvhNode &node : nodes) {
+			node.first += node.count == 0 ? nodeBase : slotBase;
+			bvhTemplate.push_back(node);
+		}
+		// leaves read their triangles' indices directly, w keeps the full mesh triangle it comes from for its color
+		for (uint32_t t : order)
+			bvhTriangles.push_back(glm::uvec4(indices[t], level == 0 ? t : model.lods[level - 1].sources[t]));
+		lods.push_back({ (uint32_t)nodeBase, level == 0 ? 0.0f : model.lods[level - 1].error });
+		bvhParents.push_back(-1);
+		bvhParents.resize(bvhTemplate.size());
+		for (int32_t n = nodeBase; n < (int32_t)bvhTemplate.size(); n++) {
+			if (bvhTemplate[n].count != 0)
+				bvhLeaves.push_back(n);
+			else if (n < bvhTemplate[n].first) // not the root of an empty bvh
+				bvhParents[bvhTemplate[n].first] = bvhParents[bvhTemplate[n].first + 1] = n;
+		}
+
+		CD_INFO("bottom level bvh lod {}: {} triangles, {} nodes, error {:.3f}{}", level, order.size(), nodes.size(),
+			lods.back().error, source);
+	}
+	CD_INFO("bottom level bvh: {} levels, {} unique vertices, {} nodes", lods.size(), vertexCount, bvhTemplate.size());
 }
 
-/*
-render texture target: https://www.opengl-tutorial.org/intermediate-tutorials/tutorial-14-render-to-texture/  https://github.com/opengl-tutorials/ogl/blob/master/tutorial14_render_to_texture/tutorial14.cpp
-opengl context: https://www.khronos.org/opengl/wiki/Creating_an_OpenGL_Context_(WGL)
-wgl context: https://docs.microsoft.com/en-us/windows/win32/api/wingdi/nf-wingdi-wglcreatecontext
-
-integer artribute: https://stackoverflow.com/questions/15844939/sending-array-to-shader-with-gluniformmatrix
-*/
+const char *PrimitiveProcessor::buildLevel(const AnimatedModel &model, cd::Span<glm::uvec3> indices, cd::Span<cd::BvhNode> bvh,
+		cd::Span<cd::TriangleCluster> clusters, std::vector<cd::BvhNode> &nodes, std::vector<uint32_t> &order) {
+	bool clusterLeaves = bvh.empty() && !clusters.empty() && std::all_of(clusters.begin(), clusters.end(),
+		[](const cd::TriangleCluster &cluster) { return cluster.count <= BVH_LEAF_SIZE; });
+	nodes.clear();
+	order.clear();
+
+	if (!bvh.empty()) {
+		// the loader checked the leaves cover every triangle in the file's order
+		nodes.assign(bvh.begin(), bvh.end());
+		order.resize(indices.size());
+		for (uint32_t t = 0; t < order.size(); t++)
+			order[t] = t;
+		return ", prebaked";
+	} else if (clusterLeaves) {
+		// the converter's clusters are the leaves, only the tree above them is built
+		std::vector<cd::Aabb> boxes(clusters.size());
+		for (uint32_t c = 0; c < boxes.size(); c++)
+			boxes[c] = { clusters[c].min, clusters[c].max };
+		std::vector<uint32_t> clusterOrder, firstSlot;
+		cd::BuildBvh(boxes, nodes, clusterOrder, 1);
+
+		// leaf slots become the clusters' triangles in leaf order
+		for (uint32_t c : clusterOrder) {
+			firstSlot.push_back((uint32_t)order.size());
+			for (uint32_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; t++)
+				order.push_back(t);
+		}
+		for (cd::BvhNode &node : nodes) {
+			if (node.count == 0) continue;
+			node.count = (int32_t)clusters[clusterOrder[node.first]].count;
+			node.first = (int32_t)firstSlot[node.first];
+		}
+		return ", leaves from the model's clusters";
+	} else {
+		std::vector<cd::Aabb> triangles(indices.size());
+		for (uint32_t t = 0; t < triangles.size(); t++) {
+			for (int corner = 0; corner < 3; corner++)
+				triangles[t].grow(glm::vec3(cd::UnpackVertex(model.vertices[indices[t][corner]], model.vertexBounds).position));
+		}
+		cd::BuildBvh(triangles, nodes, order);
+		return "";
+	}
+}
\ No newline at end of file
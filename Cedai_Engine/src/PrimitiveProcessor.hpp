@@ -1,39 +1,111 @@
 #pragma once
 
 #include "tools/Config.hpp"
+#include "tools/Span.hpp"
 #include "model/Vertex.hpp"
+#include "model/Bvh.hpp"
+#include "model/AnimatedModel.hpp"
+#include "model/StaticModel.hpp"
 
-#include <GL/gl3w.h>
+#include <CL/cl.hpp>
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <array>
 
-class Interface;
+class Renderer;
 
+/*
+Skins the model into meshes with an opencl kernel on the renderer's queue and refits each mesh's bottom level bvh.
+All meshes live in one vertex buffer and one node buffer that the render kernel reads through per instance offsets:
+MAX_ANIMATED_MODELS live meshes per frame slot (one per pose, so a frame can be skinned while the previous one is
+still being rendered) followed by the meshes kept by the PoseCache. The bvh topology is built once from the bind
+pose and shared by every mesh, only the node bounds are refit (in parallel from the leaves up). Meshes are indexed: only the unique vertices are
+skinned and the triangle buffer holds each bvh leaf slot's vertex indices. The skinning input is the model's packed
+vertices, uploaded as they are (16 bytes each: positions quantized against the bind pose bounds, 8 bit bone indices
+and weights normalized to 1).
+A bvh prebaked by the converter (sah, too slow to build here) is only refit. Otherwise, when the model stores triangle
+clusters (spatially sorted runs of at most BVH_LEAF_SIZE triangles) they become the bvh leaves as they are, so leaf
+slots, like the vertices, follow the model's memory order. The model's coarser levels of detail share its vertices, so
+each mesh holds one bvh per level one after another, all refit together, and instances trace the level they select.
+Static meshes follow the skinned meshes in the same buffers: uploaded once with their bvh, never skinned or refit.
+*/
 class PrimitiveProcessor {
 public:
-	void init(Interface *interface, std::vector<cd::Vertex> &vertices, std::array<glm::mat4, MAX_BONES> bones);
+	// copied to the device, need not outlive init. a prebaked bvh (may be empty) is used as it is, otherwise clusters (may be
+	// empty) become the bvh leaves when small enough
+	void init(Renderer *renderer, const AnimatedModel &model);
+	// after init and before createMeshes, returns the static mesh. its triangle t is drawn in polygon color firstColor + t
+	uint32_t addStaticMesh(const StaticModel &model, uint32_t firstColor);
+	void createMeshes(uint32_t cachedMeshes); // after init, allocates the live and cached meshes and uploads the static ones
 
-	inline GLuint getVertexBuffer() { return vertexBufferOut; }
+	inline size_t getMeshBytes() const { return sizeof(glm::vec4) * vertexCount + sizeof(cd::BvhNode) * bvhTemplate.size(); }
+	inline uint32_t liveMesh(uint32_t slot, uint32_t pose) const { return slot * MAX_ANIMATED_MODELS + pose; }
+	inline uint32_t cachedMesh(uint32_t entry) const { return FRAMES_IN_FLIGHT * MAX_ANIMATED_MODELS + entry; }
+	inline int32_t vertexOffset(uint32_t mesh) const { return (int32_t)(mesh * vertexCount); }
+	inline int32_t nodeOffset(uint32_t mesh) const { return (int32_t)(mesh * bvhTemplate.size()); }
 
-	void vertexProcess(std::array<glm::mat4, MAX_BONES> bones);
-	void vertexBarrier();
+	// after createMeshes
+	inline int32_t staticVertexOffset(uint32_t mesh) const { return (int32_t)(meshCount * vertexCount + staticMeshes[mesh].firstVertex); }
+	inline int32_t staticNodeOffset(uint32_t mesh) const { return (int32_t)(meshCount * bvhTemplate.size() + staticMeshes[mesh].firstNode); }
+
+	// levels of detail, 0 = the full mesh. the root is relative to the mesh's nodes
+	inline uint32_t lodCount() const { return (uint32_t)lods.size(); }
+	inline int32_t lodRoot(uint32_t lod) const { return (int32_t)lods[lod].root; }
+	uint32_t selectLod(float pixelsPerUnit) const; // coarsest level within LOD_PIXEL_ERROR at this projected scale
+
+	inline const cl::Buffer &getVertexBuffer() { return vertexBufferOut; }
+	inline const cl::Buffer &getNodeBuffer() { return nodeBuffer; }
+	inline const cl::Buffer &getTriangleBuffer() { return triangleBuffer; }
+
+	// bones = BonePalette buffer of this frame, boneOffset = the pose's first matrix in it.
+	// appends the skinning and refit events to events, the mesh is ready once the last completes
+	void vertexProcess(const cl::Buffer &bones, uint32_t boneOffset, const cl::Event &bonesReady, uint32_t mesh,
+		std::vector<cl::Event> &events);
+
+	void readVertices(std::vector<glm::vec4> &vertices, uint32_t mesh); // blocking, call once the queue is finished
 
 	void cleanUp();
 
 private:
 
-	GLuint program;
-	GLuint framebuffer, renderbuffer;
+	cl::CommandQueue queue;
+	cl::Kernel kernel;
+	cl::Kernel refitKernel;
+	cl::NDRange global_work;
+
+	cl::Context context;
+	cl::Buffer vertexBufferIn; // packed
+	cl::Buffer vertexBufferOut; // every mesh
+	cl::Buffer nodeBuffer; // every mesh's bvh
+	cl::Buffer triangleBuffer; // vertex indices (xyz) and triangle (w) of each bvh leaf slot
+	cl::Buffer parentBuffer; // of each template node, -1 for each level's root
+	cl::Buffer leafBuffer; // template nodes that are leaves, a refit work item each
+	cl::Buffer counterBuffer; // refit children fitted per node of every skinned mesh
+	uint32_t vertexCount = 0; // per skinned mesh
+	uint32_t meshCount = 0; // skinned, live and cached
+
+	struct Lod {
+		uint32_t root; // first node of the level's bvh
+		float error; // model units
+	};
 
-	GLuint vertexBufferIn, vertexBufferOut;
-	GLuint vertexArray;
-	uint32_t vertexCount = 0;
+	std::vector<cd::BvhNode> bvhTemplate; // bind pose, every level in turn
+	std::vector<glm::uvec4> bvhTriangles;
+	std::vector<int32_t> bvhParents; // of bvhTemplate
+	std::vector<int32_t> bvhLeaves;
+	cl::NDRange refitWork;
+	std::vector<Lod> lods;
 
-	void createRasteriseTarget();
-	void setProgramIO(std::vector<cd::Vertex> &vertices);
+	struct StaticMesh {
+		uint32_t firstVertex; // after the skinned meshes
+		uint32_t firstNode;
+	};
+	std::vector<StaticMesh> staticMeshes;
+	std::vector<glm::vec4> staticVertices; // every static mesh, kept until createMeshes uploads them
+	std::vector<cd::BvhNode> staticNodes;
 
-	void setVertexAttributes();
-	void updateUniforms(std::array<glm::mat4, MAX_BONES> bones);
+	void buildBvh(const AnimatedModel &model);
+	const char *buildLevel(const AnimatedModel &model, cd::Span<glm::uvec3> indices, cd::Span<cd::BvhNode> bvh,
+		cd::Span<cd::TriangleCluster> clusters, std::vector<cd::BvhNode> &nodes, std::vector<uint32_t> &order);
 };
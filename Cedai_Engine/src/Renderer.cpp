@@ -2,8 +2,10 @@
 #include "tools/Config.hpp"
 
 #include "Interface.hpp"
-#include "PrimitiveProcessor.hpp"
 #include "tools/Log.hpp"
+#include "tools/Profiler.hpp"
+#include "tools/Trace.hpp"
+#include "render_math.h"
 
 #ifdef CD_PLATFORM_WINDOWS
 #	define GLFW_EXPOSE_NATIVE_WGL
@@ -20,20 +22,26 @@
 #include <cmath>
 
 #define KERNEL_PATH "kernels/kernel.cl"
+#define KERNEL_INCLUDE_DIR "kernels" /* location of render_math.h */
 #define KERNEL_ENTRY "render"
 
+#define GL_SYNC_TIMEOUT 1000000000 /* ns, only used without cl_khr_gl_event */
+
 // using a macro so that CD_ERROR prints the appropriate line number
 #define checkCLError(err, message) if (err) { \
 	CD_ERROR("{}. error code = ({})", message, err); \
 	throw std::runtime_error("renderer error"); }
 
+static_assert(FRAMES_IN_FLIGHT <= PROFILE_EVENT_RING, "frame events are needed until the frame is presented");
+
 // PUBLIC FUNCTIONS
 
 Renderer::Renderer() {
-	gl_objects.resize(gl_object_indices::count);
+	for (std::vector<cl::Memory> &objects : gl_objects)
+		objects.resize(gl_object_indices::count);
 }
 
-void Renderer::init(int image_width, int image_height, Interface* interface, PrimitiveProcessor* vertexProcessor,
+void Renderer::init(int image_width, int image_height, Interface* interface,
 		std::vector<cd::Sphere>& spheres, std::vector<cd::Sphere>& lights, std::vector<cl_uchar4>& polygon_colors) {
 	CD_INFO("Initialising renderer...");
 
@@ -44,16 +52,49 @@ void Renderer::init(int image_width, int image_height, Interface* interface, Pri
 
 	createContext(interface);
 	createQueue();
+	setGlobalWork();
 
-	createBuffers(interface->getTexTarget(), interface->getTexHandle(), vertexProcessor->getVertexBuffer(),
-		spheres, lights, polygon_colors);
+	createBuffers(interface, spheres, lights, polygon_colors);
 	createKernels();
-	setGlobalWork();
 
 	queue.finish();
 }
 
-void Renderer::renderQueue(const float view[4][4], float seconds) {
+void Renderer::setMeshes(const cl::Buffer &vertices, const cl::Buffer &triangles, const cl::Buffer &nodes) {
+	kernel.setArg(7, vertices);
+	kernel.setArg(10, triangles);
+	kernel.setArg(11, nodes);
+}
+
+void Renderer::setInstances(uint32_t slot, const std::vector<cd::GpuInstance> &instances, const std::vector<cd::Aabb> &bounds) {
+	CD_ZONE("Renderer::setInstances");
+	if (MAX_INSTANCES < instances.size()) {
+		CD_ERROR("{} instances, MAX_INSTANCES = {}", instances.size(), MAX_INSTANCES);
+		throw std::runtime_error("renderer set instances");
+	}
+
+	// a few instances, rebuilt every frame as they move and animate
+	SlotInstances &frame = slotInstances[slot];
+	std::vector<uint32_t> order;
+	cd::BuildBvh(bounds, frame.nodes, order);
+	frame.instances.clear();
+	for (uint32_t i : order)
+		frame.instances.push_back(instances[i]);
+
+	// the previous upload from these host vectors completed before the frame in this slot was presented
+	std::vector<cl::Event> uploads(2);
+	if (!frame.instances.empty())
+		queue.enqueueWriteBuffer(frame.cl_instances, CL_FALSE, 0, sizeof(cd::GpuInstance) * frame.instances.size(),
+			frame.instances.data(), NULL, &uploads[0]);
+	queue.enqueueWriteBuffer(frame.cl_nodes, CL_FALSE, 0, sizeof(cd::BvhNode) * frame.nodes.size(),
+		frame.nodes.data(), NULL, &uploads[1]);
+	if (!uploads[0]()) uploads.erase(uploads.begin());
+	queue.enqueueMarkerWithWaitList(&uploads, &frame.uploaded);
+}
+
+void Renderer::renderQueue(const float view[4][4], float seconds, uint32_t slot, const std::vector<cl::Event> &verticesReady) {
+	CD_ZONE("Renderer::renderQueue");
+
 	static cl_float16 cl_view;
 	static cl_float3 cl_pos;
 	static cl_float cl_time;
@@ -68,14 +109,92 @@ void Renderer::renderQueue(const float view[4][4], float seconds) {
 	kernel.setArg(0, cl_view);
 	kernel.setArg(1, cl_pos);
 	kernel.setArg(2, cl_time);
+	kernel.setArg(5, (cl_int)slotInstances[slot].instances.size());
+	kernel.setArg(9, gl_objects[slot][gl_object_indices::output_image]);
+	kernel.setArg(12, slotInstances[slot].cl_instances);
+	kernel.setArg(13, slotInstances[slot].cl_nodes);
+#	ifdef KERNEL_COUNTERS
+	kernel.setArg(14, cl_counters[slot]);
+	kernel.setArg(15, cl_pixel_cost[slot]);
+	kernel.setArg(16, heatmapMaxCost);
+#	endif
+
+	FrameEvents &events = frameEvents[frameIndex % PROFILE_EVENT_RING];
+#	ifdef PROFILE_GPU
+	// this slot was last used PROFILE_EVENT_RING frames ago
+	if (events.pending)
+		resolveEvents(events);
+#	endif
+	if (events.glReady)
+		glDeleteSync(events.glReady);
+
+	// the output texture was last drawn FRAMES_IN_FLIGHT - 1 frames ago, fence every gl command so far
+	GLsync glReady = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	events.frame = Profiler::Frame();
+	events.slot = slot;
+	events.glReady = glReady;
+	events.skin = verticesReady;
+	events.hostQueued = Profiler::HostTime();
+
+	// opencl may only use the gl objects once the gl commands using them are complete
+	std::vector<cl::Event> waitGL;
+	if (createEventFromGLsync) {
+		cl_int result;
+		cl_event glEvent = createEventFromGLsync(context(), glReady, &result);
+		checkCLError(result, "cl event from gl sync");
+		waitGL.push_back(cl::Event(glEvent));
+	} else {
+		while (glClientWaitSync(glReady, GL_SYNC_FLUSH_COMMANDS_BIT, GL_SYNC_TIMEOUT) == GL_TIMEOUT_EXPIRED)
+			CD_WARN("Renderer::renderQueue still waiting for opengl");
+	}
+
+	// the queue is out of order so each command waits on the previous one
+	queue.enqueueAcquireGLObjects(&gl_objects[slot], &waitGL, &events.acquire);
+	std::vector<cl::Event> acquired = { events.acquire, slotInstances[slot].uploaded };
+	acquired.insert(acquired.end(), verticesReady.begin(), verticesReady.end());
+	queue.enqueueNDRangeKernel(kernel, 0, global_work, local_work, &acquired, &events.render);
+	std::vector<cl::Event> rendered = { events.render };
+	queue.enqueueReleaseGLObjects(&gl_objects[slot], &rendered, &events.release);
+
+	// start the device without waiting for it
+	queue.flush();
+	events.pending = true;
+	frameIndex++;
+}
+
+int Renderer::renderBarrier() {
+	CD_ZONE("Renderer::renderBarrier");
+
+	// present once FRAMES_IN_FLIGHT frames are queued, the newest frames keep the device busy meanwhile
+	if (frameIndex - presentIndex < FRAMES_IN_FLIGHT)
+		return -1;
+
+	FrameEvents &events = frameEvents[presentIndex % PROFILE_EVENT_RING];
+	events.release.wait();
+	presentIndex++;
+#	ifdef KERNEL_COUNTERS
+	readCounters(events.slot);
+#	endif
 
-	queue.enqueueAcquireGLObjects(&gl_objects);
-	queue.enqueueNDRangeKernel(kernel, 0, global_work, local_work);
+#	ifdef PROFILE_GPU
+	// collect the timings of every frame that has finished
+	for (FrameEvents &frame : frameEvents) {
+		if (frame.pending && frame.release.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE)
+			resolveEvents(frame);
+	}
+#	endif
+	return events.slot;
 }
 
-void Renderer::renderBarrier() {
-	queue.enqueueReleaseGLObjects(&gl_objects);
+void Renderer::renderFinish() {
 	queue.finish();
+#	ifdef KERNEL_COUNTERS
+	for (; presentIndex < frameIndex; presentIndex++)
+		readCounters(frameEvents[presentIndex % PROFILE_EVENT_RING].slot);
+#	endif
+	presentIndex = frameIndex;
 }
 
 void Renderer::resize(int image_width, int image_height, Interface *interface) {
@@ -83,14 +202,33 @@ void Renderer::resize(int image_width, int image_height, Interface *interface) {
 	this->image_height = image_height;
 	setGlobalWork();
 
-	// trust that OpenCL handles buffer release TODO: garbage collection or what?
-	gl_objects[gl_object_indices::output_image] = nullptr;
-	createOutputImage(interface->getTexTarget(), interface->getTexHandle());
-	setOutArg();
+	// the caller finishes the frames in flight first (renderFinish)
+	for (std::vector<cl::Memory> &objects : gl_objects)
+		objects[gl_object_indices::output_image] = nullptr;
+	createOutputImages(interface);
+
+#	ifdef KERNEL_COUNTERS
+	createCounterBuffers();
+#	endif
+}
+
+void Renderer::setHeatmap(bool enabled) {
+	heatmapMaxCost = enabled ? HEATMAP_MAX_COST : 0;
+}
+
+void Renderer::logCounters() {
+#	ifdef KERNEL_COUNTERS
+	logRequested = true;
+#	endif
 }
 
 void Renderer::cleanUp() {
-	
+	renderFinish();
+	for (FrameEvents &events : frameEvents) {
+		if (events.glReady)
+			glDeleteSync(events.glReady);
+		events.glReady = nullptr;
+	}
 }
 
 // INIT FUNCTIONS
@@ -138,6 +276,12 @@ void Renderer::createDevice() {
 
 	// set ND range to equal CL_DEVICE_MAX_WORK_GROUP_SIZE
 	setLocalWork(device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>());
+
+	// lets opencl wait on gl fences on the device instead of the host waiting for them
+	if (device.getInfo<CL_DEVICE_EXTENSIONS>().find("cl_khr_gl_event") != std::string::npos)
+		createEventFromGLsync = (CreateEventFromGLsync)clGetExtensionFunctionAddressForPlatform(platform(), "clCreateEventFromGLsyncKHR");
+	if (!createEventFromGLsync)
+		CD_WARN("cl_khr_gl_event not supported: the host will wait for opengl before each frame");
 }
 
 bool Renderer::checkDevice(DeviceDetails &deviceDetails) {
@@ -191,12 +335,17 @@ void Renderer::createContext(Interface* interface) {
 }
 
 void Renderer::createQueue() {
+	cl_command_queue_properties properties = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+#	ifdef PROFILE_GPU
+	properties |= CL_QUEUE_PROFILING_ENABLE;
+#	endif
+
 	cl_int res;
-	queue = cl::CommandQueue(context, device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &res);
+	queue = cl::CommandQueue(context, device, properties, &res);
 	checkCLError(res, "Failed openCL queue creation");
 }
 
-void Renderer::createBuffers(cl_GLenum gl_texture_target, cl_GLuint gl_texture, cl_GLuint gl_vert_buffer,
+void Renderer::createBuffers(Interface *interface,
 		std::vector<cd::Sphere>& spheres, std::vector<cd::Sphere>& lights, std::vector<cl_uchar4>&polygon_colors) {
 	sphere_count = spheres.size();
 	light_count = lights.size();
@@ -210,27 +359,94 @@ void Renderer::createBuffers(cl_GLenum gl_texture_target, cl_GLuint gl_texture,
 	queue.enqueueWriteBuffer(cl_spheres, CL_TRUE, 0, sphere_count * sizeof(cd::Sphere), spheres.data());
 	queue.enqueueWriteBuffer(cl_spheres, CL_TRUE, sphere_count * sizeof(cd::Sphere), light_count * sizeof(cd::Sphere), lights.data());
 
-	// gl vertices
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, gl_vert_buffer);
-	gl_objects[gl_object_indices::vertices] = cl::BufferGL(context, CL_MEM_READ_WRITE, gl_vert_buffer, &result);
-	checkCLError(result, "gl vertex buffer create");
-
 	// polygons
 	cl_polygons = cl::Buffer(context, CL_MEM_READ_ONLY, polygon_count * sizeof(cl_uchar4), NULL, &result);
 	CD_INFO("polygon bytes = {}", polygon_count * sizeof(cl_uchar4));
 	checkCLError(result, "polygon buffer create");
 	queue.enqueueWriteBuffer(cl_polygons, CL_TRUE, 0, polygon_count * sizeof(cl_uchar4), polygon_colors.data());
 
-	// output image
-	createOutputImage(gl_texture_target, gl_texture);
+	// instances
+	createInstanceBuffers();
+
+	// output images
+	createOutputImages(interface);
+
+#	ifdef KERNEL_COUNTERS
+	createCounterBuffers();
+#	endif
+}
+
+void Renderer::createOutputImages(Interface *interface) {
+	cl_int result;
+	cl_GLenum gl_texture_target = interface->getTexTarget();
+	for (uint32_t slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+		cl_GLuint gl_texture = interface->getTexHandle(slot);
+		glBindTexture(gl_texture_target, gl_texture);
+		cd::checkErrorsGL("cl bind texture target");
+		gl_objects[slot][gl_object_indices::output_image] = cl::ImageGL(context, CL_MEM_WRITE_ONLY, gl_texture_target, 0, gl_texture, &result);
+		checkCLError(result, "Error during cl_output creation");
+	}
 }
 
-void Renderer::createOutputImage(cl_GLenum gl_texture_target, cl_GLuint gl_texture) {
+void Renderer::createInstanceBuffers() {
 	cl_int result;
-	glBindTexture(gl_texture_target, gl_texture);
-	cd::checkErrorsGL("cl bind texture target");
-	gl_objects[gl_object_indices::output_image] = cl::ImageGL(context, CL_MEM_WRITE_ONLY, gl_texture_target, 0, gl_texture, &result);
-	checkCLError(result, "Error during cl_output creation");
+	for (SlotInstances &frame : slotInstances) {
+		frame.cl_instances = cl::Buffer(context, CL_MEM_READ_ONLY, MAX_INSTANCES * sizeof(cd::GpuInstance), NULL, &result);
+		checkCLError(result, "instance buffer create");
+		frame.cl_nodes = cl::Buffer(context, CL_MEM_READ_ONLY, 2 * MAX_INSTANCES * sizeof(cd::BvhNode), NULL, &result);
+		checkCLError(result, "top level bvh buffer create");
+	}
+	CD_INFO("instance bytes = {}", FRAMES_IN_FLIGHT * MAX_INSTANCES * (sizeof(cd::GpuInstance) + 2 * sizeof(cd::BvhNode)));
+}
+
+void Renderer::createCounterBuffers() {
+	cl_int result;
+	std::vector<cl_uint> zeros(cd::rm::COUNTER_COUNT * 2, 0);
+	for (uint32_t slot = 0; slot < FRAMES_IN_FLIGHT; slot++) {
+		cl_counters[slot] = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, zeros.size() * sizeof(cl_uint), zeros.data(), &result);
+		checkCLError(result, "counter buffer create");
+
+		cl_pixel_cost[slot] = cl::Buffer(context, CL_MEM_WRITE_ONLY, global_work[0] * global_work[1] * sizeof(cl_uint), NULL, &result);
+		checkCLError(result, "pixel cost buffer create");
+	}
+	counterTotals.assign(cd::rm::COUNTER_COUNT, 0);
+	countedFrames = 0;
+}
+
+void Renderer::readCounters(uint32_t slot) {
+	// the slot's frame is complete: its counts join the totals and its counters are cleared for the slot's next frame
+	std::vector<cl_uint> counters(cd::rm::COUNTER_COUNT * 2);
+	queue.enqueueReadBuffer(cl_counters[slot], CL_TRUE, 0, counters.size() * sizeof(cl_uint), counters.data());
+	for (int c = 0; c < cd::rm::COUNTER_COUNT; c++)
+		counterTotals[c] += (uint64_t)counters[c * 2 + 1] << 32 | counters[c * 2];
+	std::fill(counters.begin(), counters.end(), 0);
+	queue.enqueueWriteBuffer(cl_counters[slot], CL_TRUE, 0, counters.size() * sizeof(cl_uint), counters.data());
+	countedFrames++;
+	if (!logRequested) return;
+
+	// per pixel cost of this frame
+	std::vector<cl_uint> cost(global_work[0] * global_work[1]);
+	queue.enqueueReadBuffer(cl_pixel_cost[slot], CL_TRUE, 0, cost.size() * sizeof(cl_uint), cost.data());
+	uint64_t costSum = 0;
+	cl_uint costMax = 0;
+	for (cl_uint c : cost) {
+		costSum += c;
+		costMax = std::max(costMax, c);
+	}
+
+	const std::vector<uint64_t> &totals = counterTotals;
+	uint64_t rays = totals[cd::rm::COUNTER_RAYS] + totals[cd::rm::COUNTER_SHADOW_RAYS];
+	uint64_t tests = totals[cd::rm::COUNTER_SPHERE_TESTS] + totals[cd::rm::COUNTER_TRIANGLE_TESTS];
+	CD_TRACE("kernel counters over {} frames (per frame):", countedFrames);
+	CD_TRACE("  rays {} + shadow rays {}", totals[cd::rm::COUNTER_RAYS] / countedFrames, totals[cd::rm::COUNTER_SHADOW_RAYS] / countedFrames);
+	CD_TRACE("  sphere tests {}, triangle tests {}, bvh nodes {}", totals[cd::rm::COUNTER_SPHERE_TESTS] / countedFrames,
+		totals[cd::rm::COUNTER_TRIANGLE_TESTS] / countedFrames, totals[cd::rm::COUNTER_BVH_NODES] / countedFrames);
+	CD_TRACE("  per ray: {:.1f} tests, {:.1f} bvh nodes", (double)tests / rays, (double)totals[cd::rm::COUNTER_BVH_NODES] / rays);
+	CD_TRACE("  pixel cost: mean {:.1f} max {} (heatmap max {})", (double)costSum / cost.size(), costMax, HEATMAP_MAX_COST);
+
+	counterTotals.assign(cd::rm::COUNTER_COUNT, 0);
+	countedFrames = 0;
+	logRequested = false;
 }
 
 void Renderer::createKernels() {
@@ -243,17 +459,19 @@ void Renderer::createKernels() {
 
 	kernel.setArg(3, sphere_count);
 	kernel.setArg(4, light_count);
-	kernel.setArg(5, polygon_count);
+	/* arg 5 = instance count (per frame slot) */
 
 	kernel.setArg(6, cl_spheres);
-	kernel.setArg(7, gl_objects[gl_object_indices::vertices]);
+	/* arg 7 = skinned and static vertices (setMeshes) */
 	kernel.setArg(8, cl_polygons);
+	/* arg 9 = output image (per frame slot) */
+	/* arg 10 = indexed triangles in bvh leaf order, 11 = bottom level bvh nodes (setMeshes) */
+	/* arg 12 = instances, 13 = top level bvh nodes (per frame slot) */
 
-	setOutArg();
-}
-
-void Renderer::setOutArg() {
-	kernel.setArg(9, gl_objects[gl_object_indices::output_image]);
+#	ifdef KERNEL_COUNTERS
+	/* arg 14 = counters, 15 = pixel cost (per frame slot) */
+	kernel.setArg(16, heatmapMaxCost);
+#	endif
 }
 
 void Renderer::createKernel(const char* filename, cl::Kernel& kernel, const char* entryPoint) {
@@ -266,6 +484,11 @@ void Renderer::createKernel(const char* filename, cl::Kernel& kernel, const char
 	source += "#define HALF_RESOLUTION\n";
 #endif
 
+	// debug kernel with performance counters
+#ifdef KERNEL_COUNTERS
+	source += "#define KERNEL_COUNTERS\n";
+#endif
+
 	// Convert the OpenCL source code to a string
 	std::ifstream file(filename);
 	if (!file) {
@@ -283,6 +506,7 @@ void Renderer::createKernel(const char* filename, cl::Kernel& kernel, const char
 
 	// compiler options
 	std::string options = "-cl-std=CL1.2 -cl-fast-relaxed-math -cl-denorms-are-zero -Werror";
+	options += " -I " KERNEL_INCLUDE_DIR;
 
 	// Create an OpenCL program by performing runtime source compilation for the chosen device
 	cl::Program program = cl::Program(context, kernel_source);
@@ -309,6 +533,38 @@ void Renderer::setLocalWork(uint32_t localSize) {
 
 // HELPER FUNCTIONS
 
+void Renderer::resolveEvents(FrameEvents &events) {
+	events.release.wait();
+
+	// device timestamps -> host clock, assuming the acquire was queued as soon as it was enqueued
+	uint64_t offset = events.hostQueued - events.acquire.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+
+	auto record = [&](cd::ProfileStage stage, const cl::Event &event) {
+		Profiler::Record(stage, events.frame,
+			event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>() + offset,
+			event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>() + offset,
+			event.getProfilingInfo<CL_PROFILING_COMMAND_START>() + offset,
+			event.getProfilingInfo<CL_PROFILING_COMMAND_END>() + offset);
+	};
+
+	// every mesh skinned for the frame as one span
+	if (!events.skin.empty()) {
+		uint64_t queued = UINT64_MAX, submit = UINT64_MAX, start = UINT64_MAX, end = 0;
+		for (const cl::Event &skin : events.skin) {
+			queued = std::min(queued, skin.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>());
+			submit = std::min(submit, skin.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>());
+			start = std::min(start, skin.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+			end = std::max(end, skin.getProfilingInfo<CL_PROFILING_COMMAND_END>());
+		}
+		Profiler::Record(cd::stage_skin, events.frame, queued + offset, submit + offset, start + offset, end + offset);
+	}
+	record(cd::stage_acquire, events.acquire);
+	record(cd::stage_render, events.render);
+	record(cd::stage_release, events.release);
+
+	events.pending = false;
+}
+
 void Renderer::printErrorLog(const cl::Program& program, const cl::Device& device) {
 
 	// Get the error log and print to console
@@ -2,29 +2,48 @@
 
 #include "tools/Config.hpp"
 #include "model/Sphere.hpp"
+#include "model/Instance.hpp"
+#include "model/Bvh.hpp"
 
+#include <GL/gl3w.h>
 #include <CL/cl.hpp>
 #include <vector>
+#include <array>
 #include <string>
 
 class Interface;
-class PrimitiveProcessor;
 
 class Renderer {
 public:
 
 	Renderer();
-	void init(int image_width, int image_height,
-		Interface* interface, PrimitiveProcessor* vertexProcessor,
+	void init(int image_width, int image_height, Interface* interface,
 		std::vector<cd::Sphere>& spheres, std::vector<cd::Sphere>& lights, std::vector<cl_uchar4>& polygon_colors);
 
-	void renderQueue(const float view[4][4], float seconds);
-	void renderBarrier();
+	// skinned meshes and their bottom level bvhs (PrimitiveProcessor), instances index into them
+	void setMeshes(const cl::Buffer &vertices, const cl::Buffer &triangles, const cl::Buffer &nodes);
+	// builds the top level bvh over the instance bounds and uploads both for the frame in this slot
+	void setInstances(uint32_t slot, const std::vector<cd::GpuInstance> &instances, const std::vector<cd::Aabb> &bounds);
+
+	// queue the frame without waiting, rendering starts once every verticesReady event completes
+	void renderQueue(const float view[4][4], float seconds, uint32_t slot, const std::vector<cl::Event> &verticesReady);
+	// once FRAMES_IN_FLIGHT frames are queued, waits for the oldest and returns its slot to draw, otherwise -1
+	int renderBarrier();
+	void renderFinish(); // waits for every queued frame, which are then never returned by renderBarrier
 
 	void resize(int image_width, int image_height, Interface *interface);
 
+	// KERNEL_COUNTERS debug kernel only
+	void setHeatmap(bool enabled); // draw the per pixel cost instead of the shaded image
+	void logCounters(); // log and reset the counter totals once the next frame completes (renderBarrier)
+
 	void cleanUp();
 
+	// shared with the skinning kernel (PrimitiveProcessor)
+	inline const cl::Context &getContext() { return context; }
+	inline const cl::CommandQueue &getQueue() { return queue; }
+	void createKernel(const char* filename, cl::Kernel& kernel, const char* entryPoint);
+
 private:
 
 	cl::Platform platform;
@@ -42,14 +61,52 @@ private:
 	cl::Buffer cl_spheres;
 	cl::Buffer cl_polygons;
 
-	// contents: [0] = cl::Buffer cl_gl_vertices; [1] = cl::ImageGL cl_output;
-	std::vector<cl::Memory> gl_objects;
+	// per frame slot: instances in top level leaf order and the top level bvh
+	struct SlotInstances {
+		std::vector<cd::GpuInstance> instances; // host copies stay untouched until the upload completes
+		std::vector<cd::BvhNode> nodes;
+		cl::Buffer cl_instances;
+		cl::Buffer cl_nodes;
+		cl::Event uploaded;
+	};
+	std::array<SlotInstances, FRAMES_IN_FLIGHT> slotInstances;
+
+	// per frame slot, contents: [0] = cl::ImageGL cl_output;
+	std::array<std::vector<cl::Memory>, FRAMES_IN_FLIGHT> gl_objects;
 	enum gl_object_indices {
-		vertices,
 		output_image,
 		count
 	};
 
+	// opencl events of the commands enqueued each frame (profiled when PROFILE_GPU is defined)
+	struct FrameEvents {
+		std::vector<cl::Event> skin; // PrimitiveProcessor::vertexProcess of the meshes this frame reads
+		cl::Event acquire;
+		cl::Event render;
+		cl::Event release;
+		GLsync glReady = nullptr;
+		uint64_t frame = 0;
+		uint32_t slot = 0;
+		uint64_t hostQueued = 0; // host time when the acquire was enqueued
+		bool pending = false; // timings not yet collected
+	};
+	std::array<FrameEvents, PROFILE_EVENT_RING> frameEvents;
+	uint32_t frameIndex = 0; // frames queued
+	uint32_t presentIndex = 0; // frames returned by renderBarrier
+
+	// cl_khr_gl_event, null if unsupported
+	typedef cl_event (CL_API_CALL *CreateEventFromGLsync)(cl_context context, cl_GLsync sync, cl_int *errcode_ret);
+	CreateEventFromGLsync createEventFromGLsync = nullptr;
+
+	// debug kernel counters per frame slot, read once the slot's frame completes: cl_counters holds a (low, high) uint
+	// pair per counter_index (render_math.h)
+	std::array<cl::Buffer, FRAMES_IN_FLIGHT> cl_counters;
+	std::array<cl::Buffer, FRAMES_IN_FLIGHT> cl_pixel_cost;
+	cl_uint heatmapMaxCost = 0; // 0 = shaded image
+	std::vector<uint64_t> counterTotals; // of the completed frames since the last log
+	uint32_t countedFrames = 0;
+	bool logRequested = false;
+
 	int sphere_count = 0;
 	int light_count = 0;
 	int polygon_count = 0;
@@ -64,15 +121,18 @@ private:
 	void createContext(Interface* interface);
 	void createQueue();
 
-	void createBuffers(cl_GLenum gl_texture_target, cl_GLuint gl_texture, cl_GLuint gl_vert_buffer,
+	void createBuffers(Interface *interface,
 			std::vector<cd::Sphere>& spheres, std::vector<cd::Sphere>& lights, std::vector<cl_uchar4>& polygon_colors);
-	void createOutputImage(cl_GLenum gl_texture_target, cl_GLuint gl_texture);
+	void createOutputImages(Interface *interface);
+	void createInstanceBuffers();
+	void createCounterBuffers();
+	void readCounters(uint32_t slot);
 
 	void createKernels();
-	void setOutArg();
-	void createKernel(const char* filename, cl::Kernel& kernel, const char* entryPoint);
 	void setGlobalWork();
 	void setLocalWork(uint32_t localSize);
 
+	void resolveEvents(FrameEvents &events);
+
 	void printErrorLog(const cl::Program& program, const cl::Device& device);
 };
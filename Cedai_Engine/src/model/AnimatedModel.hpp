@@ -1,7 +1,11 @@
 #pragma once
 
 #include "tools/Config.hpp"
+#include "tools/Span.hpp"
+#include "tools/MappedFile.hpp"
 #include "Vertex.hpp"
+#include "CompressedClip.hpp"
+#include "Bvh.hpp"
 
 #include <glm/glm.hpp>
 #include <vector>
@@ -17,16 +21,36 @@ namespace cd
 
 	struct AnimationClip {
 		double duration = 0;
-		std::vector<Keyframe> keyframes;
+		Span<Keyframe> keyframes;
+	};
+
+	// a coarser mesh over the same vertices
+	struct MeshLod {
+		Span<glm::uvec3> indices;
+		Span<uint32_t> sources; // per triangle, the full mesh triangle it was simplified from
+		Span<BvhNode> bvh; // prebaked, with indices relative to the level, empty when the file has none
+		float error = 0; // largest distance to the full mesh's surface, model units
 	};
 }
 
 struct AnimatedModel {
-	int keyFrameIndex = 0;
-	std::vector<cd::Vertex> vertices;
-	cd::AnimationClip animation;
+	cd::Span<cd::PackedVertex> vertices; // unique, skinned once per pose, uploaded as they are
+	cd::Aabb vertexBounds; // the bind pose range the vertex positions are quantized against
+	cd::Span<glm::uvec3> indices; // one per triangle, into vertices
+	cd::Span<cd::TriangleCluster> clusters; // spatially compact runs of triangles, empty when the file has none
+	cd::Span<cd::BvhNode> bvh; // prebaked by the converter over the bind pose, empty when the file has none
+	std::vector<cd::MeshLod> lods; // coarser levels of detail, finest first
+	cd::CompressedClip animation;
+	cd::Aabb bounds; // of every pose, in model space
 
-	inline std::array<glm::mat4, MAX_BONES> GetBoneTransforms() {
-		return animation.keyframes[keyFrameIndex].boneTransforms;
-	}
+	// what vertices and indices point into: the mapped file (version 3) or the copies read from other versions. the
+	// vertices are always a copy, only version 4 stores them packed
+	MappedFile file;
+	std::vector<cd::PackedVertex> vertexStorage;
+	std::vector<glm::uvec3> indexStorage;
+	std::vector<cd::TriangleCluster> clusterStorage;
+	std::vector<cd::BvhNode> bvhStorage;
+	std::vector<glm::uvec3> lodIndexStorage;
+	std::vector<uint32_t> lodSourceStorage;
+	std::vector<cd::BvhNode> lodBvhStorage;
 };
\ No newline at end of file
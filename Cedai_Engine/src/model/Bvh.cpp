@@ -0,0 +1,60 @@
+#include "Bvh.hpp"
+
+#include <algorithm>
+
+namespace {
+	void split(const std::vector<cd::Aabb> &primitives, std::vector<cd::BvhNode> &nodes, std::vector<uint32_t> &order,
+			uint32_t node, uint32_t first, uint32_t count, uint32_t leafSize) {
+		cd::Aabb bounds, centers;
+		for (uint32_t p = first; p < first + count; p++) {
+			bounds.grow(primitives[order[p]]);
+			centers.grow(primitives[order[p]].center());
+		}
+		nodes[node].min = bounds.min;
+		nodes[node].max = bounds.max;
+
+		if (count <= leafSize) {
+			nodes[node].first = first;
+			nodes[node].count = count;
+			return;
+		}
+
+		// halve the primitives along the widest spread of their centers
+		glm::vec3 extent = centers.max - centers.min;
+		int axis = extent.x < extent.y ? (extent.y < extent.z ? 2 : 1) : (extent.x < extent.z ? 2 : 0);
+		uint32_t half = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+			[&](uint32_t a, uint32_t b) { return primitives[a].center()[axis] < primitives[b].center()[axis]; });
+
+		uint32_t children = (uint32_t)nodes.size();
+		nodes.resize(children + 2);
+		nodes[node].first = children;
+		nodes[node].count = 0;
+		split(primitives, nodes, order, children, first, half, leafSize);
+		split(primitives, nodes, order, children + 1, first + half, count - half, leafSize);
+	}
+}
+
+cd::Aabb cd::Aabb::transformed(const glm::mat4 &transform) const {
+	Aabb box;
+	for (int corner = 0; corner < 8; corner++) {
+		glm::vec3 point(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z);
+		box.grow(glm::vec3(transform * glm::vec4(point, 1)));
+	}
+	return box;
+}
+
+void cd::BuildBvh(const std::vector<Aabb> &primitives, std::vector<BvhNode> &nodes, std::vector<uint32_t> &order, uint32_t leafSize) {
+	nodes.clear();
+	order.resize(primitives.size());
+	for (uint32_t p = 0; p < order.size(); p++)
+		order[p] = p;
+
+	nodes.reserve(primitives.size() * 2);
+	nodes.push_back(BvhNode());
+	if (primitives.empty()) {
+		nodes[0] = { glm::vec3(0), 0, glm::vec3(0), 0 };
+		return;
+	}
+	split(primitives, nodes, order, 0, 0, (uint32_t)primitives.size(), std::max(1u, leafSize));
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+#define BVH_LEAF_SIZE 4 /* primitives per leaf */
+#define BVH_MAX_DEPTH 32 /* nodes from the root to a leaf that traversal can follow, BVH_STACK_SIZE in kernel.cl */
+
+namespace cd {
+	struct Aabb {
+		glm::vec3 min = glm::vec3(INFINITY);
+		glm::vec3 max = glm::vec3(-INFINITY);
+
+		inline void grow(glm::vec3 point) { min = glm::min(min, point); max = glm::max(max, point); }
+		inline void grow(const Aabb &box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+		inline glm::vec3 center() const { return (min + max) * 0.5f; }
+		Aabb transformed(const glm::mat4 &transform) const; // bounds of the transformed box
+	};
+
+	/*
+	matches BvhNode in kernel.cl (two float4). interior nodes have count = 0 and their children at first and first + 1,
+	leaves hold primitives [first, first + count) of the build order. children are always stored after their parent
+	so walking the nodes backwards visits children first.
+	*/
+	struct BvhNode {
+		glm::vec3 min;
+		int32_t first;
+		glm::vec3 max;
+		int32_t count;
+	};
+
+	// consecutive triangles [first, first + count) and their bind pose bounds (matches TriangleCluster in the converter's FBX_Loader.h)
+	struct TriangleCluster {
+		glm::vec3 min;
+		uint32_t first;
+		glm::vec3 max;
+		uint32_t count;
+	};
+
+	// median split bvh over the primitive bounds, order = primitive of each leaf slot
+	void BuildBvh(const std::vector<Aabb> &primitives, std::vector<BvhNode> &nodes, std::vector<uint32_t> &order,
+		uint32_t leafSize = BVH_LEAF_SIZE);
+}
@@ -0,0 +1,202 @@
+#include "CompressedClip.hpp"
+#include "AnimatedModel.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+
+#define SCALE_EPSILON 1e-4f /* tracks with every scale within this of 1 store no scale */
+
+namespace {
+	uint16_t quantizeUnit(float value) {
+		return (uint16_t)std::lround(glm::clamp(value, 0.0f, 1.0f) * 65535.0f);
+	}
+
+	glm::u16vec3 quantizeRange(glm::vec3 value, glm::vec3 min, glm::vec3 range) {
+		glm::vec3 unit = glm::vec3(
+			range.x > 0 ? (value.x - min.x) / range.x : 0,
+			range.y > 0 ? (value.y - min.y) / range.y : 0,
+			range.z > 0 ? (value.z - min.z) / range.z : 0);
+		return glm::u16vec3(quantizeUnit(unit.x), quantizeUnit(unit.y), quantizeUnit(unit.z));
+	}
+
+	glm::vec3 dequantizeRange(const uint16_t value[3], glm::vec3 min, glm::vec3 range) {
+		return min + glm::vec3(value[0], value[1], value[2]) * (range * (1.0f / 65535.0f));
+	}
+
+	glm::quat dequantizeRotation(const int16_t value[4]) {
+		return glm::normalize(glm::quat(value[3], value[0], value[1], value[2]));
+	}
+
+	// time on the same 0 - 65535 scale as the keys
+	float quantizedTime(double time, double duration) {
+		return duration > 0 ? (float)glm::clamp(time / duration, 0.0, 1.0) * 65535.0f : 0;
+	}
+
+	// key k starts the interval holding the time, the first and last intervals extend past the ends
+	bool inInterval(const cd::TrackKey *keys, uint32_t last, uint32_t k, float time) {
+		if (last == 0) return k == 0;
+		if (last <= k) return false;
+		return (k == 0 || keys[k].time <= time) && (k + 1 == last || time < keys[k + 1].time);
+	}
+
+	uint32_t findKey(const cd::TrackKey *keys, uint32_t last, float time) {
+		if (last == 0) return 0;
+		const cd::TrackKey *k = std::upper_bound(keys + 1, keys + last, time,
+			[](float t, const cd::TrackKey &key) { return t < key.time; });
+		return (uint32_t)(k - keys) - 1;
+	}
+
+	// column by column so each column is one 4 wide multiply-add
+	void compose(glm::mat4 &out, const glm::quat &rotation, glm::vec3 translation, glm::vec3 scale) {
+		glm::mat3 r = glm::mat3_cast(rotation);
+		out[0] = glm::vec4(r[0] * scale.x, 0);
+		out[1] = glm::vec4(r[1] * scale.y, 0);
+		out[2] = glm::vec4(r[2] * scale.z, 0);
+		out[3] = glm::vec4(translation, 1);
+	}
+
+	void decompose(const glm::mat4 &m, glm::quat &rotation, glm::vec3 &translation, glm::vec3 &scale) {
+		translation = glm::vec3(m[3]);
+		scale = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+		if (glm::determinant(glm::mat3(m)) < 0)
+			scale.x = -scale.x;
+		glm::mat3 r(glm::vec3(m[0]) / scale.x, glm::vec3(m[1]) / scale.y, glm::vec3(m[2]) / scale.z);
+		rotation = glm::normalize(glm::quat_cast(r));
+	}
+}
+
+void cd::CompressedClip::Sample(double time, glm::mat4 *palette, uint32_t *cursors) const {
+	float clipTime = quantizedTime(time, duration);
+
+	for (size_t t = 0; t < tracks.size(); t++) {
+		const BoneTrack &track = tracks[t];
+		const TrackKey *first = &keys[track.firstKey];
+		uint32_t last = track.keyCount - 1;
+
+		// interval [k0, k1] containing the time, holding the end keys outside the track
+		uint32_t k0 = cursors ? cursors[t] : 0;
+		if (!inInterval(first, last, k0, clipTime)) {
+			// playing forward the time has usually only moved on to the next interval
+			if (inInterval(first, last, k0 + 1, clipTime))
+				k0++;
+			else
+				k0 = findKey(first, last, clipTime);
+		}
+		if (cursors)
+			cursors[t] = k0;
+		uint32_t k1 = std::min(k0 + 1, last);
+
+		float span = (float)first[k1].time - first[k0].time;
+		float f = span > 0 ? glm::clamp((clipTime - first[k0].time) / span, 0.0f, 1.0f) : 0;
+
+		glm::quat rotation = glm::slerp(dequantizeRotation(first[k0].rotation), dequantizeRotation(first[k1].rotation), f);
+		glm::vec3 translation = glm::mix(
+			dequantizeRange(first[k0].translation, track.translationMin, track.translationRange),
+			dequantizeRange(first[k1].translation, track.translationMin, track.translationRange), f);
+
+		glm::vec3 scale(1);
+		if (track.hasScale) {
+			const glm::u16vec3 &s0 = scaleKeys[track.firstScaleKey + k0];
+			const glm::u16vec3 &s1 = scaleKeys[track.firstScaleKey + k1];
+			scale = track.scaleMin + glm::mix(glm::vec3(s0), glm::vec3(s1), f) * (track.scaleRange * (1.0f / 65535.0f));
+		}
+
+		compose(palette[track.bone], rotation, translation, scale);
+	}
+}
+
+uint32_t cd::CompressedClip::FindKey(const BoneTrack &track, double time) const {
+	return findKey(&keys[track.firstKey], track.keyCount - 1, quantizedTime(time, duration));
+}
+
+size_t cd::CompressedClip::Bytes() const {
+	return sizeof(CompressedClip) + tracks.size() * sizeof(BoneTrack) + keys.size() * sizeof(TrackKey)
+		+ scaleKeys.size() * sizeof(glm::u16vec3);
+}
+
+float cd::CompressClip(const AnimationClip &clip, Span<PackedVertex> vertices, CompressedClip &compressed) {
+	compressed = CompressedClip();
+	compressed.duration = clip.duration;
+	if (clip.keyframes.empty()) return 0;
+
+	// only bones that move a vertex
+	bool used[MAX_BONES] = { false };
+	for (const PackedVertex &vertex : vertices) {
+		for (int b = 0; b < 4; b++) {
+			int bone = vertex.boneIndices[b];
+			if (bone < MAX_BONES && vertex.boneWeights[b] != 0)
+				used[bone] = true;
+		}
+	}
+
+	size_t keyCount = clip.keyframes.size();
+	std::vector<glm::quat> rotations(keyCount);
+	std::vector<glm::vec3> translations(keyCount), scales(keyCount);
+	float maxError = 0;
+
+	for (uint16_t bone = 0; bone < MAX_BONES; bone++) {
+		if (!used[bone]) continue;
+
+		BoneTrack track;
+		track.bone = bone;
+		track.firstKey = (uint32_t)compressed.keys.size();
+		track.keyCount = (uint32_t)keyCount;
+
+		glm::vec3 translationMax(-INFINITY), scaleMax(-INFINITY);
+		track.translationMin = glm::vec3(INFINITY);
+		track.scaleMin = glm::vec3(INFINITY);
+		for (size_t k = 0; k < keyCount; k++) {
+			decompose(clip.keyframes[k].boneTransforms[bone], rotations[k], translations[k], scales[k]);
+
+			// keep neighbouring quaternions in the same hemisphere so interpolation takes the short way
+			if (k > 0 && glm::dot(rotations[k], rotations[k - 1]) < 0)
+				rotations[k] = -rotations[k];
+
+			track.translationMin = glm::min(track.translationMin, translations[k]);
+			translationMax = glm::max(translationMax, translations[k]);
+			track.scaleMin = glm::min(track.scaleMin, scales[k]);
+			scaleMax = glm::max(scaleMax, scales[k]);
+		}
+		track.translationRange = translationMax - track.translationMin;
+		track.hasScale = glm::any(glm::greaterThan(glm::abs(track.scaleMin - 1.0f), glm::vec3(SCALE_EPSILON)))
+			|| glm::any(glm::greaterThan(glm::abs(scaleMax - 1.0f), glm::vec3(SCALE_EPSILON)));
+		if (track.hasScale) {
+			track.scaleRange = scaleMax - track.scaleMin;
+			track.firstScaleKey = (uint32_t)compressed.scaleKeys.size();
+		} else {
+			track.scaleMin = glm::vec3(1);
+		}
+
+		for (size_t k = 0; k < keyCount; k++) {
+			TrackKey key;
+			key.time = quantizeUnit(clip.duration > 0 ? (float)(clip.keyframes[k].time / clip.duration) : 0);
+			key.rotation[0] = (int16_t)std::lround(rotations[k].x * 32767.0f);
+			key.rotation[1] = (int16_t)std::lround(rotations[k].y * 32767.0f);
+			key.rotation[2] = (int16_t)std::lround(rotations[k].z * 32767.0f);
+			key.rotation[3] = (int16_t)std::lround(rotations[k].w * 32767.0f);
+			glm::u16vec3 translation = quantizeRange(translations[k], track.translationMin, track.translationRange);
+			key.translation[0] = translation.x;
+			key.translation[1] = translation.y;
+			key.translation[2] = translation.z;
+			compressed.keys.push_back(key);
+			if (track.hasScale)
+				compressed.scaleKeys.push_back(quantizeRange(scales[k], track.scaleMin, track.scaleRange));
+		}
+		compressed.tracks.push_back(track);
+	}
+
+	// error at every source keyframe
+	std::vector<glm::mat4> palette(MAX_BONES);
+	for (const Keyframe &keyframe : clip.keyframes) {
+		compressed.Sample(keyframe.time, palette.data());
+		for (const BoneTrack &track : compressed.tracks) {
+			const glm::mat4 &source = keyframe.boneTransforms[track.bone];
+			for (int c = 0; c < 4; c++) {
+				for (int r = 0; r < 4; r++)
+					maxError = std::max(maxError, std::fabs(palette[track.bone][c][r] - source[c][r]));
+			}
+		}
+	}
+	return maxError;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "tools/Config.hpp"
+#include "tools/Span.hpp"
+#include "Vertex.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+
+namespace cd {
+	struct AnimationClip;
+
+	// one key of a bone track, 16 bytes
+	struct TrackKey {
+		uint16_t time;				// fraction of the clip duration * 65535
+		int16_t rotation[4];		// quaternion (x, y, z, w) * 32767
+		uint16_t translation[3];	// fraction of the track's translation range * 65535
+	};
+
+	// the keys of one bone that influences the mesh
+	struct BoneTrack {
+		uint16_t bone = 0;			// palette index
+		uint16_t hasScale = 0;		// otherwise scale is 1
+		uint32_t firstKey = 0;		// into CompressedClip::keys (and scaleKeys when hasScale)
+		uint32_t keyCount = 0;
+		uint32_t firstScaleKey = 0;
+		glm::vec3 translationMin = glm::vec3(0);
+		glm::vec3 translationRange = glm::vec3(0);
+		glm::vec3 scaleMin = glm::vec3(1);
+		glm::vec3 scaleRange = glm::vec3(0);
+	};
+
+	/*
+	Animation stored as quantized rotation + translation (+ scale) keys per used bone instead of full
+	palettes per keyframe. Sampling interpolates between keys (slerp rotation, lerp translation and scale)
+	so the pose is continuous at any render rate. Bones without a track are never written and keep the
+	palette's identity.
+	*/
+	struct CompressedClip {
+		double duration = 0;
+		std::vector<BoneTrack> tracks;
+		std::vector<TrackKey> keys;
+		std::vector<glm::u16vec3> scaleKeys;
+
+		// cursors (one per track, may be null) cache the key each track was last sampled at
+		void Sample(double time, glm::mat4 *palette, uint32_t *cursors = nullptr) const;
+		uint32_t FindKey(const BoneTrack &track, double time) const; // binary search
+		size_t Bytes() const;
+	};
+
+	// returns the largest difference of any matrix element between the clip and its compressed keys
+	float CompressClip(const AnimationClip &clip, Span<PackedVertex> vertices, CompressedClip &compressed);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+
+namespace cd {
+	// one placement of an animated model
+	struct ModelInstance {
+		glm::mat4 transform = glm::mat4(1.0f);
+		uint32_t player = 0; // Animator player, instances sharing a player are skinned once
+	};
+
+	// one placement of a static model, traced beside the animated instances but never skinned
+	struct StaticInstance {
+		glm::mat4 transform = glm::mat4(1.0f);
+		uint32_t mesh = 0; // PrimitiveProcessor static mesh
+	};
+
+	// matches Instance in kernel.cl: affine transforms as 3 rows
+	struct GpuInstance {
+		glm::vec4 worldToObject[3];
+		glm::vec4 objectToWorld[3];
+		glm::ivec4 offsets; // x = first vertex, y = first bottom level bvh node, z / w = root of the camera / shadow level
+
+		GpuInstance(const glm::mat4 &transform, int32_t vertexOffset, int32_t nodeOffset, int32_t root = 0, int32_t shadowRoot = 0) {
+			glm::mat4 inverse = glm::inverse(transform);
+			for (int r = 0; r < 3; r++) {
+				worldToObject[r] = glm::vec4(inverse[0][r], inverse[1][r], inverse[2][r], inverse[3][r]);
+				objectToWorld[r] = glm::vec4(transform[0][r], transform[1][r], transform[2][r], transform[3][r]);
+			}
+			offsets = glm::ivec4(vertexOffset, nodeOffset, root, shadowRoot);
+		}
+	};
+}
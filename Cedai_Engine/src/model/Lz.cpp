@@ -0,0 +1,54 @@
+#include "Lz.hpp"
+
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+
+namespace {
+	// lengths of 15 continue in the following bytes, each adding up to 255
+	bool readLength(const uint8_t *&ip, const uint8_t *end, size_t &length) {
+		if (length != 15) return true;
+		uint8_t add;
+		do {
+			if (ip == end) return false;
+			add = *ip++;
+			length += add;
+		} while (add == 255);
+		return true;
+	}
+}
+
+bool cd::LzDecompress(const uint8_t *src, size_t srcBytes, uint8_t *dst, size_t dstBytes) {
+	const uint8_t *ip = src;
+	const uint8_t *end = src + srcBytes;
+	uint8_t *op = dst;
+	uint8_t *dstEnd = dst + dstBytes;
+
+	while (ip < end) {
+		uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (!readLength(ip, end, literals) || (size_t)(end - ip) < literals || (size_t)(dstEnd - op) < literals)
+			return false;
+		std::memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == end) break; // the last sequence has no match
+
+		if (end - ip < 2) return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		size_t match = token & 15;
+		if (!readLength(ip, end, match)) return false;
+		match += LZ_MIN_MATCH;
+		if (offset == 0 || (size_t)(op - dst) < offset || (size_t)(dstEnd - op) < match)
+			return false;
+
+		// byte by byte, the match may overlap what it copies (runs)
+		const uint8_t *from = op - offset;
+		for (size_t i = 0; i < match; i++)
+			op[i] = from[i];
+		op += match;
+	}
+	return op == dstEnd;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace cd {
+	// decodes one lz4 format block of exactly dstBytes, false when the block is malformed or a different size
+	bool LzDecompress(const uint8_t *src, size_t srcBytes, uint8_t *dst, size_t dstBytes);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#define MODEL_SECTION_ALIGNMENT 64 /* section offsets are multiples of this (also defined in FBX_Loader.h in the model converter) */
+#define MODEL_BLOCK_BYTES (64 * 1024) /* decoded bytes per independently compressed block (also defined in FBX_Loader.h) */
+
+/*
+Layout of the version 3 and 4 model files, written by the model converter. A header, a table of sections, then each
+section's elements at an aligned offset:
+
+	ModelFileHeader
+	ModelSection (ModelSectionv3 in version 3) * sectionCount
+	(padding) section data ...
+
+Version 3 sections are raw engine structs read in place from a mapped file, with no parse or intermediate copy of
+the file. Only the indices are used as they are though: the vertices are packed and the keyframes compressed for
+upload like every other version's, so mapping saves the reading, not the upload's copies. Version 4 stores packed
+vertices (PackedVertex, quantized against section_vertex_bounds), keyframes of only the model's bones and may
+compress sections. A compressed section is split into blocks of whole elements of at most MODEL_BLOCK_BYTES,
+stored as the compressed size of every block (uint32_t each) followed by the blocks, so blocks decode in parallel.
+Sections of unknown type are skipped so later versions can add sections older readers ignore. A static version 4
+file (the converter's --static export) has no bones, no keyframes section and no levels of detail, only
+LoadStaticModel reads it.
+*/
+namespace cd {
+	enum ModelSectionType : uint32_t {
+		section_vertices = 1,			// cd::Vertex, unique
+		section_indices = 2,			// glm::uvec3 per triangle, into the vertices
+		section_keyframes = 3,			// cd::Keyframe of MAX_BONES matrices
+		section_packed_vertices = 4,	// cd::PackedVertex
+		section_vertex_bounds = 5,		// one cd::Aabb, the range of the packed positions
+		section_packed_keyframes = 6,	// double time then boneCount glm::mat4
+		section_triangle_clusters = 7,	// cd::TriangleCluster, optional, covering the triangles in order
+		section_bvh_nodes = 8,			// cd::BvhNode, optional, bind pose bvh whose leaves index the triangles directly
+		section_lod_indices = 9,		// glm::uvec3, optional, the triangles of every coarser level of detail in turn
+		section_lod_bvh_nodes = 10,		// cd::BvhNode, optional, the bvh of every coarser level in turn
+		section_lods = 11,				// cd::ModelLod, optional, one per coarser level, finest first
+		section_lod_sources = 12		// uint32_t per section_lod_indices triangle, the full mesh triangle it comes from (its color)
+	};
+
+	enum ModelSectionEncoding : uint32_t {
+		encoding_raw = 0,
+		encoding_lz = 1 // lz4 block format per block
+	};
+
+	struct ModelFileHeader {
+		uint16_t version;
+		uint16_t sectionCount;
+		uint32_t boneCount; // MAX_BONES in version 3, the model's bones in version 4 (0 in a static file)
+		double duration; // of the animation, seconds
+	};
+
+	struct ModelSection {
+		uint32_t type;
+		uint32_t count; // elements
+		uint64_t offset; // from the start of the file
+		uint64_t bytes; // stored, with the block sizes when compressed
+		uint32_t encoding;
+		uint32_t reserved;
+	};
+
+	struct ModelSectionv3 {
+		uint32_t type;
+		uint32_t count;
+		uint64_t offset;
+		uint64_t bytes;
+	};
+
+	// a coarser level of detail over the same vertices, its bvh's child and triangle indices relative to the level's own
+	// first node and triangle
+	struct ModelLod {
+		uint32_t firstTriangle; // into section_lod_indices
+		uint32_t triangleCount;
+		uint32_t firstNode; // into section_lod_bvh_nodes
+		uint32_t nodeCount; // 0 when the bvh isn't prebaked
+		float error; // largest distance between the level's surface and the full mesh, model units
+		uint32_t reserved[3];
+	};
+
+	static_assert(sizeof(ModelLod) == 32, "model file layout");
+	static_assert(sizeof(ModelFileHeader) == 16 && sizeof(ModelSection) == 32 && sizeof(ModelSectionv3) == 24, "model file layout");
+}
@@ -1,15 +1,454 @@
 #include "Model_Loader.hpp"
+#include "ModelFile.hpp"
+#include "Lz.hpp"
 
 #include "tools/Log.hpp"
+#include "tools/Trace.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <cmath>
+
+#define ANIMATED_BOUNDS_MARGIN 0.05f /* fraction of the extent */
 
 bool fileExists(const std::string& filePath) {
 	struct stat buffer;
 	return (stat(filePath.c_str(), &buffer) == 0);
 }
 
+namespace {
+	struct VertexLess {
+		bool operator()(const cd::Vertex &a, const cd::Vertex &b) const { return std::memcmp(&a, &b, sizeof(cd::Vertex)) < 0; }
+	};
+
+	// v1 files store three vertices per triangle, identical copies become one indexed vertex
+	void weldVertices(const std::vector<cd::Vertex> &corners, std::vector<cd::Vertex> &vertices, std::vector<glm::uvec3> &indices) {
+		std::map<cd::Vertex, uint32_t, VertexLess> unique;
+		vertices.clear();
+
+		indices.resize(corners.size() / 3);
+		for (size_t c = 0; c < indices.size() * 3; c++) {
+			auto found = unique.emplace(corners[c], (uint32_t)vertices.size());
+			if (found.second)
+				vertices.push_back(corners[c]);
+			indices[c / 3][c % 3] = found.first->second;
+		}
+		CD_INFO("model welded: {} vertices -> {} unique", corners.size(), vertices.size());
+	}
+
+	// files before version 4 store full vertices, they're packed as the converter packs them (PackedVertex)
+	void packVertices(cd::Span<cd::Vertex> vertices, AnimatedModel &model) {
+		cd::Aabb &bounds = model.vertexBounds;
+		bounds = cd::Aabb();
+		for (const cd::Vertex &vertex : vertices)
+			bounds.grow(glm::vec3(vertex.position));
+		glm::vec3 extent = bounds.max - bounds.min;
+
+		model.vertexStorage.resize(vertices.size());
+		float maxError = 0;
+		for (size_t v = 0; v < vertices.size(); v++) {
+			const cd::Vertex &vertex = vertices[v];
+			cd::PackedVertex &out = model.vertexStorage[v];
+			for (int c = 0; c < 3; c++) {
+				float unit = extent[c] > 0 ? (vertex.position[c] - bounds.min[c]) / extent[c] : 0;
+				out.position[c] = (uint16_t)std::lround(glm::clamp(unit, 0.0f, 1.0f) * 65535.0f);
+				maxError = std::max(maxError, std::fabs(bounds.min[c] + out.position[c] * extent[c] / 65535.0f - vertex.position[c]));
+			}
+			out.position[3] = 0;
+
+			// weights of the bones the kernel can use, normalized to 255 with the largest taking the rounding
+			float sum = 0;
+			for (int b = 0; b < 4; b++) {
+				bool used = 0 <= vertex.boneIndices[b] && vertex.boneIndices[b] < MAX_BONES && vertex.boneWeights[b] > 0;
+				out.boneIndices[b] = used ? (uint8_t)vertex.boneIndices[b] : 255;
+				sum += used ? vertex.boneWeights[b] : 0;
+			}
+			int total = 0, largest = 0;
+			for (int b = 0; b < 4; b++) {
+				out.boneWeights[b] = out.boneIndices[b] != 255 ? (uint8_t)std::lround(vertex.boneWeights[b] / sum * 255.0f) : 0;
+				total += out.boneWeights[b];
+				if (out.boneWeights[b] > out.boneWeights[largest]) largest = b;
+			}
+			if (out.boneIndices[largest] != 255) // unweighted vertices keep the bind position
+				out.boneWeights[largest] = (uint8_t)(out.boneWeights[largest] + 255 - total);
+		}
+		model.vertices = model.vertexStorage;
+		CD_INFO("model vertices packed: {} -> {} bytes per vertex, max position error {:.2e}", sizeof(cd::Vertex),
+			sizeof(cd::PackedVertex), maxError);
+	}
+
+	void checkIndices(const AnimatedModel &model) {
+		for (const glm::uvec3 &triangle : model.indices) {
+			if (model.vertices.size() <= glm::max(triangle.x, glm::max(triangle.y, triangle.z))) {
+				CD_ERROR("model reader triangle index out of range ({} vertices)", model.vertices.size());
+				throw std::runtime_error("model reader");
+			}
+		}
+	}
+
+	// clusters must cover every triangle once in order, otherwise they're dropped and the bvh is built from the triangles
+	void checkClusters(AnimatedModel &model) {
+		uint32_t next = 0;
+		for (const cd::TriangleCluster &cluster : model.clusters) {
+			if (cluster.first != next || cluster.count == 0 || model.indices.size() - next < cluster.count) {
+				next = UINT32_MAX;
+				break;
+			}
+			next += cluster.count;
+		}
+		if (!model.clusters.empty() && next != model.indices.size()) {
+			CD_WARN("model reader triangle clusters don't cover the triangles, ignoring them");
+			model.clusterStorage.clear();
+			model.clusters = cd::Span<cd::TriangleCluster>();
+		}
+	}
+
+	// a tree with children after their parent whose leaves cover every one of the triangles once, no deeper than the
+	// kernel's traversal stack (it skips whatever doesn't fit)
+	bool validBvh(cd::Span<cd::BvhNode> nodes, size_t triangleCount) {
+		std::vector<uint32_t> parents(nodes.size()), covered(triangleCount), depths(nodes.size(), 1);
+		bool valid = true;
+		for (size_t n = 0; n < nodes.size() && valid; n++) {
+			int64_t first = nodes[n].first, count = nodes[n].count;
+			if (count == 0) {
+				valid = (int64_t)n < first && first + 1 < (int64_t)nodes.size() && depths[n] < BVH_MAX_DEPTH;
+				if (valid) {
+					parents[first]++;
+					parents[first + 1]++;
+					depths[first] = depths[first + 1] = depths[n] + 1;
+				}
+			} else {
+				valid = 0 < count && 0 <= first && first + count <= (int64_t)triangleCount;
+				for (int64_t slot = first; valid && slot < first + count; slot++)
+					covered[slot]++;
+			}
+		}
+		for (size_t n = 0; n < parents.size() && valid; n++)
+			valid = parents[n] == (n == 0 ? 0u : 1u);
+		return valid && std::all_of(covered.begin(), covered.end(), [](uint32_t leaves) { return leaves == 1; });
+	}
+
+	// a stored bvh that isn't valid is dropped and built from the triangles instead
+	void checkBvh(AnimatedModel &model) {
+		if (!model.bvh.empty() && !validBvh(model.bvh, model.indices.size())) {
+			CD_WARN("model reader bvh isn't a tree over the triangles at most {} deep, ignoring it", BVH_MAX_DEPTH);
+			model.bvhStorage.clear();
+			model.bvh = cd::Span<cd::BvhNode>();
+		}
+	}
+
+	// levels of detail point into the lod sections, any range or index outside them drops every level
+	void loadLods(AnimatedModel &model, const std::vector<cd::ModelLod> &levels) {
+		model.lods.clear();
+		if (!levels.empty() && model.lodSourceStorage.size() != model.lodIndexStorage.size()) {
+			CD_WARN("model reader levels of detail without a source per triangle, ignoring every level");
+			return;
+		}
+		for (const cd::ModelLod &level : levels) {
+			if (model.lodIndexStorage.size() < (size_t)level.firstTriangle + level.triangleCount || level.triangleCount == 0
+					|| model.lodBvhStorage.size() < (size_t)level.firstNode + level.nodeCount || !(0 <= level.error)) {
+				CD_WARN("model reader level of detail {} outside the lod sections, ignoring every level", model.lods.size() + 1);
+				model.lods.clear();
+				return;
+			}
+			cd::MeshLod lod;
+			lod.indices = cd::Span<glm::uvec3>(model.lodIndexStorage.data() + level.firstTriangle, level.triangleCount);
+			lod.sources = cd::Span<uint32_t>(model.lodSourceStorage.data() + level.firstTriangle, level.triangleCount);
+			lod.bvh = cd::Span<cd::BvhNode>(model.lodBvhStorage.data() + level.firstNode, level.nodeCount);
+			lod.error = level.error;
+			for (const glm::uvec3 &triangle : lod.indices) {
+				if (model.vertices.size() <= glm::max(triangle.x, glm::max(triangle.y, triangle.z))) {
+					CD_WARN("model reader level of detail {} triangle index out of range, ignoring every level", model.lods.size() + 1);
+					model.lods.clear();
+					return;
+				}
+			}
+			for (uint32_t source : lod.sources) {
+				if (model.indices.size() <= source) {
+					CD_WARN("model reader level of detail {} source triangle out of range, ignoring every level", model.lods.size() + 1);
+					model.lods.clear();
+					return;
+				}
+			}
+			if (!lod.bvh.empty() && !validBvh(lod.bvh, lod.indices.size())) {
+				CD_WARN("model reader level of detail {} bvh isn't a tree over its triangles at most {} deep, ignoring it", model.lods.size() + 1, BVH_MAX_DEPTH);
+				lod.bvh = cd::Span<cd::BvhNode>();
+			}
+			model.lods.push_back(lod);
+		}
+	}
+
+	// the section table of a mapped version 3 or 4 file, every section checked to lie in the file
+	std::vector<cd::ModelSection> readSections(const MappedFile &file) {
+		const cd::ModelFileHeader *header = (const cd::ModelFileHeader *)file.data();
+		size_t entryBytes = header->version == 3 ? sizeof(cd::ModelSectionv3) : sizeof(cd::ModelSection);
+		if (file.size() < sizeof(cd::ModelFileHeader) + entryBytes * header->sectionCount) {
+			CD_ERROR("model reader section table truncated");
+			throw std::runtime_error("model reader");
+		}
+
+		std::vector<cd::ModelSection> sections(header->sectionCount);
+		const uint8_t *table = file.data() + sizeof(cd::ModelFileHeader);
+		for (uint32_t s = 0; s < header->sectionCount; s++) {
+			cd::ModelSection &section = sections[s];
+			if (header->version == 3) {
+				const cd::ModelSectionv3 &entry = ((const cd::ModelSectionv3 *)table)[s];
+				section = { entry.type, entry.count, entry.offset, entry.bytes, cd::encoding_raw, 0 };
+			} else {
+				section = ((const cd::ModelSection *)table)[s];
+			}
+			if (section.offset % MODEL_SECTION_ALIGNMENT || file.size() < section.offset || file.size() - section.offset < section.bytes) {
+				CD_ERROR("model reader section {} (type {}) out of bounds or misaligned", s, section.type);
+				throw std::runtime_error("model reader");
+			}
+		}
+		return sections;
+	}
+
+	size_t elementBytes(uint32_t type, uint32_t boneCount) {
+		if (type == cd::section_vertices) return sizeof(cd::Vertex);
+		if (type == cd::section_indices) return sizeof(glm::uvec3);
+		if (type == cd::section_keyframes) return sizeof(cd::Keyframe);
+		if (type == cd::section_packed_vertices) return sizeof(cd::PackedVertex);
+		if (type == cd::section_vertex_bounds) return sizeof(cd::Aabb);
+		if (type == cd::section_packed_keyframes) return sizeof(double) + sizeof(glm::mat4) * boneCount;
+		if (type == cd::section_triangle_clusters) return sizeof(cd::TriangleCluster);
+		if (type == cd::section_bvh_nodes) return sizeof(cd::BvhNode);
+		if (type == cd::section_lod_indices) return sizeof(glm::uvec3);
+		if (type == cd::section_lod_bvh_nodes) return sizeof(cd::BvhNode);
+		if (type == cd::section_lods) return sizeof(cd::ModelLod);
+		if (type == cd::section_lod_sources) return sizeof(uint32_t);
+		return 0;
+	}
+
+	// elements [first, first + count) of a section, decoded by one worker
+	struct DecodeBlock {
+		const cd::ModelSection *section;
+		const uint8_t *src;
+		size_t srcBytes;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	void sectionBlocks(const uint8_t *data, const cd::ModelSection &section, size_t stride, std::vector<DecodeBlock> &blocks) {
+		uint32_t perBlock = (uint32_t)std::max<size_t>(1, MODEL_BLOCK_BYTES / stride);
+		uint32_t blockCount = (section.count + perBlock - 1) / perBlock;
+		const uint8_t *src = data + section.offset;
+		const uint8_t *end = src + section.bytes;
+
+		if (section.encoding == cd::encoding_raw) {
+			if (section.bytes != stride * section.count) {
+				CD_ERROR("model reader section (type {}) holds {} bytes for {} elements", section.type, section.bytes, section.count);
+				throw std::runtime_error("model reader");
+			}
+			for (uint32_t first = 0; first < section.count; first += perBlock) {
+				uint32_t count = std::min(perBlock, section.count - first);
+				blocks.push_back({ &section, src + stride * first, stride * count, first, count });
+			}
+		} else if (section.encoding == cd::encoding_lz) {
+			if (section.bytes < sizeof(uint32_t) * blockCount) {
+				CD_ERROR("model reader compressed section (type {}) block table truncated", section.type);
+				throw std::runtime_error("model reader");
+			}
+			const uint32_t *blockBytes = (const uint32_t *)src;
+			src += sizeof(uint32_t) * blockCount;
+			for (uint32_t b = 0; b < blockCount && src <= end; b++) {
+				uint32_t first = b * perBlock;
+				blocks.push_back({ &section, src, blockBytes[b], first, std::min(perBlock, section.count - first) });
+				src += blockBytes[b];
+			}
+			if (src != end) {
+				CD_ERROR("model reader compressed section (type {}) block sizes don't match its {} bytes", section.type, section.bytes);
+				throw std::runtime_error("model reader");
+			}
+		} else {
+			CD_ERROR("model reader unknown section encoding {}", section.encoding);
+			throw std::runtime_error("model reader");
+		}
+	}
+
+	// calls job(0 .. count - 1) on worker threads, the calling thread is one of them
+	void parallelFor(size_t count, const std::function<void(size_t)> &job) {
+		size_t threads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+		std::atomic<size_t> next{ 0 };
+		auto worker = [&]() {
+			for (size_t i = next++; i < count; i = next++)
+				job(i);
+		};
+		std::vector<std::thread> pool;
+		for (size_t t = 1; t < threads; t++)
+			pool.emplace_back(worker);
+		worker();
+		for (std::thread &thread : pool)
+			thread.join();
+	}
+
+	// the blocks of every given section (null ones skipped) decoded on worker threads, write copies out the elements of
+	// each block. returns the number of blocks
+	size_t decodeSections(const MappedFile &file, uint32_t boneCount, std::initializer_list<const cd::ModelSection *> sections,
+			const std::function<void(const DecodeBlock &block, const uint8_t *elements)> &write) {
+		std::vector<DecodeBlock> blocks;
+		for (const cd::ModelSection *section : sections) {
+			if (section)
+				sectionBlocks(file.data(), *section, elementBytes(section->type, boneCount), blocks);
+		}
+
+		std::atomic<bool> failed{ false };
+		parallelFor(blocks.size(), [&](size_t b) {
+			const DecodeBlock &block = blocks[b];
+			const uint8_t *src = block.src;
+			std::vector<uint8_t> decoded;
+			if (block.section->encoding == cd::encoding_lz) {
+				decoded.resize(elementBytes(block.section->type, boneCount) * block.count);
+				if (!cd::LzDecompress(block.src, block.srcBytes, decoded.data(), decoded.size())) {
+					failed = true;
+					return;
+				}
+				src = decoded.data();
+			}
+			write(block, src);
+		});
+		if (failed) {
+			CD_ERROR("model reader compressed block can't be decoded");
+			throw std::runtime_error("model reader");
+		}
+		return blocks.size();
+	}
+
+	// the mapped version 3 or 4 file's header, checked against the reader version
+	const cd::ModelFileHeader &fileHeader(const MappedFile &file, uint16_t version) {
+		const cd::ModelFileHeader *header = (const cd::ModelFileHeader *)file.data();
+		if (file.size() < sizeof(cd::ModelFileHeader) || header->version != version) {
+			CD_ERROR("file version number {} incompatible with reader version {}", file.size() < sizeof(uint16_t) ? 0 : header->version, version);
+			throw std::runtime_error("model reader error");
+		}
+		return *header;
+	}
+
+	uint16_t fileVersion(const std::string &filePath) {
+		if (!fileExists(filePath)) {
+			CD_ERROR("model reader file {} not found", filePath);
+			throw std::runtime_error("model reader");
+		}
+		uint16_t version = 0;
+		std::ifstream input(filePath, std::ios::binary);
+		input.read((char *)& version, sizeof(uint16_t));
+		return version;
+	}
+
+	// bounds over the key poses and the compressed animation, once the vertices are loaded
+	void loadAnimation(const cd::AnimationClip &clip, AnimatedModel &model) {
+		// full palettes are only needed to build the tracks and the bounds
+		model.bounds = cd::Aabb();
+		for (const cd::Keyframe &keyframe : clip.keyframes) {
+			for (const cd::PackedVertex &packed : model.vertices) {
+				cd::Vertex vertex = cd::UnpackVertex(packed, model.vertexBounds);
+				// as the skinning kernel: weighted bones, the remaining weight keeps the bind position
+				glm::mat4 animation(0.0f);
+				float weightRemaining = 1;
+				for (int b = 0; b < 4; b++) {
+					if (0 <= vertex.boneIndices[b] && vertex.boneIndices[b] < MAX_BONES) {
+						animation += keyframe.boneTransforms[vertex.boneIndices[b]] * vertex.boneWeights[b];
+						weightRemaining -= vertex.boneWeights[b];
+				}	}
+				animation += glm::mat4(1.0f) * glm::clamp(weightRemaining, 0.0f, 1.0f);
+				model.bounds.grow(glm::vec3(animation * vertex.position + animation[3]));
+		}	}
+		// poses between keys are interpolated so they can reach slightly outside the key poses
+		glm::vec3 margin = (model.bounds.max - model.bounds.min) * ANIMATED_BOUNDS_MARGIN;
+		model.bounds.min -= margin;
+		model.bounds.max += margin;
+
+		float maxError = cd::CompressClip(clip, model.vertices, model.animation);
+		size_t rawBytes = sizeof(cd::Keyframe) * clip.keyframes.size();
+		CD_INFO("animation: {} of {} bones animated, {} keys, {} -> {} bytes ({:.1f}x), max error {:.2e}",
+			model.animation.tracks.size(), MAX_BONES, model.animation.keys.size(), rawBytes, model.animation.Bytes(),
+			(double)rawBytes / model.animation.Bytes(), maxError);
+	}
+
+	// the bind pose, triangles and prebaked bvh of a version 1 to 4 file. bones and keyframes aren't read, so any bone
+	// count is fine, and a static file (no keyframes) is too
+	void readStaticGeometry(const std::string &filePath, uint16_t version, StaticModel &model) {
+		if (version == 1 || version == 2) {
+			std::ifstream input(filePath, std::ios::binary);
+			uint16_t version_in;
+			uint32_t num_vertices, num_triangles = 0, num_keyframes, num_bones;
+			input.read((char *)& version_in, sizeof(uint16_t));
+			input.read((char *)& num_vertices, sizeof(uint32_t));
+			if (version == 2)
+				input.read((char *)& num_triangles, sizeof(uint32_t));
+			input.read((char *)& num_keyframes, sizeof(uint32_t));
+			input.read((char *)& num_bones, sizeof(uint32_t));
+
+			std::vector<cd::Vertex> vertices(num_vertices);
+			input.read((char *)vertices.data(), sizeof(cd::Vertex) * num_vertices);
+			if (version == 1) {
+				std::vector<cd::Vertex> corners;
+				corners.swap(vertices);
+				weldVertices(corners, vertices, model.indices);
+			} else {
+				model.indices.resize(num_triangles);
+				input.read((char *)model.indices.data(), sizeof(glm::uvec3) * num_triangles);
+			}
+			if (!input) {
+				CD_ERROR("model reader file {} truncated", filePath);
+				throw std::runtime_error("model reader");
+			}
+			for (const cd::Vertex &vertex : vertices)
+				model.vertices.push_back(glm::vec4(glm::vec3(vertex.position), 1));
+			return;
+		}
+
+		MappedFile file;
+		file.open(filePath);
+		const cd::ModelFileHeader &header = fileHeader(file, version);
+		std::vector<cd::ModelSection> sections = readSections(file);
+
+		// the last section of each type is used
+		const cd::ModelSection *vertices = nullptr, *indices = nullptr, *bounds = nullptr, *bvh = nullptr;
+		for (const cd::ModelSection &section : sections) {
+			if (section.type == cd::section_vertices || section.type == cd::section_packed_vertices) vertices = &section;
+			else if (section.type == cd::section_indices) indices = &section;
+			else if (section.type == cd::section_vertex_bounds) bounds = &section;
+			else if (section.type == cd::section_bvh_nodes) bvh = &section;
+		}
+		if (!vertices || !indices || (vertices->type == cd::section_packed_vertices
+				&& (!bounds || bounds->encoding != cd::encoding_raw || bounds->bytes != sizeof(cd::Aabb)))) {
+			CD_ERROR("model reader missing section (vertices {}, indices {}, vertex bounds {})",
+				vertices != nullptr, indices != nullptr, bounds != nullptr);
+			throw std::runtime_error("model reader");
+		}
+		cd::Aabb vertexBounds;
+		if (bounds)
+			std::memcpy(&vertexBounds, file.data() + bounds->offset, sizeof(cd::Aabb));
+
+		model.vertices.resize(vertices->count);
+		model.indices.resize(indices->count);
+		model.bvh.resize(bvh ? bvh->count : 0);
+		decodeSections(file, header.boneCount, { vertices, indices, bvh }, [&](const DecodeBlock &block, const uint8_t *src) {
+			uint32_t type = block.section->type;
+			for (uint32_t e = 0; e < block.count; e++) {
+				uint32_t slot = block.first + e;
+				if (type == cd::section_packed_vertices)
+					model.vertices[slot] = glm::vec4(glm::vec3(cd::UnpackVertex(((const cd::PackedVertex *)src)[e], vertexBounds).position), 1);
+				else if (type == cd::section_vertices)
+					model.vertices[slot] = glm::vec4(glm::vec3(((const cd::Vertex *)src)[e].position), 1);
+			}
+			if (type == cd::section_indices)
+				std::memcpy(&model.indices[block.first], src, sizeof(glm::uvec3) * block.count);
+			else if (type == cd::section_bvh_nodes)
+				std::memcpy(&model.bvh[block.first], src, sizeof(cd::BvhNode) * block.count);
+		});
+	}
+}
+
 void cd::LoadModelv0(const std::string& filePath, std::vector<glm::vec4>& vertices, std::vector<glm::uvec4>& polygons) {
 	if (!fileExists(filePath)) {
 		CD_ERROR("file {} not found", filePath);
@@ -40,6 +479,8 @@ void cd::LoadModelv0(const std::string& filePath, std::vector<glm::vec4>& vertic
 }
 
 void cd::LoadModelv1(const std::string &filePath, AnimatedModel &model) {
+	CD_ZONE("cd::LoadModelv1");
+
 	if (!fileExists(filePath)) {
 		CD_ERROR("model reader file {} not found", filePath);
 		throw std::runtime_error("model reader");
@@ -64,12 +505,296 @@ void cd::LoadModelv1(const std::string &filePath, AnimatedModel &model) {
 		throw std::runtime_error("model reader");
 	}
 
+	std::vector<cd::Vertex> corners(num_vertices), vertices;
+	std::vector<cd::Keyframe> keyframes(num_keyframes);
+	cd::AnimationClip clip;
+
+	input.read((char *)corners.data(), sizeof(cd::Vertex) * num_vertices);
+	input.read((char *)& clip.duration, sizeof(double));
+	input.read((char *)keyframes.data(), sizeof(cd::Keyframe) * num_keyframes);
+	clip.keyframes = keyframes;
+
+	weldVertices(corners, vertices, model.indexStorage);
+	model.indices = model.indexStorage;
+	packVertices(vertices, model);
+	loadAnimation(clip, model);
+}
+
+void cd::LoadModelv2(const std::string &filePath, AnimatedModel &model) {
+	CD_ZONE("cd::LoadModelv2");
+
+	if (!fileExists(filePath)) {
+		CD_ERROR("model reader file {} not found", filePath);
+		throw std::runtime_error("model reader");
+	}
+
+	std::ifstream input(filePath, std::ios::binary);
+	const int version_number = 2;
+
+	uint16_t version_in;
+	input.read((char *)& version_in, sizeof(uint16_t));
+	if (version_in != version_number) {
+		CD_ERROR("file version number {} incompatible with reader version {}", version_in, version_number);
+		throw std::runtime_error("model reader error");
+	}
+
+	uint32_t num_vertices, num_triangles, num_keyframes, num_bones;
+	input.read((char *)& num_vertices, sizeof(uint32_t));
+	input.read((char *)& num_triangles, sizeof(uint32_t));
+	input.read((char *)& num_keyframes, sizeof(uint32_t));
+	input.read((char *)& num_bones, sizeof(uint32_t));
+	if (num_bones != MAX_BONES) {
+		CD_ERROR("model reader incompatible bone count (file has MAX_BONES = {} we use MAX_BONES = {}", num_bones, MAX_BONES);
+		throw std::runtime_error("model reader");
+	}
+
+	std::vector<cd::Vertex> vertices(num_vertices);
+	model.indexStorage.clear();
+	model.indexStorage.resize(num_triangles);
+	std::vector<cd::Keyframe> keyframes(num_keyframes);
+	cd::AnimationClip clip;
+
+	input.read((char *)vertices.data(), sizeof(cd::Vertex) * num_vertices);
+	input.read((char *)model.indexStorage.data(), sizeof(glm::uvec3) * num_triangles);
+	input.read((char *)& clip.duration, sizeof(double));
+	input.read((char *)keyframes.data(), sizeof(cd::Keyframe) * num_keyframes);
+	packVertices(vertices, model);
+	model.indices = model.indexStorage;
+	clip.keyframes = keyframes;
+
+	checkIndices(model);
+	loadAnimation(clip, model);
+}
+
+void cd::MapModelv3(const std::string &filePath, AnimatedModel &model) {
+	CD_ZONE("cd::MapModelv3");
+
+	model.file.open(filePath);
+	const uint8_t *data = model.file.data();
+	size_t size = model.file.size();
+	const cd::ModelFileHeader *header = &fileHeader(model.file, 3);
+	if (header->boneCount != MAX_BONES) {
+		CD_ERROR("model reader incompatible bone count (file has MAX_BONES = {} we use MAX_BONES = {}", header->boneCount, MAX_BONES);
+		throw std::runtime_error("model reader");
+	}
+
+	// the sections are read in place, only their bounds and alignment are checked. the indices are used from the mapping,
+	// the vertices and keyframes only as the source of the packed vertices and compressed clip the upload takes
+	std::vector<cd::ModelSection> sections = readSections(model.file);
+	cd::Span<cd::Vertex> vertices;
+	cd::AnimationClip clip;
+	clip.duration = header->duration;
+	bool found[4] = { false };
+	for (uint32_t s = 0; s < header->sectionCount; s++) {
+		const cd::ModelSection &section = sections[s];
+		size_t stride = section.type <= cd::section_keyframes ? elementBytes(section.type, MAX_BONES) : 0;
+		if (stride == 0) continue;
+
+		if (section.bytes != stride * section.count) {
+			CD_ERROR("model reader section {} (type {}) holds {} bytes for {} elements", s, section.type, section.bytes, section.count);
+			throw std::runtime_error("model reader");
+		}
+		const uint8_t *elements = data + section.offset;
+		if (section.type == cd::section_vertices)
+			vertices = cd::Span<cd::Vertex>((const cd::Vertex *)elements, section.count);
+		else if (section.type == cd::section_indices)
+			model.indices = cd::Span<glm::uvec3>((const glm::uvec3 *)elements, section.count);
+		else
+			clip.keyframes = cd::Span<cd::Keyframe>((const cd::Keyframe *)elements, section.count);
+		found[section.type] = true;
+	}
+	if (!found[cd::section_vertices] || !found[cd::section_indices] || !found[cd::section_keyframes]) {
+		CD_ERROR("model reader missing section (vertices {}, indices {}, keyframes {})",
+			found[cd::section_vertices], found[cd::section_indices], found[cd::section_keyframes]);
+		throw std::runtime_error("model reader");
+	}
+
+	packVertices(vertices, model);
+	checkIndices(model);
+	loadAnimation(clip, model);
+	CD_INFO("model mapped: {} bytes, {} vertices, {} triangles, {} keyframes", size, model.vertices.size(),
+		model.indices.size(), clip.keyframes.size());
+}
+
+void cd::LoadModelv4(const std::string &filePath, AnimatedModel &model) {
+	CD_ZONE("cd::LoadModelv4");
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// only read while decoding, the model keeps decoded copies
+	MappedFile file;
+	file.open(filePath);
+	const cd::ModelFileHeader *header = &fileHeader(file, 4);
+	if (MAX_BONES < header->boneCount) {
+		CD_ERROR("model reader bone count {} above MAX_BONES ({})", header->boneCount, MAX_BONES);
+		throw std::runtime_error("model reader");
+	}
+	std::vector<cd::ModelSection> sections = readSections(file);
+
+	// the last section of each type is used
+	const cd::ModelSection *vertices = nullptr, *indices = nullptr, *keyframes = nullptr, *bounds = nullptr, *clusters = nullptr;
+	const cd::ModelSection *bvh = nullptr, *lodIndices = nullptr, *lodSources = nullptr, *lodBvh = nullptr, *lods = nullptr;
+	for (const cd::ModelSection &section : sections) {
+		if (section.type == cd::section_vertices || section.type == cd::section_packed_vertices) vertices = &section;
+		else if (section.type == cd::section_indices) indices = &section;
+		else if (section.type == cd::section_keyframes || section.type == cd::section_packed_keyframes) keyframes = &section;
+		else if (section.type == cd::section_vertex_bounds) bounds = &section;
+		else if (section.type == cd::section_triangle_clusters) clusters = &section;
+		else if (section.type == cd::section_bvh_nodes) bvh = &section;
+		else if (section.type == cd::section_lod_indices) lodIndices = &section;
+		else if (section.type == cd::section_lod_bvh_nodes) lodBvh = &section;
+		else if (section.type == cd::section_lods) lods = &section;
+		else if (section.type == cd::section_lod_sources) lodSources = &section;
+	}
+	if (!vertices || !indices || !keyframes || (vertices->type == cd::section_packed_vertices
+			&& (!bounds || bounds->encoding != cd::encoding_raw || bounds->bytes != sizeof(cd::Aabb)))) {
+		CD_ERROR("model reader missing section (vertices {}, indices {}, keyframes {}, vertex bounds {})",
+			vertices != nullptr, indices != nullptr, keyframes != nullptr, bounds != nullptr);
+		throw std::runtime_error("model reader");
+	}
+	if (bounds)
+		std::memcpy(&model.vertexBounds, file.data() + bounds->offset, sizeof(cd::Aabb));
+
+	// packed vertices are kept as they are, full ones are packed once decoded
+	bool packed = vertices->type == cd::section_packed_vertices;
+	std::vector<cd::Vertex> fullVertices(packed ? 0 : vertices->count);
+	model.vertexStorage.clear();
+	model.vertexStorage.resize(packed ? vertices->count : 0);
+	model.indexStorage.clear();
+	model.indexStorage.resize(indices->count);
+	model.clusterStorage.clear();
+	model.clusterStorage.resize(clusters ? clusters->count : 0);
+	model.bvhStorage.clear();
+	model.bvhStorage.resize(bvh ? bvh->count : 0);
+	model.lodIndexStorage.clear();
+	model.lodIndexStorage.resize(lodIndices ? lodIndices->count : 0);
+	model.lodSourceStorage.clear();
+	model.lodSourceStorage.resize(lodSources ? lodSources->count : 0);
+	model.lodBvhStorage.clear();
+	model.lodBvhStorage.resize(lodBvh ? lodBvh->count : 0);
+	std::vector<cd::ModelLod> levels(lods ? lods->count : 0);
+	std::vector<cd::Keyframe> keyframeStorage(keyframes->count); // bones past the file's are identity
+
+	// every block writes its own elements
+	size_t blockCount = decodeSections(file, header->boneCount, { vertices, indices, keyframes, clusters, bvh, lodIndices, lodSources, lodBvh, lods },
+			[&](const DecodeBlock &block, const uint8_t *src) {
+		uint32_t type = block.section->type;
+		size_t stride = elementBytes(type, header->boneCount);
+		if (type == cd::section_packed_vertices) {
+			std::memcpy(&model.vertexStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_vertices) {
+			std::memcpy(&fullVertices[block.first], src, stride * block.count);
+		} else if (type == cd::section_indices) {
+			std::memcpy(&model.indexStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_triangle_clusters) {
+			std::memcpy(&model.clusterStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_bvh_nodes) {
+			std::memcpy(&model.bvhStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_lod_indices) {
+			std::memcpy(&model.lodIndexStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_lod_sources) {
+			std::memcpy(&model.lodSourceStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_lod_bvh_nodes) {
+			std::memcpy(&model.lodBvhStorage[block.first], src, stride * block.count);
+		} else if (type == cd::section_lods) {
+			std::memcpy(&levels[block.first], src, stride * block.count);
+		} else if (type == cd::section_packed_keyframes) {
+			for (uint32_t k = 0; k < block.count; k++, src += stride) {
+				cd::Keyframe &keyframe = keyframeStorage[block.first + k];
+				std::memcpy(&keyframe.time, src, sizeof(double));
+				std::memcpy(keyframe.boneTransforms.data(), src + sizeof(double), sizeof(glm::mat4) * header->boneCount);
+			}
+		} else {
+			std::memcpy(&keyframeStorage[block.first], src, stride * block.count);
+		}
+	});
+
+	if (packed)
+		model.vertices = model.vertexStorage;
+	else
+		packVertices(fullVertices, model);
+	model.indices = model.indexStorage;
+	model.clusters = model.clusterStorage;
+	model.bvh = model.bvhStorage;
+	cd::AnimationClip clip;
+	clip.duration = header->duration;
+	clip.keyframes = keyframeStorage;
+
+	CD_INFO("model decoded: {} bytes, {} blocks, {} bones, {:.2f} ms", file.size(), blockCount, header->boneCount,
+		std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+
+	checkIndices(model);
+	checkClusters(model);
+	checkBvh(model);
+	loadLods(model, levels);
+	loadAnimation(clip, model);
+}
+
+void cd::LoadModel(const std::string &filePath, AnimatedModel &model) {
+	uint16_t version = fileVersion(filePath);
+
+	if (version == 1) {
+		cd::LoadModelv1(filePath, model);
+	} else if (version == 2) {
+		cd::LoadModelv2(filePath, model);
+	} else if (version == 3) {
+		cd::MapModelv3(filePath, model);
+	} else if (version == 4) {
+		cd::LoadModelv4(filePath, model);
+	} else {
+		CD_ERROR("model reader unknown file version {}", version);
+		throw std::runtime_error("model reader");
+	}
+}
+
+void cd::LoadStaticModel(const std::string &filePath, StaticModel &model) {
+	CD_ZONE("cd::LoadStaticModel");
 	model.vertices.clear();
-	model.vertices.resize(num_vertices);
-	model.animation.keyframes.clear();
-	model.animation.keyframes.resize(num_keyframes);
-
-	input.read((char *)model.vertices.data(), sizeof(cd::Vertex) * num_vertices);
-	input.read((char *)& model.animation.duration, sizeof(double));
-	input.read((char *)model.animation.keyframes.data(), sizeof(cd::Keyframe) * num_keyframes);
-}
\ No newline at end of file
+	model.indices.clear();
+	model.bvh.clear();
+
+	uint16_t version = fileVersion(filePath);
+	if (version == 0) {
+		std::vector<glm::uvec4> polygons;
+		cd::LoadModelv0(filePath, model.vertices, polygons);
+		for (const glm::uvec4 &polygon : polygons)
+			model.indices.push_back(glm::uvec3(polygon));
+	} else if (1 <= version && version <= 4) {
+		readStaticGeometry(filePath, version, model);
+	} else {
+		CD_ERROR("model reader unknown file version {}", version);
+		throw std::runtime_error("model reader");
+	}
+
+	if (model.indices.empty()) {
+		CD_ERROR("model reader static model {} has no triangles", filePath);
+		throw std::runtime_error("model reader");
+	}
+	model.bounds = cd::Aabb();
+	for (const glm::vec4 &vertex : model.vertices)
+		model.bounds.grow(glm::vec3(vertex));
+	std::vector<cd::Aabb> triangles(model.indices.size());
+	for (size_t t = 0; t < triangles.size(); t++) {
+		const glm::uvec3 &triangle = model.indices[t];
+		if (model.vertices.size() <= glm::max(triangle.x, glm::max(triangle.y, triangle.z))) {
+			CD_ERROR("model reader triangle index out of range ({} vertices)", model.vertices.size());
+			throw std::runtime_error("model reader");
+		}
+		for (int corner = 0; corner < 3; corner++)
+			triangles[t].grow(glm::vec3(model.vertices[triangle[corner]]));
+	}
+
+	// without a valid prebaked bvh the triangles are put in the built bvh's leaf order
+	if (!model.bvh.empty() && !validBvh(model.bvh, model.indices.size())) {
+		CD_WARN("model reader bvh isn't a tree over the triangles at most {} deep, ignoring it", BVH_MAX_DEPTH);
+		model.bvh.clear();
+	}
+	if (model.bvh.empty()) {
+		std::vector<uint32_t> order;
+		cd::BuildBvh(triangles, model.bvh, order);
+		std::vector<glm::uvec3> sorted(order.size());
+		for (size_t slot = 0; slot < order.size(); slot++)
+			sorted[slot] = model.indices[order[slot]];
+		model.indices.swap(sorted);
+	}
+	CD_INFO("static model loaded: {} vertices, {} triangles, {} bvh nodes", model.vertices.size(), model.indices.size(), model.bvh.size());
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "AnimatedModel.hpp"
+#include "StaticModel.hpp"
 
 #include <glm/glm.hpp>
 #include <vector>
@@ -8,5 +9,14 @@
 
 namespace cd {
 	void LoadModelv0(const std::string &filePath, std::vector<glm::vec4> &vertices, std::vector<glm::uvec4> &polygons);
-	void LoadModelv1(const std::string &filePath, AnimatedModel &model);
+	void LoadModelv1(const std::string &filePath, AnimatedModel &model); // de-indexed, welded on load
+	void LoadModelv2(const std::string &filePath, AnimatedModel &model); // indexed
+	// sectioned (ModelFile.hpp), read in place from a mapped file. the indices stay in the mapping, the vertices are
+	// packed and the keyframes compressed from it
+	void MapModelv3(const std::string &filePath, AnimatedModel &model);
+	void LoadModelv4(const std::string &filePath, AnimatedModel &model); // packed and compressed sections, decoded on worker threads
+	void LoadModel(const std::string &filePath, AnimatedModel &model); // any of the above by the file's version
+	// the bind pose of any version, only its geometry sections are read (so a static file of the converter's --static
+	// export loads too), with the file's bvh or one built on load
+	void LoadStaticModel(const std::string &filePath, StaticModel &model);
 }
\ No newline at end of file
@@ -10,6 +10,10 @@ namespace cd {
 		Sphere(cl_float radius, cl_float3 position, cl_uint4 color)
 			: radius(radius), position(position), color(color) {}
 
+		inline cl_float getRadius() const { return radius; }
+		inline cl_float3 getPosition() const { return position; }
+		inline cl_uint4 getColor() const { return color; }
+
 	private:
 		cl_float radius;
 		cl_float padding1 = 0; // not used
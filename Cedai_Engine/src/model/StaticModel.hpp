@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Bvh.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// geometry that never moves: positions only, no bones or animation, uploaded once with a bvh that is never refit
+struct StaticModel {
+	std::vector<glm::vec4> vertices; // xyz = position in model space
+	std::vector<glm::uvec3> indices; // one per triangle, into vertices, in the bvh's leaf order
+	std::vector<cd::BvhNode> bvh; // leaves index the triangles directly
+	cd::Aabb bounds;
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "Bvh.hpp"
+
 #include <glm/glm.hpp>
 #include <array>
+#include <cstdint>
 
 namespace cd {
 	struct Vertex {
@@ -17,4 +20,28 @@ namespace cd {
 			};
 		}
 	};
+
+	/*
+	vertex of the version 4 model file, of a loaded model and of the skinning kernel input (PackedVertex in skinning.cl),
+	16 bytes. the converter writes the same encoding (PackedVertex in FBX_Loader.h): weights are normalized so a skinned
+	vertex's sum to 255, the largest taking the rounding, and a vertex without bones has every weight 0 and keeps its
+	bind position.
+	*/
+	struct PackedVertex {
+		uint16_t position[4];		// fraction of the vertex bounds * 65535 (w unused)
+		uint8_t boneIndices[4];		// 255 = no bone
+		uint8_t boneWeights[4];		// * 255
+	};
+
+	// of the vertex bounds its position was quantized against, for the cpu (the kernel unpacks its own)
+	inline Vertex UnpackVertex(const PackedVertex &packed, const Aabb &bounds) {
+		Vertex vertex;
+		glm::vec3 scale = (bounds.max - bounds.min) * (1.0f / 65535.0f);
+		vertex.position = glm::vec4(bounds.min + glm::vec3(packed.position[0], packed.position[1], packed.position[2]) * scale, 0);
+		for (int b = 0; b < 4; b++) {
+			vertex.boneIndices[b] = packed.boneIndices[b] == 255 ? -1 : packed.boneIndices[b];
+			vertex.boneWeights[b] = packed.boneWeights[b] * (1.0f / 255.0f);
+		}
+		return vertex;
+	}
 }
@@ -0,0 +1,93 @@
+#include "Benchmark.hpp"
+
+#include "tools/Log.hpp"
+#include "render_math.h"
+
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+using namespace cd::rm;
+
+#define BENCH_SAMPLES 4096	/* distinct inputs (cycled through so they stay in cache) */
+#define BENCH_CALLS 4000000	/* calls per routine */
+
+namespace {
+	struct Inputs {
+		std::vector<float3> origins, directions, points, centers, normals, v0, v1, v2;
+		std::vector<float> radii;
+		std::vector<uint4> colors;
+		std::vector<Packed> packed;
+	};
+
+	Inputs makeInputs() {
+		// fixed seed so runs are comparable
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> pos(-5.0f, 5.0f);
+		std::uniform_real_distribution<float> rad(0.1f, 2.0f);
+		std::uniform_int_distribution<uint32_t> channel(0, 255);
+		auto randomVec = [&]() { return float3(pos(rng), pos(rng), pos(rng)); };
+
+		Inputs in;
+		for (int i = 0; i < BENCH_SAMPLES; i++) {
+			in.origins.push_back(randomVec());
+			in.directions.push_back(fast_normalize(randomVec()));
+			in.points.push_back(randomVec());
+			in.centers.push_back(randomVec());
+			in.normals.push_back(randomVec());
+			in.v0.push_back(randomVec());
+			in.v1.push_back(randomVec());
+			in.v2.push_back(randomVec());
+			in.radii.push_back(rad(rng));
+			in.colors.push_back(uint4(channel(rng), channel(rng), channel(rng), channel(rng)));
+			in.packed.push_back(pack(in.colors.back()));
+		}
+		return in;
+	}
+
+	// runs routine(i) BENCH_CALLS times and logs calls per second. the results are summed into
+	// a volatile sink so the compiler can't discard the calls
+	template <typename Routine>
+	void run(const char *name, Routine routine) {
+		volatile float sink = 0;
+		float sum = 0;
+
+		time_point<high_resolution_clock> start = high_resolution_clock::now();
+		for (int c = 0; c < BENCH_CALLS; c++)
+			sum += routine(c % BENCH_SAMPLES);
+		double seconds = duration<double, std::chrono::seconds::period>(high_resolution_clock::now() - start).count();
+		sink = sum;
+		(void)sink;
+
+		CD_INFO("  {:<20} {:>8.2f} M calls/s {:>7.2f} ns/call", name, BENCH_CALLS / seconds * 1e-6, seconds / BENCH_CALLS * 1e9);
+	}
+}
+
+void cd::benchmarkRenderMath() {
+	CD_INFO("benchmarking render_math.h routines ({} calls each)...", BENCH_CALLS);
+	Inputs in = makeInputs();
+
+	run("sphere_intersect", [&](int i) {
+		return sphere_intersect(in.origins[i], in.directions[i], in.centers[i], in.radii[i]); });
+
+	run("triangle_intersect", [&](int i) {
+		return triangle_intersect(in.origins[i], in.directions[i], in.v0[i], in.v1[i], in.v2[i]); });
+
+	run("diffuse_sphere", [&](int i) {
+		return diffuse_sphere(in.normals[i], in.points[i], in.centers[i]); });
+
+	run("diffuse_polygon", [&](int i) {
+		return diffuse_polygon(in.normals[i], in.points[i], in.centers[i], in.directions[i]); });
+
+	run("ceiling", [&](int i) {
+		return ceiling(in.radii[i], 0.2f); });
+
+	run("pack", [&](int i) {
+		return (float)pack(in.colors[i]); });
+
+	run("unpack", [&](int i) {
+		return (float)unpack(in.packed[i]).x; });
+
+	CD_INFO("benchmark finished.");
+}
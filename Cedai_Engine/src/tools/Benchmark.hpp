@@ -0,0 +1,6 @@
+#pragma once
+
+namespace cd {
+	// times each routine in render_math.h on the cpu and logs the throughput
+	void benchmarkRenderMath();
+}
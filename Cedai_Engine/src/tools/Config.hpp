@@ -5,12 +5,59 @@
 #define WINDOW_TITLE "Cedai"
 #define INIT_SCREEN_WIDTH 960
 #define INIT_SCREEN_HEIGHT 640
+#define FRAMES_IN_FLIGHT 2 /* frames the cpu and gpu work on at once, 1 = serial (presentation lags FRAMES_IN_FLIGHT - 1 frames) */
+#define BONE_PALETTE_FRAMES 3 /* bone palette slots, at least FRAMES_IN_FLIGHT */
 
 #define PRINT_FPS
 //#define HALF_RESOLUTION
 //#define RESIZABLE
+//#define BENCHMARK_RENDER_MATH /* time the kernel intersection/lighting routines on the cpu at startup */
+//#define GOLDEN_TEST /* compare renders of fixed views against the cpu reference renderer then exit */
+//#define PROFILE_GPU /* time each gpu command and show stage averages in the log and window title */
+//#define TRACE_FRAMES /* write a chrome trace of cpu zones and gpu stages (see TRACING) */
+//#define KERNEL_COUNTERS /* render kernel counts intersection tests per pixel, H toggles the cost heatmap */
+//#define POSE_CACHE /* skin each animation pose once and reuse it (see POSE CACHE) */
 
 
+	/* GOLDEN TEST THRESHOLDS */
+
+#define GOLDEN_PIXEL_TOLERANCE 8	/* max channel difference before a pixel counts as bad */
+#define GOLDEN_MAX_BAD_PIXELS 0.002	/* fraction of bad pixels allowed (shadow and silhouette edges) */
+#define GOLDEN_MIN_PSNR 35.0		/* dB */
+#define GOLDEN_OUTPUT_DIR "golden/"
+
+
+	/* PROFILING */
+
+#define PROFILE_WINDOW 64		/* samples in each rolling average */
+#define PROFILE_EVENT_RING 4	/* frames of opencl events kept before they must be resolved */
+#define PROFILE_FRAME_RING 8	/* frames kept for the per frame timeline */
+#define GL_TIMER_LATENCY 2		/* frames before gl timer queries are read back */
+#define HEATMAP_MAX_COST 600	/* tests per pixel drawn red, white above */
+
+
+	/* TRACING */
+
+#define TRACE_FIRST_FRAME 0		/* 0 includes startup (model loading) */
+#define TRACE_FRAME_COUNT 120
+#define TRACE_BUFFER_EVENTS 16384	/* per thread */
+#define TRACE_OUTPUT_FILE "cedai_trace.json"
+
+#if defined(TRACE_FRAMES) && !defined(PROFILE_GPU)
+#	define PROFILE_GPU /* gpu stages in the trace come from the profiler */
+#endif
+
+
+	/* POSE CACHE */
+
+#define POSE_CACHE_RATE 60					/* cached poses per second of animation, the player time snaps to the nearest */
+#define POSE_CACHE_BUDGET (8 * 1024 * 1024)	/* bytes of skinned vertices, poses beyond it are evicted least recently used first */
+
+	/* LEVEL OF DETAIL */
+
+#define LOD_PIXEL_ERROR 1.0f	/* largest projected simplification error, in pixels, of the level an instance traces */
+#define LOD_SHADOW_BIAS 1		/* levels coarser than the camera's traced by shadow rays, 0 = the same level */
+
 	/* CONSTANTS */
 
 #define CL_USE_DEPRECATED_OPENCL_1_2_APIS
@@ -18,5 +65,6 @@
 
 #define CD_PI 3.14159f
 
-#define BONES_GL 16 /* also defined in primitive.vert */
-#define MAX_BONES 50 /* also defined in AnimatedModel.h in the model converter */
\ No newline at end of file
+#define MAX_BONES 50 /* also defined in AnimatedModel.h in the model converter */
+#define MAX_ANIMATED_MODELS 16 /* animation players, each needs a bone palette pose and a skinned mesh per frame */
+#define MAX_INSTANCES 64 /* model placements in the top level bvh */
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "GLTimer.hpp"
+
+#include "Interface.hpp"
+
+void GLTimer::init() {
+#	ifdef PROFILE_GPU
+	for (FrameQueries &queries : frames) {
+		glGenQueries(cd::stage_count, queries.timestamp);
+		glGenQueries(cd::stage_count, queries.elapsed);
+	}
+	calibrate();
+	cd::checkErrorsGL("gl timer init");
+#	endif
+}
+
+void GLTimer::begin([[maybe_unused]] cd::ProfileStage stage, [[maybe_unused]] uint64_t frame) {
+#	ifdef PROFILE_GPU
+	FrameQueries &queries = frames[current];
+	glQueryCounter(queries.timestamp[stage], GL_TIMESTAMP);
+	glBeginQuery(GL_TIME_ELAPSED, queries.elapsed[stage]);
+	queries.used |= 1 << stage;
+	queries.frame[stage] = frame;
+#	endif
+}
+
+void GLTimer::end([[maybe_unused]] cd::ProfileStage stage) {
+#	ifdef PROFILE_GPU
+	glEndQuery(GL_TIME_ELAPSED);
+#	endif
+}
+
+void GLTimer::nextFrame() {
+#	ifdef PROFILE_GPU
+	current = (current + 1) % (GL_TIMER_LATENCY + 1);
+
+	// the oldest set of queries is reused this frame so read it back now
+	calibrate();
+	collect(frames[current]);
+#	endif
+}
+
+void GLTimer::cleanUp() {
+#	ifdef PROFILE_GPU
+	for (FrameQueries &queries : frames) {
+		glDeleteQueries(cd::stage_count, queries.timestamp);
+		glDeleteQueries(cd::stage_count, queries.elapsed);
+	}
+#	endif
+}
+
+// PRIVATE FUNCTIONS
+
+void GLTimer::calibrate() {
+	// GL_TIMESTAMP from glGet is the gl time once previous commands reach the server (doesn't wait for them to execute)
+	GLint64 glTime;
+	glGetInteger64v(GL_TIMESTAMP, &glTime);
+	hostOffset = (int64_t)Profiler::HostTime() - glTime;
+}
+
+void GLTimer::collect(FrameQueries &queries) {
+	for (int s = 0; s < cd::stage_count; s++) {
+		if (!(queries.used & (1 << s))) continue;
+
+		// skip the sample rather than wait if the gpu is running more than GL_TIMER_LATENCY frames behind
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(queries.elapsed[s], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+
+		GLuint64 start, elapsed;
+		glGetQueryObjectui64v(queries.timestamp[s], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(queries.elapsed[s], GL_QUERY_RESULT, &elapsed);
+
+		uint64_t hostStart = start + hostOffset;
+		Profiler::Record((cd::ProfileStage)s, queries.frame[s], hostStart, hostStart, hostStart, hostStart + elapsed);
+	}
+	queries.used = 0;
+}
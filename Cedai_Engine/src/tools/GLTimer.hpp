@@ -0,0 +1,38 @@
+#pragma once
+
+#include "tools/Config.hpp"
+#include "tools/Profiler.hpp"
+
+#include <GL/gl3w.h>
+#include <cstdint>
+
+/*
+Times opengl stages with GL_TIMESTAMP (start) and GL_TIME_ELAPSED (duration) queries. Results are read
+GL_TIMER_LATENCY frames later, when the gpu has already finished them, so reading never stalls. Timestamps
+are converted to the host clock and passed to the Profiler. Does nothing unless PROFILE_GPU is defined.
+*/
+class GLTimer {
+public:
+	void init();
+
+	void begin(cd::ProfileStage stage, uint64_t frame = Profiler::Frame()); // frame the work belongs to
+	void end(cd::ProfileStage stage);
+	void nextFrame(); // call once per frame after the last end()
+
+	void cleanUp();
+
+private:
+	struct FrameQueries {
+		GLuint timestamp[cd::stage_count];
+		GLuint elapsed[cd::stage_count];
+		uint32_t used = 0; // bit per stage
+		uint64_t frame[cd::stage_count];
+	};
+
+	FrameQueries frames[GL_TIMER_LATENCY + 1];
+	uint32_t current = 0;
+	int64_t hostOffset = 0; // host clock - gl clock (ns)
+
+	void calibrate();
+	void collect(FrameQueries &queries);
+};
@@ -0,0 +1,77 @@
+#include "GoldenTest.hpp"
+
+#include "tools/Config.hpp"
+#include "tools/Log.hpp"
+
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cmath>
+
+std::vector<cd::GoldenCase> cd::goldenCases() {
+	return {
+		//  name			position				target				up					time	animation
+		{ "origin",			glm::vec3(0, 0, 0),		glm::vec3(1, 0, 0),	glm::vec3(0, 0, 1),	0.0f,	0.0f },
+		{ "side",			glm::vec3(0, -12, 0),	glm::vec3(0, 0, 0),	glm::vec3(0, 0, 1),	1.5f,	0.42f },
+		{ "above",			glm::vec3(0, 0, 14),	glm::vec3(0, 0, 0),	glm::vec3(1, 0, 0),	3.0f,	0.83f },
+		{ "behind_lit",		glm::vec3(-14, 3, 2),	glm::vec3(2, 0, 0),	glm::vec3(0, 0, 1),	4.2f,	1.25f },
+		{ "spheres",		glm::vec3(-3, -2, 0),	glm::vec3(3, 2, -3),glm::vec3(0, 0, 1),	6.0f,	0.23f },
+	};
+}
+
+bool cd::checkGolden(const std::string &name, const std::vector<glm::u8vec4> &image, const std::vector<glm::u8vec4> &reference,
+		int width, int height) {
+	int badPixels = 0;
+	int maxError = 0;
+	double squaredError = 0;
+	std::vector<glm::u8vec4> diff(width * height);
+
+	for (int p = 0; p < width * height; p++) {
+		int pixelError = 0;
+		for (int c = 0; c < 3; c++) {
+			int error = std::abs((int)image[p][c] - (int)reference[p][c]);
+			squaredError += error * error;
+			pixelError = std::max(pixelError, error);
+		}
+		maxError = std::max(maxError, pixelError);
+		if (pixelError > GOLDEN_PIXEL_TOLERANCE)
+			badPixels++;
+
+		// amplify small differences, mark bad pixels red
+		uint8_t shade = (uint8_t)std::min(255, pixelError * 16);
+		diff[p] = pixelError > GOLDEN_PIXEL_TOLERANCE ? glm::u8vec4(255, 0, 0, 255) : glm::u8vec4(shade, shade, shade, 255);
+	}
+
+	double mse = squaredError / (width * height * 3.0);
+	double psnr = mse == 0 ? INFINITY : 10 * std::log10(255.0 * 255.0 / mse);
+	double badFraction = (double)badPixels / (width * height);
+	bool pass = badFraction <= GOLDEN_MAX_BAD_PIXELS && psnr >= GOLDEN_MIN_PSNR;
+
+	if (pass) {
+		CD_INFO("golden test '{}' passed: psnr = {:.2f} dB, bad pixels = {} ({:.4f}%), max error = {}",
+			name, psnr, badPixels, badFraction * 100, maxError);
+	} else {
+		CD_WARN("golden test '{}' FAILED: psnr = {:.2f} dB (min {}), bad pixels = {} ({:.4f}%, max {:.4f}%), max error = {}",
+			name, psnr, GOLDEN_MIN_PSNR, badPixels, badFraction * 100, GOLDEN_MAX_BAD_PIXELS * 100, maxError);
+
+		std::filesystem::create_directories(GOLDEN_OUTPUT_DIR);
+		std::string prefix = std::string(GOLDEN_OUTPUT_DIR) + name;
+		writePPM(prefix + "_cl.ppm", image, width, height);
+		writePPM(prefix + "_ref.ppm", reference, width, height);
+		writePPM(prefix + "_diff.ppm", diff, width, height);
+		CD_WARN("diff images written to {}_*.ppm", prefix);
+	}
+	return pass;
+}
+
+void cd::writePPM(const std::string &filePath, const std::vector<glm::u8vec4> &image, int width, int height) {
+	std::ofstream output(filePath, std::ios::binary);
+	if (!output.is_open()) {
+		CD_ERROR("unable to write image: " + filePath);
+		return;
+	}
+
+	output << "P6\n" << width << " " << height << "\n255\n";
+	for (const glm::u8vec4 &pixel : image)
+		output.write((const char *)&pixel, 3);
+}
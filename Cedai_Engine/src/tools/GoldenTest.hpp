@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <string>
+
+namespace cd {
+	// a fixed camera pose, time and animation pose to render
+	struct GoldenCase {
+		std::string name;
+		glm::vec3 position;
+		glm::vec3 target;
+		glm::vec3 up;
+		float time;
+		float animationTime; // seconds into the clip
+	};
+
+	std::vector<GoldenCase> goldenCases();
+
+	/*
+	compares the opencl render against the cpu reference. passes when no more than GOLDEN_MAX_BAD_PIXELS
+	of the pixels differ by more than GOLDEN_PIXEL_TOLERANCE in any channel and the psnr is at least GOLDEN_MIN_PSNR.
+	on failure both images and an amplified difference image are written to GOLDEN_OUTPUT_DIR.
+	*/
+	bool checkGolden(const std::string &name, const std::vector<glm::u8vec4> &image, const std::vector<glm::u8vec4> &reference,
+		int width, int height);
+
+	void writePPM(const std::string &filePath, const std::vector<glm::u8vec4> &image, int width, int height);
+}
@@ -14,5 +14,6 @@ enum CD_INPUTS {
 	MOUSEL		= (1 << 9),
 	MOUSER		= (1 << 10),
 	INTERACTL	= (1 << 11),
-	INTERACTR	= (1 << 12)
+	INTERACTR	= (1 << 12),
+	HEATMAP		= (1 << 13)
 };
\ No newline at end of file
@@ -0,0 +1,75 @@
+#include "MappedFile.hpp"
+
+#include "tools/Log.hpp"
+
+#ifdef CD_PLATFORM_WINDOWS
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#include <stdexcept>
+
+// PUBLIC FUNCTIONS
+
+void MappedFile::open(const std::string &filePath) {
+	close();
+
+#	ifdef CD_PLATFORM_WINDOWS
+	file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	LARGE_INTEGER fileSize;
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CD_ERROR("mapped file {} can't be opened", filePath);
+		if (file == INVALID_HANDLE_VALUE) file = nullptr;
+		close();
+		throw std::runtime_error("mapped file");
+	}
+	bytes = (size_t)fileSize.QuadPart;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		mapped = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!mapped) {
+		CD_ERROR("mapped file {} map error: {}", filePath, GetLastError());
+		close();
+		throw std::runtime_error("mapped file");
+	}
+#	else
+	int descriptor = ::open(filePath.c_str(), O_RDONLY);
+	struct stat status;
+	if (descriptor < 0 || fstat(descriptor, &status) != 0 || status.st_size == 0) {
+		CD_ERROR("mapped file {} can't be opened", filePath);
+		if (0 <= descriptor) ::close(descriptor);
+		throw std::runtime_error("mapped file");
+	}
+	bytes = (size_t)status.st_size;
+	void *address = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	::close(descriptor); // the mapping keeps its own reference to the file
+	if (address == MAP_FAILED) {
+		CD_ERROR("mapped file {} mmap error", filePath);
+		bytes = 0;
+		throw std::runtime_error("mapped file");
+	}
+	mapped = (const uint8_t *)address;
+	// every section is read during loading, start reading ahead now
+	madvise(address, bytes, MADV_WILLNEED);
+#	endif
+}
+
+void MappedFile::close() {
+#	ifdef CD_PLATFORM_WINDOWS
+	if (mapped) UnmapViewOfFile(mapped);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#	else
+	if (mapped) munmap((void *)mapped, bytes);
+#	endif
+	mapped = nullptr;
+	bytes = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/*
+A whole file mapped read only into the address space. Pages are read from disk on first access and belong to the
+page cache, so data used straight from the mapping is never copied into (or zero filled in) process memory first.
+*/
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	~MappedFile() { close(); }
+
+	void open(const std::string &filePath); // throws when the file can't be mapped
+	void close();
+
+	inline bool isOpen() const { return mapped != nullptr; }
+	inline const uint8_t *data() const { return mapped; }
+	inline size_t size() const { return bytes; }
+
+private:
+	const uint8_t *mapped = nullptr;
+	size_t bytes = 0;
+#	ifdef CD_PLATFORM_WINDOWS
+	void *file = nullptr; // HANDLE
+	void *mapping = nullptr; // HANDLE
+#	endif
+};
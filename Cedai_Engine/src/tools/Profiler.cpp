@@ -0,0 +1,125 @@
+#include "Profiler.hpp"
+
+#include "tools/Log.hpp"
+#include "tools/Trace.hpp"
+
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+	const char *stageNames[cd::stage_count] = {
+		"skin",
+		"acquire",
+		"render",
+		"release",
+		"draw"
+	};
+}
+
+uint64_t Profiler::s_Frame = 0;
+Profiler::StageHistory Profiler::s_Stages[cd::stage_count];
+Profiler::FrameRecord Profiler::s_Frames[PROFILE_FRAME_RING];
+
+void Profiler::NextFrame() {
+	s_Frame++;
+}
+
+uint64_t Profiler::HostTime() {
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(cd::ProfileStage stage, uint64_t frame, uint64_t queued, uint64_t submit, uint64_t start, uint64_t end) {
+	Latencies sample;
+	sample.queueToSubmit = (int64_t)(submit - queued) * 1e-6;
+	sample.submitToStart = (int64_t)(start - submit) * 1e-6;
+	sample.startToEnd = (int64_t)(end - start) * 1e-6;
+
+	// replace the oldest sample in the window
+	StageHistory &history = s_Stages[stage];
+	Latencies &oldest = history.samples[history.next];
+	if (history.count == PROFILE_WINDOW) {
+		history.sum.queueToSubmit -= oldest.queueToSubmit;
+		history.sum.submitToStart -= oldest.submitToStart;
+		history.sum.startToEnd -= oldest.startToEnd;
+	} else {
+		history.count++;
+	}
+	oldest = sample;
+	history.sum.queueToSubmit += sample.queueToSubmit;
+	history.sum.submitToStart += sample.submitToStart;
+	history.sum.startToEnd += sample.startToEnd;
+	history.next = (history.next + 1) % PROFILE_WINDOW;
+
+	// add to the frame timeline
+	FrameRecord &record = s_Frames[frame % PROFILE_FRAME_RING];
+	if (record.frame != frame) {
+		record = FrameRecord();
+		record.frame = frame;
+	}
+	record.start[stage] = start;
+	record.end[stage] = end;
+	record.recorded |= 1 << stage;
+
+#	ifdef TRACE_FRAMES
+	bool gl = stage == cd::stage_draw;
+	Trace::GpuEvent(stageNames[stage], gl ? Trace::track_gl : Trace::track_cl, frame, start, end);
+#	endif
+}
+
+std::string Profiler::Summary() {
+	std::ostringstream summary;
+	summary << std::fixed << std::setprecision(2);
+	for (int s = 0; s < cd::stage_count; s++) {
+		if (s_Stages[s].count == 0) continue;
+		summary << " " << stageNames[s] << ": " << Average((cd::ProfileStage)s).startToEnd << "ms";
+	}
+	return summary.str();
+}
+
+void Profiler::LogSummary() {
+	CD_TRACE("gpu stage averages (ms)   queued->submit  submit->start  start->end");
+	for (int s = 0; s < cd::stage_count; s++) {
+		if (s_Stages[s].count == 0) continue;
+		Latencies average = Average((cd::ProfileStage)s);
+		CD_TRACE("  {:<22} {:>14.3f} {:>14.3f} {:>11.3f}", stageNames[s],
+			average.queueToSubmit, average.submitToStart, average.startToEnd);
+	}
+
+	// most recent frame with every stage recorded
+	const FrameRecord *latest = nullptr;
+	for (const FrameRecord &record : s_Frames) {
+		if (record.recorded == (1 << cd::stage_count) - 1 && (!latest || latest->frame < record.frame))
+			latest = &record;
+	}
+	if (latest)
+		LogFrame(*latest);
+}
+
+Profiler::Latencies Profiler::Average(cd::ProfileStage stage) {
+	const StageHistory &history = s_Stages[stage];
+	Latencies average;
+	if (history.count == 0) return average;
+	average.queueToSubmit = history.sum.queueToSubmit / history.count;
+	average.submitToStart = history.sum.submitToStart / history.count;
+	average.startToEnd = history.sum.startToEnd / history.count;
+	return average;
+}
+
+void Profiler::LogFrame(const FrameRecord &record) {
+	uint64_t frameStart = record.start[0];
+	uint64_t frameEnd = record.end[0];
+	for (int s = 1; s < cd::stage_count; s++) {
+		frameStart = std::min(frameStart, record.start[s]);
+		frameEnd = std::max(frameEnd, record.end[s]);
+	}
+
+	// each stage as offset from the first gpu work of the frame and duration
+	CD_TRACE("frame {} gpu timeline ({:.3f}ms span):", record.frame, (frameEnd - frameStart) * 1e-6);
+	for (int s = 0; s < cd::stage_count; s++) {
+		CD_TRACE("  {:<8} +{:>8.3f}ms  {:>8.3f}ms", stageNames[s],
+			(int64_t)(record.start[s] - frameStart) * 1e-6, (int64_t)(record.end[s] - record.start[s]) * 1e-6);
+	}
+}
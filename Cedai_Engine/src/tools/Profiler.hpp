@@ -0,0 +1,67 @@
+#pragma once
+
+#include "tools/Config.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace cd {
+	// gpu work measured each frame, in submission order
+	enum ProfileStage {
+		stage_skin,		// opencl: skinning and bvh refit kernels of every mesh (PrimitiveProcessor::vertexProcess)
+		stage_acquire,	// opencl: acquire gl objects
+		stage_render,	// opencl: render kernel
+		stage_release,	// opencl: release gl objects
+		stage_draw,		// opengl: draw to window (Interface::drawRun)
+		stage_count
+	};
+}
+
+/*
+Collects gpu timings per stage and keeps rolling averages over the last PROFILE_WINDOW samples of each stage.
+Timestamps are nanoseconds on the host clock (see HostTime) so opencl and opengl work line up on one timeline.
+Latencies per command:
+	queued -> submit:	time in the host side queue (opencl only)
+	submit -> start:	time waiting on the device (opencl only)
+	start -> end:		execution time
+*/
+class Profiler {
+public:
+	static void NextFrame();
+	inline static uint64_t Frame() { return s_Frame; }
+	static uint64_t HostTime();
+
+	static void Record(cd::ProfileStage stage, uint64_t frame, uint64_t queued, uint64_t submit, uint64_t start, uint64_t end);
+
+	static std::string Summary(); // short execution time summary e.g. for the window title
+	static void LogSummary();
+
+private:
+	struct Latencies {
+		double queueToSubmit = 0;
+		double submitToStart = 0;
+		double startToEnd = 0;
+	};
+
+	struct StageHistory {
+		Latencies samples[PROFILE_WINDOW];
+		Latencies sum;
+		int count = 0;
+		int next = 0;
+	};
+
+	// every stage of one frame on the host timeline
+	struct FrameRecord {
+		uint64_t frame = 0;
+		uint64_t start[cd::stage_count] = { 0 };
+		uint64_t end[cd::stage_count] = { 0 };
+		uint32_t recorded = 0; // bit per stage
+	};
+
+	static uint64_t s_Frame;
+	static StageHistory s_Stages[cd::stage_count];
+	static FrameRecord s_Frames[PROFILE_FRAME_RING];
+
+	static Latencies Average(cd::ProfileStage stage);
+	static void LogFrame(const FrameRecord &record);
+};
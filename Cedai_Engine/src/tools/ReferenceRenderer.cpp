@@ -0,0 +1,181 @@
+#include "ReferenceRenderer.hpp"
+
+#include "render_math.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace cd::rm;
+
+namespace {
+	enum primitive_type { NONE, SPHERE, LIGHT, POLYGON };
+
+	float3 toFloat3(cl_float3 v) { return float3(v.s[0], v.s[1], v.s[2]); }
+	float4 toFloat4(cl_uint4 v) { return float4(v.s[0], v.s[1], v.s[2], v.s[3]); }
+	float4 toFloat4(cl_uchar4 v) { return float4(v.s[0], v.s[1], v.s[2], v.s[3]); }
+
+	// convert_uchar4 (round toward zero)
+	glm::u8vec4 toUchar4(float4 v) {
+		return glm::u8vec4((uint8_t)v.x, (uint8_t)v.y, (uint8_t)v.z, (uint8_t)v.w);
+	}
+
+	float3 triangleVertex(const cd::ReferenceScene &scene, int polygon, int corner) {
+		return float3(scene.vertices[polygon * 3 + corner]);
+	}
+
+	bool shadow(const cd::ReferenceScene &scene, float3 intersection, float3 light, int s_index, int p_index) {
+		float3 ray_d = fast_normalize(light - intersection);
+		float3 ray_o = intersection;
+
+		// spheres
+		for (int s = 0; s < (int)scene.spheres.size(); s++) {
+			if (s == s_index) continue;
+			float t = sphere_intersect(ray_o, ray_d, toFloat3(scene.spheres[s].getPosition()), scene.spheres[s].getRadius());
+			if (0 < t && t < 100) return true;
+		}
+
+		// polygons
+		for (int p = 0; p < (int)scene.polygonColors.size(); p++) {
+			if (p == p_index) continue;
+			float t = triangle_intersect(ray_o, ray_d, triangleVertex(scene, p, 0), triangleVertex(scene, p, 1), triangleVertex(scene, p, 2));
+			if (0 < t) return true;
+		}
+
+		return false;
+	}
+
+#	if defined(HALF_RESOLUTION) && defined(DITHER)
+	int luminance(glm::u8vec4 color) {
+		return (color.x * 3 + color.y * 4 + color.z) >> 3;
+	}
+#	endif
+
+	glm::u8vec4 backgroundColor(float3 ray_d) {
+		float3 color = glm::abs(ray_d) * BACKGROUND_MULTIPLIER + BACKGROUND_OFFSET;
+		return toUchar4(float4(color * 255.0f, 0));
+	}
+
+	void draw(std::vector<glm::u8vec4> &image, int width, glm::u8vec4 color, int2 coord, [[maybe_unused]] bool no_color_found) {
+		auto write = [&](int x, int y, glm::u8vec4 c) { image[y * width + x] = c; };
+#	ifdef HALF_RESOLUTION
+#	ifdef DITHER
+		int dither = no_color_found ? 2 : luminance(color) / 64;
+		const glm::u8vec4 black(0, 0, 0, 0);
+
+		write(coord.x * 2, coord.y * 2, color);
+		if (dither < 1) color = black;
+		write(coord.x * 2 + 1, coord.y * 2 + 1, color);
+		if (dither < 2) color = black;
+		write(coord.x * 2 + 1, coord.y * 2, color);
+		if (dither < 3) color = black;
+		write(coord.x * 2, coord.y * 2 + 1, color);
+#	else // DITHER
+		write(coord.x * 2, coord.y * 2, color);
+		write(coord.x * 2 + 1, coord.y * 2 + 1, color);
+		write(coord.x * 2 + 1, coord.y * 2, color);
+		write(coord.x * 2, coord.y * 2 + 1, color);
+#	endif // DITHER
+#	else // HALF_RESOLUTION
+		write(coord.x, coord.y, color);
+#	endif // HALF_RESOLUTION
+	}
+
+	glm::u8vec4 tracePixel(const cd::ReferenceScene &scene, const float view[4][4], float time, int2 coord, int2 dim, bool &no_color_found) {
+		const int sphere_count = scene.spheres.size();
+		const int light_count = scene.lights.size();
+		const int polygon_count = scene.polygonColors.size();
+		const float3 ray_o(view[3][0], view[3][1], view[3][2]);
+
+		// create a camera ray
+		const float3 uv((float)dim.x, (float)coord.x - (float)dim.x / 2, (float)dim.y / 2 - coord.y);
+		const float3 ray_d = fast_normalize(uv.x * float3(view[0][0], view[0][1], view[0][2]) +
+											uv.y * float3(view[1][0], view[1][1], view[1][2]) +
+											uv.z * float3(view[2][0], view[2][1], view[2][2]));
+
+		// check for intersections
+		float min_t = DROP_OFF;
+		int index = 0;
+		primitive_type primitive_found = NONE;
+
+		for (int s = 0; s < sphere_count; s++) {
+			float t = sphere_intersect(ray_o, ray_d, toFloat3(scene.spheres[s].getPosition()), scene.spheres[s].getRadius());
+			if (0 < t && t < min_t) {
+				primitive_found = SPHERE;
+				min_t = t;
+				index = s;
+		}	}
+
+		// lights (indexed after the spheres like in the kernel)
+		float3 light_offset(LIGHT_RADIUS * std::cos(LIGHT_W * time), LIGHT_RADIUS * std::sin(LIGHT_W * time), 0);
+		auto lightPosition = [&](int l) {
+			return toFloat3(scene.lights[l - sphere_count].getPosition()) + light_offset * (float)(l % 2 * 2 - 1);
+		};
+		for (int l = sphere_count; l < sphere_count + light_count; l++) {
+			float t = sphere_intersect(ray_o, ray_d, lightPosition(l), scene.lights[l - sphere_count].getRadius());
+			if (0 < t && t < min_t) {
+				primitive_found = LIGHT;
+				min_t = t;
+				index = l;
+		}	}
+
+		for (int p = 0; p < polygon_count; p++) {
+			float t = triangle_intersect(ray_o, ray_d, triangleVertex(scene, p, 0), triangleVertex(scene, p, 1), triangleVertex(scene, p, 2));
+			if (0 < t && t < min_t) {
+				primitive_found = POLYGON;
+				min_t = t;
+				index = p;
+		}	}
+
+		// shading
+		no_color_found = primitive_found == NONE;
+		if (primitive_found == NONE)
+			return backgroundColor(ray_d);
+
+		if (primitive_found == LIGHT)
+			return toUchar4(toFloat4(scene.lights[index - sphere_count].getColor()));
+
+		float3 intersection = min_t * ray_d + ray_o;
+
+		if (primitive_found == SPHERE) {
+			float light = 0;
+			float3 center = toFloat3(scene.spheres[index].getPosition());
+			for (int l = sphere_count; l < sphere_count + light_count; l++) {
+				if (!shadow(scene, intersection, lightPosition(l), index, -1))
+					light += diffuse_sphere(intersection - center, intersection, lightPosition(l));
+			}
+			light = clamp(ceiling(light, LIGHT_STEP), AMBIENT, 1.0f);
+			return toUchar4(toFloat4(scene.spheres[index].getColor()) * light);
+		}
+
+		// polygon
+		float light = AMBIENT;
+		float3 v0 = triangleVertex(scene, index, 0);
+		float3 v1 = triangleVertex(scene, index, 1);
+		float3 v2 = triangleVertex(scene, index, 2);
+		for (int l = sphere_count; l < sphere_count + light_count; l++) {
+			if (!shadow(scene, intersection, lightPosition(l), -1, index))
+				light += diffuse_polygon(cross(v1 - v0, v2 - v0), intersection, lightPosition(l), ray_d);
+		}
+		light = clamp(light, 0.0f, 1.0f);
+		return toUchar4(toFloat4(scene.polygonColors[index]) * light);
+	}
+}
+
+void cd::renderReference(const ReferenceScene &scene, const float view[4][4], float time,
+		int width, int height, std::vector<glm::u8vec4> &image) {
+	image.assign(width * height, glm::u8vec4(0));
+
+#	ifdef HALF_RESOLUTION
+	int2 dim(width / 2, height / 2);
+#	else
+	int2 dim(width, height);
+#	endif
+
+	for (int y = 0; y < dim.y; y++) {
+		for (int x = 0; x < dim.x; x++) {
+			bool no_color_found;
+			glm::u8vec4 color = tracePixel(scene, view, time, int2(x, y), dim, no_color_found);
+			draw(image, width, color, int2(x, y), no_color_found);
+		}
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "tools/Config.hpp"
+#include "model/Sphere.hpp"
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace cd {
+	// everything the render kernel reads, gathered on the host
+	struct ReferenceScene {
+		std::vector<cd::Sphere> spheres;
+		std::vector<cd::Sphere> lights;
+		std::vector<glm::vec4> vertices; // skinned, world space triangles of every instance, 3 per polygon
+		std::vector<cl_uchar4> polygonColors; // per polygon of every instance
+	};
+
+	/*
+	cpu port of the render kernel (kernel.cl) using precise maths and brute force intersection instead of the bvhs.
+	writes a width * height rgba image in the same layout as the output texture.
+	*/
+	void renderReference(const ReferenceScene &scene, const float view[4][4], float time,
+		int width, int height, std::vector<glm::u8vec4> &image);
+}
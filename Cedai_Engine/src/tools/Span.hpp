@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace cd {
+	// read only view of contiguous elements owned elsewhere (a vector or a mapped file)
+	template <typename T>
+	struct Span {
+		const T *ptr = nullptr;
+		size_t count = 0;
+
+		Span() = default;
+		Span(const T *data, size_t size) : ptr(data), count(size) {}
+		Span(const std::vector<T> &elements) : ptr(elements.data()), count(elements.size()) {}
+
+		inline const T *data() const { return ptr; }
+		inline size_t size() const { return count; }
+		inline bool empty() const { return count == 0; }
+		inline const T &operator[](size_t i) const { return ptr[i]; }
+		inline const T *begin() const { return ptr; }
+		inline const T *end() const { return ptr + count; }
+	};
+}
@@ -0,0 +1,140 @@
+#include "Trace.hpp"
+
+#include "tools/Log.hpp"
+#include "tools/Profiler.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+#	ifdef TRACE_FRAMES
+	const char *trackNames[] = { "cpu", "opengl", "opencl" }; // only the writer names tracks
+#	endif
+
+	// frames before the window wrap around to large offsets
+	bool inWindow(uint64_t frame) {
+		return frame - TRACE_FIRST_FRAME < TRACE_FRAME_COUNT;
+	}
+}
+
+std::atomic<bool> Trace::s_Active{ TRACE_FIRST_FRAME == 0 };
+bool Trace::s_Written = false;
+std::mutex Trace::s_RegistryMutex;
+std::vector<std::unique_ptr<Trace::ThreadBuffer>> Trace::s_Registry;
+thread_local Trace::ThreadBuffer *Trace::t_Buffer = nullptr;
+
+// ZONE
+
+Trace::Zone::Zone(const char *name) {
+	if (!Active()) return;
+	this->name = name;
+	frame = Profiler::Frame();
+	start = Profiler::HostTime();
+}
+
+Trace::Zone::~Zone() {
+	if (!name) return;
+	Push({ name, start, Profiler::HostTime(), (uint32_t)frame, track_cpu });
+}
+
+// PUBLIC FUNCTIONS
+
+void Trace::GpuEvent(const char *name, Track track, uint64_t frame, uint64_t start, uint64_t end) {
+	// gpu timings arrive a few frames late so they are filtered by their own frame
+	if (!inWindow(frame) || s_Written) return;
+	Push({ name, start, end, (uint32_t)frame, (uint32_t)track });
+}
+
+void Trace::EndFrame() {
+#	ifdef TRACE_FRAMES
+	uint64_t frame = Profiler::Frame();
+	s_Active.store(inWindow(frame), std::memory_order_relaxed);
+
+	// wait for the late gpu timings of the last traced frame
+	if (frame == TRACE_FIRST_FRAME + TRACE_FRAME_COUNT + GL_TIMER_LATENCY + 1)
+		Write();
+#	endif
+}
+
+void Trace::Write() {
+#	ifdef TRACE_FRAMES
+	if (s_Written) return;
+	s_Written = true;
+	s_Active.store(false, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(s_RegistryMutex);
+
+	// timestamps relative to the first event keep the numbers short
+	uint64_t base = UINT64_MAX;
+	size_t total = 0;
+	for (const auto &buffer : s_Registry) {
+		uint32_t count = buffer->count.load(std::memory_order_acquire);
+		for (uint32_t e = 0; e < count; e++)
+			base = std::min(base, buffer->events[e].start);
+		total += count;
+	}
+
+	std::ofstream file(TRACE_OUTPUT_FILE);
+	if (!file.is_open()) {
+		CD_ERROR("failed to open trace file {}", TRACE_OUTPUT_FILE);
+		return;
+	}
+
+	// cpu threads are process 0, gpu queues process 1
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":0,\"args\":{\"name\":\"cpu\"}},\n";
+	file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"gpu\"}},\n";
+	file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << track_gl << ",\"args\":{\"name\":\"" << trackNames[track_gl] << "\"}},\n";
+	file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << track_cl << ",\"args\":{\"name\":\"" << trackNames[track_cl] << "\"}}";
+
+	char line[256];
+	uint32_t dropped = 0;
+	for (const auto &buffer : s_Registry) {
+		snprintf(line, sizeof(line), ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			buffer->thread, buffer->thread);
+		file << line;
+
+		uint32_t count = buffer->count.load(std::memory_order_acquire);
+		for (uint32_t e = 0; e < count; e++) {
+			const Event &event = buffer->events[e];
+			bool cpu = event.track == track_cpu;
+			snprintf(line, sizeof(line), ",\n{\"ph\":\"X\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+				event.name, trackNames[event.track], cpu ? 0 : 1, cpu ? buffer->thread : event.track,
+				(event.start - base) * 1e-3, (int64_t)(event.end - event.start) * 1e-3, event.frame);
+			file << line;
+		}
+		dropped += buffer->dropped;
+	}
+	file << "\n]}\n";
+
+	CD_INFO("wrote {} trace events to {}", total, TRACE_OUTPUT_FILE);
+	if (dropped)
+		CD_WARN("{} trace events dropped, increase TRACE_BUFFER_EVENTS", dropped);
+#	endif
+}
+
+// PRIVATE FUNCTIONS
+
+void Trace::Push(const Event &event) {
+	ThreadBuffer &buffer = LocalBuffer();
+
+	// single writer: fill the slot then publish it
+	uint32_t count = buffer.count.load(std::memory_order_relaxed);
+	if (count == TRACE_BUFFER_EVENTS) {
+		buffer.dropped++;
+		return;
+	}
+	buffer.events[count] = event;
+	buffer.count.store(count + 1, std::memory_order_release);
+}
+
+Trace::ThreadBuffer &Trace::LocalBuffer() {
+	if (!t_Buffer) {
+		std::lock_guard<std::mutex> lock(s_RegistryMutex);
+		s_Registry.push_back(std::make_unique<ThreadBuffer>());
+		t_Buffer = s_Registry.back().get();
+		t_Buffer->thread = (uint32_t)s_Registry.size() - 1;
+	}
+	return *t_Buffer;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "tools/Config.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+Records cpu zones and gpu stages for TRACE_FRAME_COUNT frames starting at TRACE_FIRST_FRAME and writes
+them to TRACE_OUTPUT_FILE in the chrome trace event format (open with chrome://tracing or ui.perfetto.dev).
+Each thread writes to its own fixed size buffer so recording a zone takes no locks. Timestamps are on the
+Profiler host clock. With TRACE_FRAMES undefined the CD_ZONE macro compiles to nothing.
+*/
+class Trace {
+public:
+	enum Track {
+		track_cpu,
+		track_gl,
+		track_cl
+	};
+
+	// scoped cpu zone, name must be a string literal (only the pointer is kept)
+	class Zone {
+	public:
+		Zone(const char *name);
+		~Zone();
+	private:
+		const char *name = nullptr;
+		uint64_t start = 0;
+		uint64_t frame = 0;
+	};
+
+	inline static bool Active() { return s_Active.load(std::memory_order_relaxed); }
+	static void GpuEvent(const char *name, Track track, uint64_t frame, uint64_t start, uint64_t end);
+	static void EndFrame(); // call once per frame after Profiler::NextFrame
+	static void Write(); // writes the recorded events, once (called by EndFrame after the window)
+
+private:
+	struct Event {
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+		uint32_t frame;
+		uint32_t track;
+	};
+
+	// written only by its own thread, read by Write after count is published
+	struct ThreadBuffer {
+		Event events[TRACE_BUFFER_EVENTS];
+		std::atomic<uint32_t> count{ 0 };
+		uint32_t dropped = 0;
+		uint32_t thread = 0;
+	};
+
+	static std::atomic<bool> s_Active;
+	static bool s_Written;
+
+	// buffers are registered once per thread and live until exit
+	static std::mutex s_RegistryMutex;
+	static std::vector<std::unique_ptr<ThreadBuffer>> s_Registry;
+	static thread_local ThreadBuffer *t_Buffer;
+
+	static void Push(const Event &event);
+	static ThreadBuffer &LocalBuffer();
+};
+
+#ifdef TRACE_FRAMES
+#	define CD_ZONE_CONCAT_(a, b) a##b
+#	define CD_ZONE_CONCAT(a, b) CD_ZONE_CONCAT_(a, b)
+#	define CD_ZONE(name) Trace::Zone CD_ZONE_CONCAT(cd_zone_, __LINE__)(name)
+#else
+#	define CD_ZONE(name)
+#endif
@@ -1,59 +1,67 @@
 #include "AnimatedModel.h"
 
+#ifdef FBX_IMPORT
+
 #include <iostream>
+#include <cmath>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/matrix_decompose.hpp>
 
 using namespace cd;
 
 void AnimatedModel::loadFBX(std::string filePath) {
-	std::cout << "starting fbx read..." << std::endl;
+	JobLog() << "starting fbx read..." << std::endl;
+	auto start = std::chrono::steady_clock::now();
+	times = StageTimes();
 	FbxManager *sdkManager = FbxManager::Create();
 	FbxIOSettings *ios = FbxIOSettings::Create(sdkManager, IOSROOT);
 	sdkManager->SetIOSettings(ios);
 
 	FbxImporter *importer = FbxImporter::Create(sdkManager, "");
 	if (!importer->Initialize(filePath.c_str(), -1, sdkManager->GetIOSettings())) {
-		printf("Call to FbxImporter::Initialize() failed.\n");
-		printf("Error returned: %s\n\n", importer->GetStatus().GetErrorString());
+		std::string error = importer->GetStatus().GetErrorString();
 		sdkManager->Destroy();
-		exit(-1);
+		throw std::runtime_error("fbx: importer initialization failed: " + error);
 	}
 
 	FbxScene *scene = FbxScene::Create(sdkManager, "myScene");
 	importer->Import(scene);
 	importer->Destroy();
+	times.import += SecondsSince(start);
 
 	// node hierarchy
-	std::cout << "\n ~ node hierarchy:" << std::endl;
+	JobLog() << "\n ~ node hierarchy:" << std::endl;
 	FbxNode *rootNode = scene->GetRootNode();
 	if (!rootNode) {
-		printf("Error: no root node found in scene");
 		sdkManager->Destroy();
-		exit(-1);
+		throw std::runtime_error("fbx: no root node found in scene");
 	}
 
 	// model processing
 	int result = loadAnimatedModel(scene);
 	if (result != 0) {
-		std::cout << " -- animation loading error! --" << std::endl;
+		JobLog() << " -- animation loading error! --" << std::endl;
 		sdkManager->Destroy();
 		throw std::runtime_error("animated fbx model loading");
 	} else {
-		std::cout << " -- animation loading success! --" << std::endl;
+		JobLog() << " -- animation loading success! --" << std::endl;
 	}
 
 	sdkManager->Destroy();
 }
 
 int AnimatedModel::loadAnimatedModel(FbxScene *scene) {
-	std::vector<glm::uvec3> indices;
-	std::vector<Vertex> indexedVertices;
+	auto stageStart = std::chrono::steady_clock::now();
 	std::vector<VertexBones> vertexBones;
+	vertices.clear();
+	indices.clear();
+	clips.clear();
 
 	// just the first animation stack
 	FbxAnimStack *animStack = scene->GetCurrentAnimationStack();
 	FbxString animStackName = animStack->GetName();
+	AnimationClip animation;
+	animation.name = animStackName.Buffer();
 
 	// time and frames
 	FbxTime animationTime = animStack->GetLocalTimeSpan().GetDuration();
@@ -76,30 +84,34 @@ int AnimatedModel::loadAnimatedModel(FbxScene *scene) {
 
 	// get vertices
 	FbxVector4 *controlPoints = mesh->GetControlPoints();
-	std::cout << "vertex count = " << mesh->GetControlPointsCount() << std::endl;
+	JobLog() << "vertex count = " << mesh->GetControlPointsCount() << std::endl;
 	for (int i = 0; i < mesh->GetControlPointsCount(); i++) {
 		Vertex vertex;
 
 		// vertex position
 		vertex.position = glm::vec4(controlPoints[i][0], controlPoints[i][1], controlPoints[i][2], 0);
 		vertex.position = meshTransform * vertex.position;
-		indexedVertices.push_back(vertex);
+		vertices.push_back(vertex);
 	}
 
 	// get indices
-	std::cout << "polygon count = " << mesh->GetPolygonCount() << std::endl;
+	JobLog() << "polygon count = " << mesh->GetPolygonCount() << std::endl;
 	for (int i = 0; i < mesh->GetPolygonCount(); i++) {
 		// ensure the whole mesh is made of triangles
 		if (mesh->GetPolygonSize(i) != 3) return -1;
 		indices.push_back(glm::uvec3(mesh->GetPolygonVertex(i, 0), mesh->GetPolygonVertex(i, 1), mesh->GetPolygonVertex(i, 2)));
 	}
 
+	times.import += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
 	// SKELETON PROCESSING
 
 	// get bones
 	bool skeletonFound = findBones(rootNode);
 	if (!skeletonFound) throw std::runtime_error("no skeleton found");
 	if (bones.size() >= MAX_BONES) throw std::runtime_error("too many bones");
+	boneCount = bones.size();
 
 	// find for a skin mesh deformer (todo vertex cache?)
 	FbxSkin *skin = nullptr;
@@ -120,10 +132,10 @@ int AnimatedModel::loadAnimatedModel(FbxScene *scene) {
 			bindPose = poseTemp;
 	}
 	if (bindPose == nullptr)
-		std::cout << "ERROR AnimatedModel load: no bind pose found" << std::endl;
+		JobLog() << "ERROR AnimatedModel load: no bind pose found" << std::endl;
 
 	// process clusters ('clusters' of vertices for each bone)
-	vertexBones.resize(indexedVertices.size());
+	vertexBones.resize(vertices.size());
 	for (int c = 0; c < skin->GetClusterCount(); c++) {
 		FbxCluster *cluster = skin->GetCluster(c);
 
@@ -134,16 +146,16 @@ int AnimatedModel::loadAnimatedModel(FbxScene *scene) {
 		// get the bind pose matrix for this bone
 		int nodeIndex = bindPose->Find(cluster->GetLink());
 		if (nodeIndex == -1)
-			std::cout << "ERROR AnimatedModel load: bone " << boneIndex << " node not found in bind pose" << std::endl;
+			JobLog() << "ERROR AnimatedModel load: bone " << boneIndex << " node not found in bind pose" << std::endl;
 		else bones[boneIndex].bindPose = convertMatrix(bindPose->GetMatrix(nodeIndex));
 
 		// loop through the vertices affected by this cluster
-		int *indices = cluster->GetControlPointIndices();
+		int *clusterIndices = cluster->GetControlPointIndices();
 		double *weights = cluster->GetControlPointWeights();
 		for (int i = 0; i < cluster->GetControlPointIndicesCount(); i++) {
 
 			// set bone reference and weighting for affected vertex
-			vertexBones[indices[i]].boneWeights.push_back(
+			vertexBones[clusterIndices[i]].boneWeights.push_back(
 				BoneWeight{
 					boneIndex,
 					(float)weights[i]
@@ -152,38 +164,83 @@ int AnimatedModel::loadAnimatedModel(FbxScene *scene) {
 	}
 
 	// add bone data to vertices (only the top 4)
-	for (int v = 0; v < indexedVertices.size(); v++) {
+	for (int v = 0; v < vertices.size(); v++) {
 		for (int w = 0; w < vertexBones[v].boneWeights.size() && w < 4; w++) {
-			indexedVertices[v].boneIndices[w] = vertexBones[v].boneWeights[w].boneIndex;
-			indexedVertices[v].boneWeights[w] = vertexBones[v].boneWeights[w].weight;
+			vertices[v].boneIndices[w] = vertexBones[v].boneWeights[w].boneIndex;
+			vertices[v].boneWeights[w] = vertexBones[v].boneWeights[w].weight;
 		}
 	}
 
+	times.skin += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
 	// ANIMATION PROCESSING
 
-	// load keyframes
-	for (long f = 0; f < frameCount; f++) {
-		Keyframe keyframe;
+	// bind poses are inverted once instead of every frame
+	std::vector<glm::mat4> inverseBindPoses(bones.size());
+	for (int b = 0; b < bones.size(); b++)
+		inverseBindPoses[b] = glm::inverse(bones[b].bindPose);
+
+	// a bone's global is its parent's times its local only without pivots or non RSrs inheritance, so each bone is
+	// checked against EvaluateGlobalTransform on a few frames and where they differ its global is sampled instead
+	auto sameTransform = [](const glm::mat4 &a, const glm::mat4 &b) {
+		float scale = 1, difference = 0;
+		for (int c = 0; c < 4; c++) {
+			for (int r = 0; r < 4; r++) {
+				scale = std::max(scale, std::abs(b[c][r]));
+				difference = std::max(difference, std::abs(a[c][r] - b[c][r]));
+			}
+		}
+		return difference <= 1e-4f * scale;
+	};
+	std::vector<bool> sampleGlobal(bones.size());
+	const long checkFrames[] = { 0, (long)frameCount / 2, (long)frameCount - 1 };
+	int globalBones = 0;
+	for (int b = 0; b < bones.size(); b++) {
+		int parent = bones[b].parentIndex;
+		sampleGlobal[b] = parent == -1; // the skeleton root's global carries any parents outside the skeleton
+		for (long f : checkFrames) {
+			if (sampleGlobal[b]) break;
+			animationTime.SetFrame(f, FbxTime::EMode::eFrames24);
+			glm::mat4 composed = convertMatrix(bones[parent].node->EvaluateGlobalTransform(animationTime))
+				* convertMatrix(bones[b].node->EvaluateLocalTransform(animationTime));
+			sampleGlobal[b] = !sameTransform(composed, convertMatrix(bones[b].node->EvaluateGlobalTransform(animationTime)));
+		}
+		globalBones += sampleGlobal[b] && parent != -1;
+	}
+	if (globalBones > 0)
+		JobLog() << globalBones << " bones don't compose from their parents (pivots or inheritance), sampled as globals" << std::endl;
 
-		// get keyframe time
+	// the sdk's evaluator belongs to the scene and isn't thread safe, so transforms are sampled here and composed below
+	std::vector<glm::mat4> sampledTransforms(frameCount * bones.size());
+	animation.keyframes.resize(frameCount);
+	for (long f = 0; f < frameCount; f++) {
 		animationTime.SetFrame(f, FbxTime::EMode::eFrames24);
-		keyframe.time = animationTime.GetSecondDouble();
-
-		// get global transforms for each bone for this keyframe
+		animation.keyframes[f].time = animationTime.GetSecondDouble();
 		for (int b = 0; b < bones.size(); b++) {
-			glm::mat4 globalTransform = convertMatrix(bones[b].node->EvaluateGlobalTransform(animationTime));
-			keyframe.boneTransforms[b] = globalTransform * glm::inverse(bones[b].bindPose);
+			FbxNode *node = bones[b].node;
+			sampledTransforms[f * bones.size() + b] = convertMatrix(sampleGlobal[b]
+				? node->EvaluateGlobalTransform(animationTime) : node->EvaluateLocalTransform(animationTime));
 		}
-
-		animation.keyframes.push_back(keyframe);
 	}
 
-	// convert vertices array into non indexed array TODO std::move? https://stackoverflow.com/questions/3279543/what-is-the-copy-and-swap-idiom
-	for (int p = 0; p < indices.size(); p++) {
-		vertices.push_back(indexedVertices[indices[p].x]);
-		vertices.push_back(indexedVertices[indices[p].y]);
-		vertices.push_back(indexedVertices[indices[p].z]);
-	}
+	// global transforms down the bone hierarchy (loadBones adds parents before their children), frames in parallel
+	ParallelFor(frameCount, bakeThreads, [&](size_t f) {
+		Keyframe &keyframe = animation.keyframes[f];
+		const glm::mat4 *sampled = &sampledTransforms[f * bones.size()];
+		std::array<glm::mat4, MAX_BONES> global;
+		for (int b = 0; b < bones.size(); b++) {
+			int parent = bones[b].parentIndex;
+			global[b] = sampleGlobal[b] ? sampled[b] : global[parent] * sampled[b];
+			keyframe.boneTransforms[b] = global[b] * inverseBindPoses[b];
+		}
+	});
+	clips.push_back(animation);
+	times.bake += SecondsSince(stageStart);
+
+	// vertices stay one per control point, triangles reference them through indices so the engine
+	// skins each shared vertex once
+	JobLog() << "unique vertices = " << vertices.size() << ", triangles = " << indices.size() << std::endl;
 
 	return 0;
 }
@@ -194,7 +251,7 @@ void AnimatedModel::getMesh(FbxNode *pNode, FbxMesh **mesh) {
 	for (int i = 0; i < pNode->GetNodeAttributeCount(); i++) {
 		FbxNodeAttribute *pAttribute = pNode->GetNodeAttributeByIndex(i);
 		if (pAttribute->GetAttributeType() == FbxNodeAttribute::eMesh) {
-			std::cout << "mesh name = " << pAttribute->GetName() << std::endl;
+			JobLog() << "mesh name = " << pAttribute->GetName() << std::endl;
 			*mesh = FbxCast<FbxMesh>(pAttribute);
 		}
 	}
@@ -264,6 +321,8 @@ glm::mat4 AnimatedModel::convertMatrix(FbxAMatrix fbxMatrix) {
 	return glm::transpose(glm::mat4(c0, c1, c2, c3));
 }
 
+#endif
+
 /*
 stack overflow example: https://stackoverflow.com/questions/45690006/fbx-sdk-skeletal-animations
 opengl skeletal animation overview: https://www.khronos.org/opengl/wiki/Skeletal_Animation
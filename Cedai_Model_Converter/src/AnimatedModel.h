@@ -1,13 +1,22 @@
 #pragma once
 
-#include <fbxsdk.h>
+// FBX_IMPORT (premake --fbx) builds the fbx importer, needs the fbx sdk (the glb importer has no dependencies)
+#ifdef FBX_IMPORT
+#	include <fbxsdk.h>
+#endif
 #include <glm/glm.hpp>
 #include <vector>
 #include <array>
 #include <string>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
 
 #define MAX_BONES 50
-// also defined in primitive.vert and Config.hpp
+// also defined in Config.hpp
 
 namespace cd
 {
@@ -24,12 +33,15 @@ namespace cd
 	};
 
 	struct AnimationClip {
+		std::string name;
 		double duration = 0;
 		std::vector<Keyframe> keyframes;
 	};
 
 	struct Bone {
+#	ifdef FBX_IMPORT
 		FbxNode *node = nullptr;
+#	endif
 		int parentIndex = -1;
 		std::string name;
 		glm::mat4 bindPose = glm::mat4(1.0);
@@ -43,18 +55,93 @@ namespace cd
 	struct VertexBones {
 		std::vector<BoneWeight> boneWeights;
 	};
+
+	// matches cd::BvhNode in the engine's Bvh.hpp, interior nodes have count = 0 and their children at first and first + 1,
+	// leaves hold triangles [first, first + count)
+	struct BvhNode {
+		glm::vec3 min;
+		int32_t first;
+		glm::vec3 max;
+		int32_t count;
+	};
+
+	// a coarser level of the mesh, its triangles index the same vertices
+	struct MeshLod {
+		std::vector<glm::uvec3> indices;
+		std::vector<uint32_t> sources; // per triangle, the full mesh's triangle it was simplified from (its color)
+		std::vector<BvhNode> bvh; // as AnimatedModel::bvh
+		float error = 0; // largest distance from the full mesh, model units
+	};
+
+	// seconds spent in each conversion stage
+	struct StageTimes {
+		double import = 0;	// reading the file and the mesh
+		double skin = 0;	// bones and vertex weights
+		double bvh = 0;		// prebaked acceleration structure
+		double lod = 0;		// simplified levels of detail
+		double bake = 0;	// keyframes
+		double write = 0;	// binaries and their read back
+	};
+
+	inline double SecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	inline unsigned ThreadCount(unsigned threads, size_t count) {
+		if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		return (unsigned)std::max<size_t>(1, std::min<size_t>(threads, count));
+	}
+
+	// job(i) for every i below count on up to threads threads (0 = one per core)
+	inline void ParallelFor(size_t count, unsigned threads, const std::function<void(size_t)> &job) {
+		std::atomic<size_t> next{ 0 };
+		auto worker = [&]() {
+			for (size_t i = next++; i < count; i = next++)
+				job(i);
+		};
+		std::vector<std::thread> pool;
+		for (unsigned t = 1; t < ThreadCount(threads, count); t++)
+			pool.emplace_back(worker);
+		worker();
+		for (std::thread &thread : pool)
+			thread.join();
+	}
+
+	// the stream of the model converted on this thread, main buffers it per job so models converted together don't
+	// interleave their messages (std::cout outside a job)
+	inline std::ostream *&JobLogStream() {
+		thread_local std::ostream *stream = nullptr;
+		return stream;
+	}
+
+	inline std::ostream &JobLog() { return JobLogStream() ? *JobLogStream() : std::cout; }
+
+	// version of an engine model file the legacy importer reads (0 to 2), UINT16_MAX for any other file. Legacy_Loader.cpp
+	uint16_t LegacyVersion(const std::string &filePath);
 }
 
 class AnimatedModel {
 public:
-	std::vector<cd::Vertex> vertices;
-	cd::AnimationClip animation;
+	std::vector<cd::Vertex> vertices; // one per control point
+	std::vector<glm::uvec3> indices; // one per triangle, into vertices
+	std::vector<cd::AnimationClip> clips; // each written to its own binary
+	std::vector<cd::BvhNode> bvh; // bind pose, children after their parent, empty when not built
+	std::vector<cd::MeshLod> lods; // coarser levels of the mesh, each coarser than the one before
+	uint32_t boneCount = MAX_BONES; // bones the keyframes animate
+	cd::StageTimes times; // of the last load
+	unsigned bakeThreads = 0; // threads baking keyframes, 0 = one per core
 
+#	ifdef FBX_IMPORT
 	void loadFBX(std::string filePath);
+#	endif
+	void loadGLB(std::string filePath); // GLB_Loader.cpp
+	void loadLegacy(std::string filePath); // version 0 to 2 engine binaries, Legacy_Loader.cpp
 
 private:
 	std::vector<cd::Bone> bones;
 
+#	ifdef FBX_IMPORT
+
 	int loadAnimatedModel(FbxScene *scene);
 
 	void getMesh(FbxNode *pNode, FbxMesh **mesh);
@@ -64,4 +151,5 @@ private:
 	bool findBones(FbxNode *node);
 	void loadBones(FbxNode *node, int parentIndex);
 	int getBoneIndex(std::string boneName);
+#	endif
 };
\ No newline at end of file
@@ -0,0 +1,215 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+#define SAH_TRAVERSAL_COST 1.0f /* visiting a node relative to testing a triangle */
+
+namespace {
+	struct Box {
+		glm::vec3 min = glm::vec3(INFINITY);
+		glm::vec3 max = glm::vec3(-INFINITY);
+
+		void grow(const Box &box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+		float area() const {
+			glm::vec3 extent = glm::max(max - min, glm::vec3(0));
+			return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+	};
+
+	float nodeArea(const cd::BvhNode &node) {
+		Box box = { node.min, node.max };
+		return box.area();
+	}
+
+	// closest point of triangle abc to p, by the region of p (Ericson, Real-Time Collision Detection 5.1.5)
+	glm::vec3 closestPoint(glm::vec3 p, glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+		glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+		float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+		if (d1 <= 0 && d2 <= 0) return a;
+		glm::vec3 bp = p - b;
+		float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+		if (d3 >= 0 && d4 <= d3) return b;
+		float vc = d1 * d4 - d3 * d2;
+		if (vc <= 0 && d1 >= 0 && d3 <= 0) return a + ab * (d1 / (d1 - d3));
+		glm::vec3 cp = p - c;
+		float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+		if (d6 >= 0 && d5 <= d6) return c;
+		float vb = d5 * d2 - d1 * d6;
+		if (vb <= 0 && d2 >= 0 && d6 <= 0) return a + ac * (d2 / (d2 - d6));
+		float va = d3 * d6 - d5 * d4;
+		if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+		float denominator = 1 / (va + vb + vc);
+		return a + ab * (vb * denominator) + ac * (vc * denominator);
+	}
+
+	float boxDistance(const cd::BvhNode &node, glm::vec3 p) {
+		return glm::length(glm::max(glm::max(node.min - p, p - node.max), glm::vec3(0)));
+	}
+
+	// nearest first, skipping nodes no closer than the closest triangle so far
+	float surfaceDistance(const std::vector<cd::Vertex> &vertices, const std::vector<glm::uvec3> &triangles,
+			const std::vector<cd::BvhNode> &nodes, glm::vec3 p) {
+		float closest = INFINITY;
+		std::vector<uint32_t> stack = { 0 };
+		while (!stack.empty()) {
+			const cd::BvhNode &node = nodes[stack.back()];
+			stack.pop_back();
+			if (closest <= boxDistance(node, p)) continue;
+
+			if (node.count == 0) {
+				bool secondNearer = boxDistance(nodes[node.first + 1], p) < boxDistance(nodes[node.first], p);
+				stack.push_back(node.first + (secondNearer ? 0 : 1));
+				stack.push_back(node.first + (secondNearer ? 1 : 0));
+				continue;
+			}
+			for (int32_t t = node.first; t < node.first + node.count; t++) {
+				const glm::uvec3 &triangle = triangles[t];
+				glm::vec3 point = closestPoint(p, glm::vec3(vertices[triangle.x].position), glm::vec3(vertices[triangle.y].position),
+					glm::vec3(vertices[triangle.z].position));
+				closest = std::min(closest, glm::length(point - p));
+			}
+		}
+		return closest;
+	}
+
+	class SahBuilder {
+	public:
+		SahBuilder(const std::vector<Box> &boxes, uint32_t leafSize, std::vector<cd::BvhNode> &nodes)
+			: boxes(boxes), leafSize(std::max(1u, leafSize)), nodes(nodes), order(boxes.size()), rightAreas(boxes.size()) {
+			std::iota(order.begin(), order.end(), 0);
+			for (const Box &box : boxes)
+				centers.push_back(box.min + box.max);
+		}
+
+		// leaf slot order of the triangles
+		std::vector<uint32_t> build() {
+			nodes.assign(1, cd::BvhNode());
+			split(0, 0, (uint32_t)order.size(), 1);
+			return order;
+		}
+
+	private:
+		const std::vector<Box> &boxes;
+		uint32_t leafSize;
+		std::vector<cd::BvhNode> &nodes;
+		std::vector<uint32_t> order;
+		std::vector<glm::vec3> centers; // doubled
+		std::vector<float> rightAreas;
+
+		// ties keep the triangle order so the build is deterministic
+		void sortAxis(uint32_t first, uint32_t count, int axis) {
+			std::sort(order.begin() + first, order.begin() + first + count, [this, axis](uint32_t a, uint32_t b) {
+				return centers[a][axis] < centers[b][axis] || (centers[a][axis] == centers[b][axis] && a < b);
+			});
+		}
+
+		// levels below a node of count triangles when every split halves them
+		uint32_t medianLevels(uint32_t count) const {
+			uint32_t levels = 0;
+			for (; count > leafSize; count = (count + 1) / 2)
+				levels++;
+			return levels;
+		}
+
+		// depth counts the nodes from the root to this one
+		void split(uint32_t node, uint32_t first, uint32_t count, uint32_t depth) {
+			Box bounds;
+			for (uint32_t p = first; p < first + count; p++)
+				bounds.grow(boxes[order[p]]);
+			nodes[node].min = bounds.min;
+			nodes[node].max = bounds.max;
+
+			// cheapest split of each axis' sorted triangles into the first s and the rest
+			float bestCost = INFINITY;
+			int bestAxis = 0;
+			uint32_t bestSplit = 0;
+			for (int axis = 0; axis < 3 && count > 1; axis++) {
+				sortAxis(first, count, axis);
+				Box right, left;
+				for (uint32_t s = count - 1; s > 0; s--) {
+					right.grow(boxes[order[first + s]]);
+					rightAreas[s] = right.area();
+				}
+				for (uint32_t s = 1; s < count; s++) {
+					left.grow(boxes[order[first + s - 1]]);
+					float cost = left.area() * s + rightAreas[s] * (count - s);
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestAxis = axis;
+						bestSplit = s;
+					}
+				}
+			}
+
+			float area = bounds.area();
+			float splitCost = SAH_TRAVERSAL_COST + (area > 0 ? bestCost / area : 0);
+			if (count == 1 || depth >= BVH_MAX_DEPTH || (count <= leafSize && count <= splitCost)) {
+				nodes[node].first = (int32_t)first;
+				nodes[node].count = (int32_t)count;
+				return;
+			}
+			if (bestAxis != 2)
+				sortAxis(first, count, bestAxis);
+
+			// an uneven split near the depth limit could run out of levels, halving always fits (and leaves at the limit
+			// take whatever is left when even that doesn't). boxes too large for a finite cost are halved too
+			if (bestSplit == 0 || depth + 1 + std::max(medianLevels(bestSplit), medianLevels(count - bestSplit)) > BVH_MAX_DEPTH)
+				bestSplit = count / 2;
+
+			uint32_t children = (uint32_t)nodes.size();
+			nodes.resize(children + 2);
+			nodes[node].first = (int32_t)children;
+			nodes[node].count = 0;
+			split(children, first, bestSplit, depth + 1);
+			split(children + 1, first + bestSplit, count - bestSplit, depth + 1);
+		}
+	};
+}
+
+void cd::BuildSahBvh(const std::vector<Vertex> &vertices, std::vector<glm::uvec3> &indices, uint32_t leafSize, std::vector<BvhNode> &nodes,
+		std::vector<uint32_t> *sources) {
+	nodes.clear();
+	if (indices.empty()) return;
+
+	std::vector<Box> boxes(indices.size());
+	for (size_t t = 0; t < indices.size(); t++) {
+		for (int c = 0; c < 3; c++)
+			boxes[t].grow({ glm::vec3(vertices[indices[t][c]].position), glm::vec3(vertices[indices[t][c]].position) });
+	}
+	std::vector<uint32_t> order = SahBuilder(boxes, leafSize, nodes).build();
+
+	// leaves index the triangles directly
+	std::vector<glm::uvec3> sorted(indices.size());
+	for (size_t slot = 0; slot < order.size(); slot++)
+		sorted[slot] = indices[order[slot]];
+	indices.swap(sorted);
+	if (sources) {
+		std::vector<uint32_t> sortedSources(order.size());
+		for (size_t slot = 0; slot < order.size(); slot++)
+			sortedSources[slot] = (*sources)[order[slot]];
+		sources->swap(sortedSources);
+	}
+}
+
+float cd::MeshDistance(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &from, const std::vector<glm::uvec3> &to,
+		const std::vector<BvhNode> &toNodes) {
+	if (toNodes.empty()) return from.empty() ? 0 : INFINITY;
+	float distance = 0;
+	for (const glm::uvec3 &triangle : from) {
+		glm::vec3 corners[3] = { glm::vec3(vertices[triangle.x].position), glm::vec3(vertices[triangle.y].position), glm::vec3(vertices[triangle.z].position) };
+		for (const glm::vec3 &corner : corners)
+			distance = std::max(distance, surfaceDistance(vertices, to, toNodes, corner));
+		distance = std::max(distance, surfaceDistance(vertices, to, toNodes, (corners[0] + corners[1] + corners[2]) / 3.0f));
+	}
+	return distance;
+}
+
+float cd::SahCost(const std::vector<BvhNode> &nodes) {
+	if (nodes.empty() || nodeArea(nodes[0]) <= 0) return 0;
+	float cost = 0;
+	for (const BvhNode &node : nodes)
+		cost += nodeArea(node) * (node.count == 0 ? SAH_TRAVERSAL_COST : (float)node.count);
+	return cost / nodeArea(nodes[0]);
+}
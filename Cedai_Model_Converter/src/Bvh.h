@@ -0,0 +1,21 @@
+#pragma once
+#include "FBX_Loader.h"
+
+namespace cd {
+	/*
+	Top down sah bvh over the bind pose triangles, each split chosen by sweeping the sorted centroids on all three axes.
+	Too slow for the engine to build at load time, so it's built here and stored for the engine to refit. The triangles
+	are reordered so each leaf's triangles are consecutive (RenumberVertices then follows that order). Splits that would
+	make the tree deeper than BVH_MAX_DEPTH are median splits instead. sources, when given, is reordered with them.
+	*/
+	void BuildSahBvh(const std::vector<Vertex> &vertices, std::vector<glm::uvec3> &indices, uint32_t leafSize, std::vector<BvhNode> &nodes,
+		std::vector<uint32_t> *sources = nullptr);
+
+	// expected cost of a ray through the root, in triangle tests
+	float SahCost(const std::vector<BvhNode> &nodes);
+
+	// largest distance from the corners and centres of the from triangles to the surface of the to triangles, which are in
+	// the leaf order of toNodes (BuildSahBvh)
+	float MeshDistance(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &from, const std::vector<glm::uvec3> &to,
+		const std::vector<BvhNode> &toNodes);
+}
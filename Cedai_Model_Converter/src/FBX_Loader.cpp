@@ -1,103 +1,689 @@
 #include "FBX_Loader.h"
 
-#include "Tools.h"
+#include "Lz.h"
+#include "KeyframeReduction.h"
+#include "MeshOrder.h"
+#include "Bvh.h"
+#include "Simplify.h"
 
-#include <fbxsdk.h>
-#include <fbxsdk/scene/geometry/fbxmesh.h>
-#include <fbxsdk/core/math/fbxvector4.h>
+#ifdef FBX_IMPORT
+#	include "Tools.h"
+#	include <fbxsdk.h>
+#	include <fbxsdk/scene/geometry/fbxmesh.h>
+#	include <fbxsdk/core/math/fbxvector4.h>
+#endif
 #include <glm/glm.hpp>
 
 #include <iostream>
 #include <fstream>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <filesystem>
+#include <sstream>
+#include <mutex>
 
-#define FBX_PATH "maize.fbx"
-#define FILENAME "maize"
+#define FBX_PATH "maize.fbx" /* converted when no model is given */
 #define OUT_PATH ""
-#define IN_PATH ""
+#define CACHE_FILE "convert_cache.txt" /* in OUT_PATH, the inputs of the last conversions */
 
 // MAIN
 
-int main() {
-	AnimatedModel model;
+namespace {
+	struct Job {
+		std::string path;
+		std::string name; // of its binaries, the path below the converted directory without extension
+		uint64_t hash = 0;
+		bool skipped = false;
+		std::string error;
+		std::vector<std::string> outputs;
+		cd::StageTimes times;
+	};
+
+	struct Settings {
+		bool force = false;
+		bool staticModels = false; // bind pose only, for LoadStaticModel
+		float tolerance = KEYFRAME_TOLERANCE;
+	};
+
+	struct CacheEntry {
+		uint64_t hash = 0;
+		std::string version;
+		std::vector<std::string> outputs;
+	};
+
+	// file name without directory or extension
+	std::string fileStem(const std::string &path) {
+		size_t start = path.find_last_of("/\\");
+		start = start == std::string::npos ? 0 : start + 1;
+		size_t end = path.find_last_of('.');
+		return path.substr(start, end == std::string::npos || end < start ? std::string::npos : end - start);
+	}
+
+	std::string fileExtension(const std::string &path) {
+		size_t slash = path.find_last_of("/\\");
+		size_t dot = path.find_last_of('.');
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return "";
+		std::string extension = path.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		return extension;
+	}
+
+	// <name>_v4.bin, <name>_<clip>_v4.bin when the model has more than one clip, <name>_static_v4.bin for a static export
+	std::string binaryName(const std::string &modelName, const cd::AnimationClip &clip, size_t clipCount, bool staticModel) {
+		std::string name = std::string(OUT_PATH) + modelName;
+		if (staticModel) {
+			name += "_static";
+		} else if (clipCount > 1) {
+			name += "_";
+			for (char c : clip.name)
+				name += std::isalnum((unsigned char)c) || c == '-' ? c : '_';
+		}
+		return name + "_v" + std::to_string(VERSION_NUMBER) + ".bin";
+	}
+
+	// the file format, converter version and settings, a change of any converts every model again
+	std::string converterVersion(const Settings &settings) {
+		return std::to_string(VERSION_NUMBER) + "." + std::to_string(CONVERTER_VERSION) + "/"
+			+ (settings.staticModels ? std::string("static") : std::to_string(settings.tolerance));
+	}
+
+	// 64 bit fnv-1a of the file's contents
+	uint64_t hashFile(const std::string &path) {
+		std::ifstream input(path, std::ios::binary);
+		if (!input) throw std::runtime_error("can't open " + path);
+		uint64_t hash = 0xcbf29ce484222325ull;
+		std::vector<char> buffer(1 << 16);
+		while (input) {
+			input.read(buffer.data(), buffer.size());
+			for (std::streamsize i = 0; i < input.gcount(); i++)
+				hash = (hash ^ (uint8_t)buffer[i]) * 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// engine binaries only of the versions the legacy importer reads, so a directory's own v4 binaries aren't inputs
+	bool isModel(const std::string &path) {
+		std::string extension = fileExtension(path);
+		return extension == "glb" || extension == "fbx" || (extension == "bin" && cd::LegacyVersion(path) != UINT16_MAX);
+	}
+
+	// a legacy binary's name without its _v<version> suffix, maize_v1.bin converts to maize_v4.bin
+	std::string modelName(const std::string &path, std::string name) {
+		size_t suffix = name.find_last_of('_');
+		if (fileExtension(path) == "bin" && suffix != std::string::npos && suffix + 2 < name.size() && name[suffix + 1] == 'v'
+				&& name.find_first_not_of("0123456789", suffix + 2) == std::string::npos)
+			name.erase(suffix);
+		return name;
+	}
+
+	// a model, every model under a directory, or a manifest (.txt) listing one model per line. models under a directory
+	// keep their subdirectory in the output so models with the same file name don't share binaries
+	void listInputs(const std::string &path, std::vector<Job> &inputs) {
+		namespace fs = std::filesystem;
+		auto add = [&](const std::string &model, const std::string &name) {
+			Job job;
+			job.path = model;
+			job.name = modelName(model, name);
+			inputs.push_back(job);
+		};
+		if (fs::is_directory(path)) {
+			std::vector<std::string> found;
+			for (const fs::directory_entry &entry : fs::recursive_directory_iterator(path)) {
+				if (entry.is_regular_file() && isModel(entry.path().string()))
+					found.push_back(entry.path().string());
+			}
+			std::sort(found.begin(), found.end());
+			for (const std::string &model : found)
+				add(model, fs::path(model).lexically_relative(path).replace_extension().generic_string());
+		} else if (fileExtension(path) == "txt") {
+			std::ifstream manifest(path);
+			if (!manifest) throw std::runtime_error("can't open manifest " + path);
+			fs::path directory = fs::path(path).parent_path();
+			std::string line;
+			while (std::getline(manifest, line)) {
+				line.erase(line.find_last_not_of(" \t\r") + 1);
+				line.erase(0, line.find_first_not_of(" \t"));
+				if (line.empty() || line[0] == '#') continue;
+				std::string model = fs::path(line).is_absolute() ? line : (directory / line).string();
+				add(model, fileStem(model));
+			}
+		} else {
+			add(path, fileStem(path));
+		}
+	}
+
+	// one line per model: hash, converter version, model path, then its binaries, tab separated
+	std::map<std::string, CacheEntry> readCache() {
+		std::map<std::string, CacheEntry> cache;
+		std::ifstream input(std::string(OUT_PATH) + CACHE_FILE);
+		std::string line;
+		while (std::getline(input, line)) {
+			std::vector<std::string> fields;
+			size_t start = 0, tab;
+			while ((tab = line.find('\t', start)) != std::string::npos) {
+				fields.push_back(line.substr(start, tab - start));
+				start = tab + 1;
+			}
+			fields.push_back(line.substr(start));
+			if (fields.size() < 3) continue;
+
+			CacheEntry &entry = cache[fields[2]];
+			entry.hash = std::strtoull(fields[0].c_str(), nullptr, 16);
+			entry.version = fields[1];
+			entry.outputs.assign(fields.begin() + 3, fields.end());
+		}
+		return cache;
+	}
+
+	void writeCache(const std::map<std::string, CacheEntry> &cache) {
+		std::ofstream output(std::string(OUT_PATH) + CACHE_FILE);
+		for (const auto &model : cache) {
+			char hash[17];
+			snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)model.second.hash);
+			output << hash << '\t' << model.second.version << '\t' << model.first;
+			for (const std::string &binary : model.second.outputs)
+				output << '\t' << binary;
+			output << '\n';
+		}
+	}
+
+	bool isCached(const std::map<std::string, CacheEntry> &cache, const Job &job, const Settings &settings) {
+		auto entry = cache.find(job.path);
+		if (entry == cache.end() || entry->second.hash != job.hash || entry->second.version != converterVersion(settings))
+			return false;
+		for (const std::string &binary : entry->second.outputs) {
+			if (!std::filesystem::exists(binary))
+				return false;
+		}
+		return !entry->second.outputs.empty();
+	}
+
+	// a finished job's messages, each line after the job's name
+	void printJobLog(const Job &job, const std::string &log) {
+		static std::mutex mutex;
+		std::lock_guard<std::mutex> lock(mutex);
+		std::istringstream lines(log);
+		std::string line;
+		while (std::getline(lines, line))
+			std::cout << job.name << ": " << line << '\n';
+		std::cout.flush();
+	}
+
+	// models converted at the same time share the cores for baking
+	void convert(Job &job, const Settings &settings, unsigned bakeThreads) {
+		AnimatedModel model;
+		model.bakeThreads = std::max(1u, bakeThreads);
+		std::string extension = fileExtension(job.path);
+		if (extension == "glb")
+			model.loadGLB(job.path);
+		else if (extension == "bin")
+			model.loadLegacy(job.path);
+#	ifdef FBX_IMPORT
+		else if (extension == "fbx")
+			model.loadFBX(job.path);
+#	endif
+		else
+			throw std::runtime_error("unsupported model format: " + job.path);
+		job.times = model.times;
+
+		// a static model is its bind pose, one binary without bones or keyframes
+		if (settings.staticModels) {
+			for (cd::Vertex &vertex : model.vertices) {
+				vertex.boneIndices = glm::ivec4(-1);
+				vertex.boneWeights = glm::vec4(0);
+			}
+			model.boneCount = 0;
+			model.clips.assign(1, cd::AnimationClip());
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		cd::ReorderTriangles(model.vertices, model.indices);
+		job.times.import += cd::SecondsSince(start);
+#	ifdef PREBAKED_BVH
+		start = std::chrono::steady_clock::now();
+		cd::BuildSahBvh(model.vertices, model.indices, TRIANGLE_CLUSTER_SIZE, model.bvh);
+		cd::RenumberVertices(model.vertices, model.indices);
+		job.times.bvh = cd::SecondsSince(start);
+		cd::JobLog() << "bvh built: " << model.bvh.size() << " nodes, sah cost " << cd::SahCost(model.bvh) << std::endl;
+#	endif
+
+		// every level indexes the full mesh's vertices, numbered above. static models have no levels (the engine's
+		// StaticModel draws the full mesh)
+		start = std::chrono::steady_clock::now();
+		cd::BuildLods(model, settings.staticModels ? 1 : LOD_LEVELS, LOD_TRIANGLE_RATIO, LOD_MIN_TRIANGLES);
+		job.times.lod = cd::SecondsSince(start);
+#	ifdef PREBAKED_BVH
+		start = std::chrono::steady_clock::now();
+		for (cd::MeshLod &lod : model.lods)
+			cd::BuildSahBvh(model.vertices, lod.indices, TRIANGLE_CLUSTER_SIZE, lod.bvh, &lod.sources);
+		job.times.bvh += cd::SecondsSince(start);
+#	endif
+
+		// tolerance as a fraction of the bind pose size
+		start = std::chrono::steady_clock::now();
+		if (settings.tolerance > 0 && !settings.staticModels) {
+			glm::vec3 min(INFINITY), max(-INFINITY);
+			for (const cd::Vertex &vertex : model.vertices) {
+				min = glm::min(min, glm::vec3(vertex.position));
+				max = glm::max(max, glm::vec3(vertex.position));
+			}
+			float tolerance = settings.tolerance * glm::length(max - min);
+			for (cd::AnimationClip &clip : model.clips) {
+				size_t keyframeCount = clip.keyframes.size();
+				float maxError = cd::ReduceKeyframes(clip, model.vertices, model.boneCount, tolerance);
+				cd::JobLog() << "clip " << clip.name << " reduced: " << keyframeCount << " -> " << clip.keyframes.size() << " keyframes ("
+					<< (float)keyframeCount / clip.keyframes.size() << "x), max error " << maxError << " (tolerance " << tolerance << ")" << std::endl;
+			}
+		}
+		job.times.bake += cd::SecondsSince(start);
+
+		// each binary is read back to check it
+		start = std::chrono::steady_clock::now();
+		for (const cd::AnimationClip &clip : model.clips) {
+			std::string binary = binaryName(job.name, clip, model.clips.size(), settings.staticModels);
+			std::filesystem::path directory = std::filesystem::path(binary).parent_path();
+			if (!directory.empty())
+				std::filesystem::create_directories(directory);
+			writeBinary(model, clip, binary);
+			AnimatedModel model_in;
+			readBinary(model_in, binary);
+			if (model_in.vertices.size() != model.vertices.size() || model_in.indices.size() != model.indices.size()
+					|| model_in.clips[0].keyframes.size() != clip.keyframes.size() || model_in.bvh.size() != model.bvh.size()
+					|| model_in.lods.size() != model.lods.size() || model_in.boneCount != model.boneCount)
+				throw std::runtime_error("read back of " + binary + " doesn't match the model");
+			job.outputs.push_back(binary);
+		}
+		job.times.write = cd::SecondsSince(start);
+	}
+}
+
+/*
+usage: Cedai_Model_Converter [--force] [--static] [--tolerance fraction] [model.glb | model.fbx | model_v1.bin | directory | manifest.txt]...
+models are converted on all cores, models whose contents and converter version match the cache are skipped
+unless --force is given. keyframes are dropped while no skinned vertex moves more than the tolerance (a fraction of
+the model's size, 0 keeps every keyframe). engine binaries of versions 0 to 2 are converted again, without their
+version in the name. --static writes only the bind pose's geometry (no bones, keyframes or levels
+of detail) to <name>_static_v4.bin for the engine's LoadStaticModel. a directory's models keep their subdirectory in the
+output, other models that share a file name fail
+*/
+int main(int argc, char **argv) {
+	auto start = std::chrono::steady_clock::now();
+	Settings settings;
+	std::vector<Job> jobs;
 	try {
-		model.loadFBX(FBX_PATH);
-		writeBinary(model);
-		AnimatedModel model_in;
-		readBinary(model_in);
+		for (int a = 1; a < argc; a++) {
+			std::string argument = argv[a];
+			if (argument == "--force")
+				settings.force = true;
+			else if (argument == "--static")
+				settings.staticModels = true;
+			else if (argument == "--tolerance" && a + 1 < argc)
+				settings.tolerance = std::max(0.0f, std::stof(argv[++a]));
+			else
+				listInputs(argument, jobs);
+		}
+		if (jobs.empty())
+			listInputs(FBX_PATH, jobs);
 	} catch (const std::exception &e) {
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
-	std::cout << "exiting..." << std::endl;
-	return 0;
+
+	// a model given twice is converted once, different models given separately can still share a name and none of them
+	// are converted
+	std::map<std::string, std::string> named;
+	std::vector<Job> unique;
+	for (Job &job : jobs) {
+		auto other = named.emplace(job.name, job.path);
+		if (other.second || other.first->second != job.path)
+			unique.push_back(job);
+	}
+	jobs.swap(unique);
+	std::map<std::string, size_t> names;
+	for (const Job &job : jobs)
+		names[job.name]++;
+	for (Job &job : jobs) {
+		if (names[job.name] > 1)
+			job.error = "another model writes binaries named " + job.name;
+	}
+
+	std::map<std::string, CacheEntry> cache = readCache();
+	unsigned threadCount = cd::ThreadCount(0, jobs.size());
+	cd::ParallelFor(jobs.size(), threadCount, [&](size_t j) {
+		Job &job = jobs[j];
+		if (!job.error.empty()) return;
+		std::ostringstream log;
+		cd::JobLogStream() = &log;
+		try {
+			job.hash = hashFile(job.path);
+			job.skipped = !settings.force && isCached(cache, job, settings);
+			if (!job.skipped)
+				convert(job, settings, std::max(1u, std::thread::hardware_concurrency()) / threadCount);
+		} catch (const std::exception &e) {
+			job.error = e.what();
+		}
+		cd::JobLogStream() = nullptr;
+		printJobLog(job, log.str());
+	});
+
+	// SUMMARY
+
+	cd::StageTimes total;
+	size_t converted = 0, skipped = 0, failed = 0;
+	for (const Job &job : jobs) {
+		if (!job.error.empty()) {
+			std::cerr << job.path << ": " << job.error << std::endl;
+			cache.erase(job.path);
+			failed++;
+		} else if (job.skipped) {
+			skipped++;
+		} else {
+			cache[job.path] = CacheEntry{ job.hash, converterVersion(settings), job.outputs };
+			total.import += job.times.import;
+			total.skin += job.times.skin;
+			total.bvh += job.times.bvh;
+			total.lod += job.times.lod;
+			total.bake += job.times.bake;
+			total.write += job.times.write;
+			converted++;
+		}
+	}
+	writeCache(cache);
+
+	std::cout << "converted " << converted << ", unchanged " << skipped << ", failed " << failed
+		<< " in " << cd::SecondsSince(start) << " s on " << threadCount << " threads" << std::endl;
+	std::cout << "stage seconds (summed over models): import " << total.import << ", skin extraction " << total.skin
+		<< ", bvh build " << total.bvh << ", lod simplification " << total.lod << ", keyframe baking " << total.bake << ", write " << total.write << std::endl;
+	return failed ? EXIT_FAILURE : 0;
+}
+
+// SECTIONS
+
+namespace {
+	struct SectionData {
+		cd::ModelSection section;
+		std::vector<uint8_t> bytes;
+	};
+
+	// blocks of whole elements compressed independently so the engine can decode them in parallel
+	SectionData encodeSection(uint32_t type, uint32_t count, size_t stride, const void *elements) {
+		SectionData data;
+		const uint8_t *src = (const uint8_t *)elements;
+		data.section = { type, count, 0, stride * count, cd::encoding_raw, 0 };
+		data.bytes.assign(src, src + stride * count);
+
+#	ifdef COMPRESS_SECTIONS
+		size_t perBlock = std::max<size_t>(1, MODEL_BLOCK_BYTES / stride);
+		size_t blockCount = (count + perBlock - 1) / perBlock;
+		std::vector<uint8_t> compressed(sizeof(uint32_t) * blockCount);
+		for (size_t b = 0; b < blockCount; b++) {
+			size_t first = b * perBlock;
+			size_t start = compressed.size();
+			cd::LzCompress(src + stride * first, stride * std::min(perBlock, count - first), compressed);
+			uint32_t blockBytes = (uint32_t)(compressed.size() - start);
+			memcpy(compressed.data() + sizeof(uint32_t) * b, &blockBytes, sizeof(uint32_t));
+		}
+		if (compressed.size() < data.bytes.size()) {
+			data.section.bytes = compressed.size();
+			data.section.encoding = cd::encoding_lz;
+			data.bytes.swap(compressed);
+		}
+#	endif
+		return data;
+	}
+
+	bool decodeSection(const cd::ModelSection &section, const std::vector<uint8_t> &bytes, size_t stride, std::vector<uint8_t> &elements) {
+		elements.resize(stride * section.count);
+		if (section.encoding == cd::encoding_raw) {
+			if (bytes.size() != elements.size()) return false;
+			memcpy(elements.data(), bytes.data(), bytes.size());
+			return true;
+		}
+		size_t perBlock = std::max<size_t>(1, MODEL_BLOCK_BYTES / stride);
+		size_t blockCount = (section.count + perBlock - 1) / perBlock;
+		size_t offset = sizeof(uint32_t) * blockCount;
+		for (size_t b = 0; b < blockCount; b++) {
+			uint32_t blockBytes;
+			memcpy(&blockBytes, bytes.data() + sizeof(uint32_t) * b, sizeof(uint32_t));
+			size_t first = b * perBlock;
+			if (bytes.size() < offset + blockBytes || !cd::LzDecompress(bytes.data() + offset, blockBytes,
+					elements.data() + stride * first, stride * std::min(perBlock, section.count - first)))
+				return false;
+			offset += blockBytes;
+		}
+		return offset == bytes.size();
+	}
+
+	uint16_t quantize(float value, float min, float max) {
+		return max > min ? (uint16_t)std::lround(glm::clamp((value - min) / (max - min), 0.0f, 1.0f) * 65535.0f) : 0;
+	}
+
+	cd::PackedVertex packVertex(const cd::Vertex &vertex, glm::vec3 min, glm::vec3 max) {
+		cd::PackedVertex packed = {};
+		for (int c = 0; c < 3; c++)
+			packed.position[c] = quantize(vertex.position[c], min[c], max[c]);
+
+		// weights normalized to 255 with the largest taking the rounding, as the engine packs older files
+		float sum = 0;
+		for (int b = 0; b < 4; b++) {
+			bool used = 0 <= vertex.boneIndices[b] && vertex.boneIndices[b] < MAX_BONES && vertex.boneWeights[b] > 0;
+			packed.boneIndices[b] = used ? (uint8_t)vertex.boneIndices[b] : 255;
+			sum += used ? vertex.boneWeights[b] : 0;
+		}
+		int total = 0, largest = 0;
+		for (int b = 0; b < 4; b++) {
+			packed.boneWeights[b] = packed.boneIndices[b] != 255 ? (uint8_t)std::lround(vertex.boneWeights[b] / sum * 255.0f) : 0;
+			total += packed.boneWeights[b];
+			if (packed.boneWeights[b] > packed.boneWeights[largest]) largest = b;
+		}
+		if (packed.boneIndices[largest] != 255) // unweighted vertices keep the bind position
+			packed.boneWeights[largest] = (uint8_t)(packed.boneWeights[largest] + 255 - total);
+		return packed;
+	}
+
+	cd::Vertex unpackVertex(const cd::PackedVertex &packed, glm::vec3 min, glm::vec3 max) {
+		cd::Vertex vertex;
+		vertex.position = glm::vec4(min + glm::vec3(packed.position[0], packed.position[1], packed.position[2]) * ((max - min) / 65535.0f), 0);
+		for (int b = 0; b < 4; b++) {
+			vertex.boneIndices[b] = packed.boneIndices[b] == 255 ? -1 : packed.boneIndices[b];
+			vertex.boneWeights[b] = packed.boneWeights[b] / 255.0f;
+		}
+		return vertex;
+	}
 }
 
 // WRITE CEDAI BINARY
 
-void writeBinary(const AnimatedModel &model) {
-	std::cout << "starting model binary write..." << std::endl;
-	std::string file_name = std::string(OUT_PATH) + FILENAME + "_v" + std::to_string(VERSION_NUMBER) + ".bin";
+void writeBinary(const AnimatedModel &model, const cd::AnimationClip &animation, const std::string &file_name) {
+	cd::JobLog() << "starting model binary write of " << file_name << "..." << std::endl;
 	std::ofstream output(file_name, std::ios::binary);
-	
-	uint16_t version_number = VERSION_NUMBER;
-	output.write((char*) &version_number, sizeof(uint16_t));
-	
-	uint32_t num_vertices = model.vertices.size();
-	uint32_t num_keyframes = model.animation.keyframes.size();
-	uint32_t num_bones = MAX_BONES;
-	output.write((char*) &num_vertices, sizeof(uint32_t));
-	output.write((char*) & num_keyframes, sizeof(uint32_t));
-	output.write((char*) & num_bones, sizeof(uint32_t));
-	
-	output.write((char*) model.vertices.data(), sizeof(cd::Vertex) * num_vertices);
-	output.write((char*) &model.animation.duration, sizeof(double));
-	output.write((char*) model.animation.keyframes.data(), sizeof(cd::Keyframe) * num_keyframes);
-	
+	if (!output) throw std::runtime_error("can't open " + file_name + " for writing");
+
+	// positions quantized against the bind pose bounds
+	glm::vec3 bounds[2] = { glm::vec3(INFINITY), glm::vec3(-INFINITY) };
+	for (const cd::Vertex &vertex : model.vertices) {
+		bounds[0] = glm::min(bounds[0], glm::vec3(vertex.position));
+		bounds[1] = glm::max(bounds[1], glm::vec3(vertex.position));
+	}
+	std::vector<cd::PackedVertex> vertices;
+	for (const cd::Vertex &vertex : model.vertices)
+		vertices.push_back(packVertex(vertex, bounds[0], bounds[1]));
+
+	// only the model's bones
+	size_t keyframeBytes = sizeof(double) + sizeof(glm::mat4) * model.boneCount;
+	std::vector<uint8_t> keyframes(keyframeBytes * animation.keyframes.size());
+	for (size_t k = 0; k < animation.keyframes.size(); k++) {
+		memcpy(&keyframes[keyframeBytes * k], &animation.keyframes[k].time, sizeof(double));
+		memcpy(&keyframes[keyframeBytes * k + sizeof(double)], animation.keyframes[k].boneTransforms.data(), sizeof(glm::mat4) * model.boneCount);
+	}
+
+	// a prebaked bvh's leaves already are clusters
+	std::vector<cd::TriangleCluster> clusters;
+	if (model.bvh.empty())
+		cd::BuildClusters(model.vertices, model.indices, TRIANGLE_CLUSTER_SIZE, clusters);
+
+	std::vector<SectionData> sections = {
+		{ { cd::section_vertex_bounds, 1, 0, sizeof(bounds), cd::encoding_raw, 0 },
+			std::vector<uint8_t>((const uint8_t *)bounds, (const uint8_t *)bounds + sizeof(bounds)) },
+		encodeSection(cd::section_packed_vertices, (uint32_t)vertices.size(), sizeof(cd::PackedVertex), vertices.data()),
+		encodeSection(cd::section_indices, (uint32_t)model.indices.size(), sizeof(glm::uvec3), model.indices.data())
+	};
+	// a static model's clip has none
+	if (!animation.keyframes.empty())
+		sections.push_back(encodeSection(cd::section_packed_keyframes, (uint32_t)animation.keyframes.size(), keyframeBytes, keyframes.data()));
+	if (!clusters.empty())
+		sections.push_back(encodeSection(cd::section_triangle_clusters, (uint32_t)clusters.size(), sizeof(cd::TriangleCluster), clusters.data()));
+	if (!model.bvh.empty())
+		sections.push_back(encodeSection(cd::section_bvh_nodes, (uint32_t)model.bvh.size(), sizeof(cd::BvhNode), model.bvh.data()));
+
+	// coarser levels, each level's triangles and nodes one after the other
+	std::vector<cd::ModelLod> lods;
+	std::vector<glm::uvec3> lodIndices;
+	std::vector<uint32_t> lodSources;
+	std::vector<cd::BvhNode> lodNodes;
+	for (const cd::MeshLod &lod : model.lods) {
+		lods.push_back({ (uint32_t)lodIndices.size(), (uint32_t)lod.indices.size(), (uint32_t)lodNodes.size(), (uint32_t)lod.bvh.size(), lod.error, {} });
+		lodIndices.insert(lodIndices.end(), lod.indices.begin(), lod.indices.end());
+		lodSources.insert(lodSources.end(), lod.sources.begin(), lod.sources.end());
+		lodNodes.insert(lodNodes.end(), lod.bvh.begin(), lod.bvh.end());
+	}
+	if (!lods.empty()) {
+		sections.push_back(encodeSection(cd::section_lods, (uint32_t)lods.size(), sizeof(cd::ModelLod), lods.data()));
+		sections.push_back(encodeSection(cd::section_lod_indices, (uint32_t)lodIndices.size(), sizeof(glm::uvec3), lodIndices.data()));
+		sections.push_back(encodeSection(cd::section_lod_sources, (uint32_t)lodSources.size(), sizeof(uint32_t), lodSources.data()));
+	}
+	if (!lodNodes.empty())
+		sections.push_back(encodeSection(cd::section_lod_bvh_nodes, (uint32_t)lodNodes.size(), sizeof(cd::BvhNode), lodNodes.data()));
+	const uint16_t section_count = (uint16_t)sections.size();
+
+	// each section starts aligned
+	uint64_t offset = sizeof(cd::ModelFileHeader) + sizeof(cd::ModelSection) * section_count;
+	for (SectionData &data : sections) {
+		offset = (offset + MODEL_SECTION_ALIGNMENT - 1) / MODEL_SECTION_ALIGNMENT * MODEL_SECTION_ALIGNMENT;
+		data.section.offset = offset;
+		offset += data.section.bytes;
+	}
+
+	cd::ModelFileHeader header = { VERSION_NUMBER, section_count, model.boneCount, animation.duration };
+	output.write((char*) &header, sizeof(header));
+	for (const SectionData &data : sections)
+		output.write((char*) &data.section, sizeof(cd::ModelSection));
+
+	const char padding[MODEL_SECTION_ALIGNMENT] = { 0 };
+	for (const SectionData &data : sections) {
+		output.write(padding, data.section.offset - output.tellp());
+		output.write((const char*) data.bytes.data(), data.bytes.size());
+	}
+
 	output.close();
-	std::cout << "model write success!" << std::endl;
+	if (!output) throw std::runtime_error("can't write " + file_name);
+
+	size_t raw = sizeof(cd::Vertex) * model.vertices.size() + sizeof(glm::uvec3) * model.indices.size()
+		+ sizeof(cd::Keyframe) * animation.keyframes.size();
+	cd::JobLog() << "model write success! " << offset << " bytes (" << raw << " unpacked)" << std::endl;
 }
 
 // READ CEDAI BINARY
 
-bool fileExists(const std::string& name) {
-	struct stat buffer;
-	return (stat(name.c_str(), &buffer) == 0);
-}
-
-void readBinary(AnimatedModel &model) {
-	std::string file_name = std::string(IN_PATH) + FILENAME + "_v" + std::to_string(VERSION_NUMBER) + ".bin";
-	if (!fileExists(file_name)) {
-		std::cout << "model reader file not found" << std::endl;
-		return;
-	}
+void readBinary(AnimatedModel &model, const std::string &file_name) {
+	if (!std::filesystem::is_regular_file(file_name)) throw std::runtime_error("file read: " + file_name + " not found");
 
 	std::ifstream input(file_name, std::ios::binary);
 
-	uint16_t version_number;
-	input.read((char*) &version_number, sizeof(uint16_t));
-	if (version_number != VERSION_NUMBER) {
-		std::cout << "model reader incompatible version number" << std::endl;
-		return;
-	}
+	cd::ModelFileHeader header;
+	input.read((char*) &header, sizeof(header));
+	if (!input || header.version != VERSION_NUMBER) throw std::runtime_error("file read: incompatible version number");
+	if (header.boneCount > MAX_BONES) throw std::runtime_error("file read: incompatible bone count");
 
-	uint32_t num_vertices, num_keyframes, num_bones;
-	input.read((char*) &num_vertices, sizeof(uint32_t));
-	input.read((char*) &num_keyframes, sizeof(uint32_t));
-	input.read((char*) &num_bones, sizeof(uint32_t));
-	if (num_bones != MAX_BONES) throw std::runtime_error("file read: incompatible bone count");
+	std::vector<cd::ModelSection> sections(header.sectionCount);
+	input.read((char*) sections.data(), sizeof(cd::ModelSection) * header.sectionCount);
+	if (!input) throw std::runtime_error("file read: section table truncated");
 
 	model.vertices.clear();
-	model.vertices.resize(num_vertices);
-	model.animation.keyframes.clear();
-	model.animation.keyframes.resize(num_keyframes);
+	model.indices.clear();
+	model.bvh.clear();
+	model.lods.clear();
+	model.clips.assign(1, cd::AnimationClip());
+	cd::AnimationClip &animation = model.clips[0];
+	animation.name = fileStem(file_name);
+	animation.duration = header.duration;
+	model.boneCount = header.boneCount;
+	glm::vec3 bounds[2] = { glm::vec3(0), glm::vec3(0) };
+	size_t keyframeBytes = sizeof(double) + sizeof(glm::mat4) * header.boneCount;
 
-	input.read((char*) model.vertices.data(), sizeof(cd::Vertex) * num_vertices);
-	input.read((char*) &model.animation.duration, sizeof(double));
-	input.read((char*) model.animation.keyframes.data(), sizeof(cd::Keyframe) * num_keyframes);
+	std::vector<cd::ModelLod> lods;
+	std::vector<glm::uvec3> lodIndices;
+	std::vector<uint32_t> lodSources;
+	std::vector<cd::BvhNode> lodNodes;
+
+	// bounds come before the vertices they unpack
+	for (const cd::ModelSection &section : sections) {
+		std::vector<uint8_t> bytes(section.bytes), elements;
+		input.seekg(section.offset);
+		input.read((char*) bytes.data(), section.bytes);
+		if (!input) throw std::runtime_error("file read: section truncated");
+
+		if (section.type == cd::section_vertex_bounds) {
+			if (!decodeSection(section, bytes, sizeof(bounds), elements)) throw std::runtime_error("file read: bad section");
+			memcpy(bounds, elements.data(), sizeof(bounds));
+		} else if (section.type == cd::section_packed_vertices) {
+			if (!decodeSection(section, bytes, sizeof(cd::PackedVertex), elements)) throw std::runtime_error("file read: bad section");
+			const cd::PackedVertex *packed = (const cd::PackedVertex *)elements.data();
+			for (uint32_t v = 0; v < section.count; v++)
+				model.vertices.push_back(unpackVertex(packed[v], bounds[0], bounds[1]));
+		} else if (section.type == cd::section_indices) {
+			if (!decodeSection(section, bytes, sizeof(glm::uvec3), elements)) throw std::runtime_error("file read: bad section");
+			model.indices.resize(section.count);
+			memcpy(model.indices.data(), elements.data(), elements.size());
+		} else if (section.type == cd::section_packed_keyframes) {
+			if (!decodeSection(section, bytes, keyframeBytes, elements)) throw std::runtime_error("file read: bad section");
+			animation.keyframes.resize(section.count);
+			for (uint32_t k = 0; k < section.count; k++) {
+				memcpy(&animation.keyframes[k].time, &elements[keyframeBytes * k], sizeof(double));
+				memcpy(animation.keyframes[k].boneTransforms.data(), &elements[keyframeBytes * k + sizeof(double)], sizeof(glm::mat4) * header.boneCount);
+			}
+		} else if (section.type == cd::section_bvh_nodes) {
+			if (!decodeSection(section, bytes, sizeof(cd::BvhNode), elements)) throw std::runtime_error("file read: bad section");
+			model.bvh.resize(section.count);
+			memcpy(model.bvh.data(), elements.data(), elements.size());
+		} else if (section.type == cd::section_lods) {
+			if (!decodeSection(section, bytes, sizeof(cd::ModelLod), elements)) throw std::runtime_error("file read: bad section");
+			lods.resize(section.count);
+			memcpy(lods.data(), elements.data(), elements.size());
+		} else if (section.type == cd::section_lod_indices) {
+			if (!decodeSection(section, bytes, sizeof(glm::uvec3), elements)) throw std::runtime_error("file read: bad section");
+			lodIndices.resize(section.count);
+			memcpy(lodIndices.data(), elements.data(), elements.size());
+		} else if (section.type == cd::section_lod_sources) {
+			if (!decodeSection(section, bytes, sizeof(uint32_t), elements)) throw std::runtime_error("file read: bad section");
+			lodSources.resize(section.count);
+			memcpy(lodSources.data(), elements.data(), elements.size());
+		} else if (section.type == cd::section_lod_bvh_nodes) {
+			if (!decodeSection(section, bytes, sizeof(cd::BvhNode), elements)) throw std::runtime_error("file read: bad section");
+			lodNodes.resize(section.count);
+			memcpy(lodNodes.data(), elements.data(), elements.size());
+		}
+	}
+
+	for (const cd::ModelLod &level : lods) {
+		if (lodIndices.size() < (size_t)level.firstTriangle + level.triangleCount || lodNodes.size() < (size_t)level.firstNode + level.nodeCount
+				|| lodSources.size() != lodIndices.size())
+			throw std::runtime_error("file read: bad level of detail");
+		cd::MeshLod lod;
+		lod.indices.assign(lodIndices.begin() + level.firstTriangle, lodIndices.begin() + level.firstTriangle + level.triangleCount);
+		lod.sources.assign(lodSources.begin() + level.firstTriangle, lodSources.begin() + level.firstTriangle + level.triangleCount);
+		lod.bvh.assign(lodNodes.begin() + level.firstNode, lodNodes.begin() + level.firstNode + level.nodeCount);
+		lod.error = level.error;
+		model.lods.push_back(lod);
+	}
 
-	std::cout << "model read success!" << std::endl;
+	cd::JobLog() << "model read success!" << std::endl;
 }
 
 /*
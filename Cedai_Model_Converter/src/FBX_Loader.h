@@ -1,7 +1,84 @@
 #pragma once
 #include "AnimatedModel.h"
 
-#define VERSION_NUMBER 1
+#define VERSION_NUMBER 4 /* v4: packed and compressed sections (v3: raw sections, v2: indexed, v1: three vertices per triangle) */
+#define CONVERTER_VERSION 6 /* bump when the output for the same model changes, the batch cache converts everything again */
+#define MODEL_SECTION_ALIGNMENT 64 /* also defined in ModelFile.hpp in the engine */
+#define MODEL_BLOCK_BYTES (64 * 1024) /* also defined in ModelFile.hpp in the engine */
+#define COMPRESS_SECTIONS /* lz compress the sections that shrink */
+#define TRIANGLE_CLUSTER_SIZE 4 /* triangles per cluster or prebaked bvh leaf, BVH_LEAF_SIZE in the engine (0 writes no clusters) */
+#define PREBAKED_BVH /* write an sah bvh over the bind pose (instead of clusters), the engine only refits it */
+#define BVH_MAX_DEPTH 32 /* nodes from the root to a prebaked bvh leaf, the engine's traversal stack (also defined in Bvh.hpp in the engine) */
+#define LOD_LEVELS 4 /* levels of detail written including the full mesh, 1 writes only the full mesh */
+#define LOD_TRIANGLE_RATIO 0.5f /* triangles of each level relative to the level before */
+#define LOD_MIN_TRIANGLES 16 /* no coarser level is made below this */
+#define KEYFRAME_TOLERANCE 1e-4f /* largest skinned vertex error from dropped keyframes, a fraction of the model's size */
 
-void writeBinary(const AnimatedModel & model);
-void readBinary(AnimatedModel &model);
\ No newline at end of file
+// file layout, matches the engine's ModelFile.hpp
+namespace cd {
+	enum ModelSectionType : uint32_t {
+		section_vertices = 1,
+		section_indices = 2,
+		section_keyframes = 3,
+		section_packed_vertices = 4,
+		section_vertex_bounds = 5,
+		section_packed_keyframes = 6,
+		section_triangle_clusters = 7,
+		section_bvh_nodes = 8,
+		section_lod_indices = 9,
+		section_lod_bvh_nodes = 10,
+		section_lods = 11,
+		section_lod_sources = 12
+	};
+
+	enum ModelSectionEncoding : uint32_t {
+		encoding_raw = 0,
+		encoding_lz = 1
+	};
+
+	struct ModelFileHeader {
+		uint16_t version;
+		uint16_t sectionCount;
+		uint32_t boneCount;
+		double duration;
+	};
+
+	struct ModelSection {
+		uint32_t type;
+		uint32_t count;
+		uint64_t offset;
+		uint64_t bytes;
+		uint32_t encoding;
+		uint32_t reserved;
+	};
+
+	// a coarser level of detail: its triangles in section_lod_indices and bvh in section_lod_bvh_nodes, the bvh's child and
+	// triangle indices relative to the level's own first node and triangle. section_lod_sources holds a uint32_t per
+	// triangle next to section_lod_indices, the full mesh triangle it was simplified from
+	struct ModelLod {
+		uint32_t firstTriangle;
+		uint32_t triangleCount;
+		uint32_t firstNode;
+		uint32_t nodeCount; // 0 when the bvh isn't prebaked
+		float error;
+		uint32_t reserved[3];
+	};
+
+	// consecutive triangles [first, first + count) and their bind pose bounds
+	struct TriangleCluster {
+		glm::vec3 min;
+		uint32_t first;
+		glm::vec3 max;
+		uint32_t count;
+	};
+
+	// matches cd::PackedVertex in the engine's Vertex.hpp, which packs older files the same way
+	struct PackedVertex {
+		uint16_t position[4];		// fraction of the vertex bounds * 65535
+		uint8_t boneIndices[4];		// 255 = no bone
+		uint8_t boneWeights[4];		// * 255, normalized to sum to 255 (0 for a vertex without bones)
+	};
+}
+
+void writeBinary(const AnimatedModel &model, const cd::AnimationClip &animation, const std::string &file_name);
+void readBinary(AnimatedModel &model, const std::string &file_name);
\ No newline at end of file
@@ -0,0 +1,585 @@
+#include "AnimatedModel.h"
+#include "Json.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#define GLB_FRAME_RATE 24.0 /* keyframes baked per second, as the fbx importer */
+
+using namespace cd;
+
+/*
+glTF 2.0 binary (.glb) import without the fbx sdk. The file is read once and every accessor is read in place
+from the binary chunk. All mesh primitives of the scene are merged into one indexed mesh, the joints of every
+skin become the model's bones and each animation is baked to keyframes of bone transforms as one clip.
+*/
+
+namespace {
+	const uint32_t GLB_MAGIC = 0x46546C67;	// "glTF"
+	const uint32_t CHUNK_JSON = 0x4E4F534A;	// "JSON"
+	const uint32_t CHUNK_BIN = 0x004E4942;	// "BIN\0"
+
+	const int COMPONENT_BYTE = 5120;
+	const int COMPONENT_UNSIGNED_BYTE = 5121;
+	const int COMPONENT_SHORT = 5122;
+	const int COMPONENT_UNSIGNED_SHORT = 5123;
+	const int COMPONENT_UNSIGNED_INT = 5125;
+	const int COMPONENT_FLOAT = 5126;
+
+	enum Interpolation { interpolation_linear, interpolation_step, interpolation_cubic };
+
+	// an accessor's elements in the binary chunk
+	struct Accessor {
+		const uint8_t *data = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		int components = 0;
+		int componentType = 0;
+		bool normalized = false;
+
+		// normalized integers as 0 - 1 (or -1 - 1), others as they are
+		float read(size_t element, int component) const {
+			const uint8_t *p = data + stride * element;
+			if (componentType == COMPONENT_FLOAT) {
+				float value;
+				memcpy(&value, p + sizeof(float) * component, sizeof(float));
+				return value;
+			} else if (componentType == COMPONENT_UNSIGNED_BYTE) {
+				uint8_t value = p[component];
+				return normalized ? value / 255.0f : value;
+			} else if (componentType == COMPONENT_BYTE) {
+				int8_t value = (int8_t)p[component];
+				return normalized ? std::max(value / 127.0f, -1.0f) : value;
+			} else if (componentType == COMPONENT_UNSIGNED_SHORT) {
+				uint16_t value;
+				memcpy(&value, p + sizeof(uint16_t) * component, sizeof(uint16_t));
+				return normalized ? value / 65535.0f : value;
+			} else if (componentType == COMPONENT_SHORT) {
+				int16_t value;
+				memcpy(&value, p + sizeof(int16_t) * component, sizeof(int16_t));
+				return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+			}
+			uint32_t value;
+			memcpy(&value, p + sizeof(uint32_t) * component, sizeof(uint32_t));
+			return (float)value;
+		}
+
+		uint32_t readIndex(size_t element, int component) const {
+			const uint8_t *p = data + stride * element;
+			if (componentType == COMPONENT_UNSIGNED_BYTE) return p[component];
+			if (componentType == COMPONENT_UNSIGNED_SHORT) {
+				uint16_t value;
+				memcpy(&value, p + sizeof(uint16_t) * component, sizeof(uint16_t));
+				return value;
+			}
+			uint32_t value;
+			memcpy(&value, p + sizeof(uint32_t) * component, sizeof(uint32_t));
+			return value;
+		}
+
+		glm::vec4 readVec(size_t element) const {
+			glm::vec4 value(0);
+			for (int c = 0; c < components && c < 4; c++)
+				value[c] = read(element, c);
+			return value;
+		}
+	};
+
+	struct Transform {
+		glm::vec3 translation = glm::vec3(0);
+		glm::quat rotation = glm::quat(1, 0, 0, 0);
+		glm::vec3 scale = glm::vec3(1);
+	};
+
+	struct Node {
+		std::string name;
+		int parent = -1;
+		int mesh = -1;
+		int skin = -1;
+		Transform local; // rest pose
+		bool animated = false; // an animation moves it or a parent
+	};
+
+	// keys of one animated property, cubic samplers hold (in tangent, value, out tangent) per key
+	struct Channel {
+		int node = -1;
+		int path = 0; // 0 translation, 1 rotation, 2 scale
+		Interpolation interpolation = interpolation_linear;
+		std::vector<float> times;
+		std::vector<glm::vec4> values;
+	};
+
+	struct BoneSource {
+		int node;
+		glm::mat4 inverseBind;
+	};
+
+	struct Gltf {
+		std::vector<uint8_t> file; // the binary chunk is read from here in place
+		const uint8_t *bin = nullptr;
+		size_t binBytes = 0;
+		Json json;
+
+		Accessor accessor(int index) const {
+			const Json &source = json["accessors"][index];
+			if (source.isNull()) throw std::runtime_error("glb: missing accessor " + std::to_string(index));
+			if (!source["sparse"].isNull()) throw std::runtime_error("glb: sparse accessors are not supported");
+
+			const Json &view = json["bufferViews"][source["bufferView"].asInt()];
+			if (view.isNull()) throw std::runtime_error("glb: accessor without a buffer view");
+			if (view["buffer"].asInt(0) != 0 || !json["buffers"][0]["uri"].isNull())
+				throw std::runtime_error("glb: external buffers are not supported");
+
+			Accessor accessor;
+			accessor.count = (size_t)source["count"].asNumber();
+			accessor.componentType = source["componentType"].asInt();
+			accessor.normalized = source["normalized"].boolean;
+			const std::string &type = source["type"].asString();
+			if (type == "SCALAR") accessor.components = 1;
+			else if (type == "VEC2") accessor.components = 2;
+			else if (type == "VEC3") accessor.components = 3;
+			else if (type == "VEC4") accessor.components = 4;
+			else if (type == "MAT4") accessor.components = 16;
+			else throw std::runtime_error("glb: unsupported accessor type " + type);
+
+			size_t componentBytes = 0;
+			if (accessor.componentType == COMPONENT_BYTE || accessor.componentType == COMPONENT_UNSIGNED_BYTE) componentBytes = 1;
+			else if (accessor.componentType == COMPONENT_SHORT || accessor.componentType == COMPONENT_UNSIGNED_SHORT) componentBytes = 2;
+			else if (accessor.componentType == COMPONENT_UNSIGNED_INT || accessor.componentType == COMPONENT_FLOAT) componentBytes = 4;
+			else throw std::runtime_error("glb: unsupported component type " + std::to_string(accessor.componentType));
+
+			size_t elementBytes = componentBytes * accessor.components;
+			size_t offset = (size_t)view["byteOffset"].asNumber() + (size_t)source["byteOffset"].asNumber();
+			accessor.stride = view["byteStride"].isNull() ? elementBytes : (size_t)view["byteStride"].asNumber();
+			size_t end = accessor.count == 0 ? offset : offset + accessor.stride * (accessor.count - 1) + elementBytes;
+			if (accessor.stride < elementBytes || binBytes < end || (size_t)view["byteOffset"].asNumber() + (size_t)view["byteLength"].asNumber() < end)
+				throw std::runtime_error("glb: accessor outside its buffer");
+			accessor.data = bin + offset;
+			return accessor;
+		}
+	};
+
+	void readGlb(const std::string &filePath, Gltf &gltf) {
+		std::ifstream input(filePath, std::ios::binary | std::ios::ate);
+		if (!input) throw std::runtime_error("glb: can't open " + filePath);
+		gltf.file.resize((size_t)input.tellg());
+		input.seekg(0);
+		input.read((char*) gltf.file.data(), gltf.file.size());
+
+		// header (magic, version, length) then chunks of (length, type, data)
+		uint32_t header[3];
+		if (gltf.file.size() < sizeof(header)) throw std::runtime_error("glb: truncated file");
+		memcpy(header, gltf.file.data(), sizeof(header));
+		if (header[0] != GLB_MAGIC) throw std::runtime_error("glb: not a binary gltf file");
+		if (header[1] != 2) throw std::runtime_error("glb: unsupported version " + std::to_string(header[1]));
+
+		const char *jsonText = nullptr;
+		size_t jsonBytes = 0;
+		size_t offset = sizeof(header);
+		size_t end = std::min<size_t>(header[2], gltf.file.size());
+		while (offset + 8 <= end) {
+			uint32_t chunk[2];
+			memcpy(chunk, gltf.file.data() + offset, sizeof(chunk));
+			offset += sizeof(chunk);
+			if (end - offset < chunk[0]) throw std::runtime_error("glb: truncated chunk");
+			if (chunk[1] == CHUNK_JSON && !jsonText) {
+				jsonText = (const char*) gltf.file.data() + offset;
+				jsonBytes = chunk[0];
+			} else if (chunk[1] == CHUNK_BIN && !gltf.bin) {
+				gltf.bin = gltf.file.data() + offset;
+				gltf.binBytes = chunk[0];
+			}
+			offset += (chunk[0] + 3) & ~3u;
+		}
+		if (!jsonText) throw std::runtime_error("glb: no json chunk");
+		gltf.json = Json::Parse(jsonText, jsonBytes);
+	}
+
+	glm::vec3 readVec3(const Json &array, glm::vec3 fallback) {
+		return array.size() == 3 ? glm::vec3(array[0].asNumber(), array[1].asNumber(), array[2].asNumber()) : fallback;
+	}
+
+	glm::mat4 compose(const glm::vec3 &translation, const glm::quat &rotation, const glm::vec3 &scale) {
+		glm::mat3 r = glm::mat3_cast(rotation);
+		glm::mat4 m(1);
+		m[0] = glm::vec4(r[0] * scale.x, 0);
+		m[1] = glm::vec4(r[1] * scale.y, 0);
+		m[2] = glm::vec4(r[2] * scale.z, 0);
+		m[3] = glm::vec4(translation, 1);
+		return m;
+	}
+
+	void decompose(const glm::mat4 &m, glm::vec3 &translation, glm::quat &rotation, glm::vec3 &scale) {
+		translation = glm::vec3(m[3]);
+		scale = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+		if (glm::determinant(glm::mat3(m)) < 0)
+			scale.x = -scale.x;
+		glm::mat3 r(glm::vec3(m[0]) / scale.x, glm::vec3(m[1]) / scale.y, glm::vec3(m[2]) / scale.z);
+		rotation = glm::normalize(glm::quat_cast(r));
+	}
+
+	glm::quat toQuat(const glm::vec4 &v) {
+		return glm::quat(v.w, v.x, v.y, v.z);
+	}
+
+	void readNodes(const Gltf &gltf, std::vector<Node> &nodes, std::vector<int> &order) {
+		const Json &source = gltf.json["nodes"];
+		nodes.assign(source.size(), Node());
+		for (size_t n = 0; n < nodes.size(); n++) {
+			const Json &json = source[n];
+			Node &node = nodes[n];
+			node.name = json["name"].asString();
+			node.mesh = json["mesh"].asInt();
+			node.skin = json["skin"].asInt();
+			if (json["matrix"].size() == 16) {
+				glm::mat4 matrix;
+				for (int i = 0; i < 16; i++)
+					matrix[i / 4][i % 4] = (float)json["matrix"][i].asNumber();
+				decompose(matrix, node.local.translation, node.local.rotation, node.local.scale);
+			} else {
+				node.local.translation = readVec3(json["translation"], glm::vec3(0));
+				node.local.scale = readVec3(json["scale"], glm::vec3(1));
+				const Json &rotation = json["rotation"];
+				if (rotation.size() == 4)
+					node.local.rotation = glm::normalize(toQuat(glm::vec4(rotation[0].asNumber(), rotation[1].asNumber(), rotation[2].asNumber(), rotation[3].asNumber())));
+			}
+		}
+		for (size_t n = 0; n < nodes.size(); n++) {
+			const Json &children = source[n]["children"];
+			for (size_t c = 0; c < children.size(); c++) {
+				int child = children[c].asInt();
+				if (child < 0 || (int)nodes.size() <= child || nodes[child].parent != -1 || child == (int)n)
+					throw std::runtime_error("glb: invalid node hierarchy");
+				nodes[child].parent = (int)n;
+			}
+		}
+
+		// parents before their children
+		order.clear();
+		std::vector<int> stack;
+		for (int n = (int)nodes.size() - 1; 0 <= n; n--) {
+			if (nodes[n].parent == -1)
+				stack.push_back(n);
+		}
+		while (!stack.empty()) {
+			int n = stack.back();
+			stack.pop_back();
+			order.push_back(n);
+			const Json &children = source[n]["children"];
+			for (size_t c = children.size(); 0 < c; c--)
+				stack.push_back(children[c - 1].asInt());
+		}
+		if (order.size() != nodes.size()) throw std::runtime_error("glb: node hierarchy has a cycle");
+	}
+
+	// the nodes in order, their parents must be in it before them
+	void globalTransforms(const std::vector<Node> &nodes, const std::vector<int> &order, const std::vector<Transform> &locals,
+			std::vector<glm::mat4> &globals) {
+		globals.resize(nodes.size());
+		for (int n : order) {
+			glm::mat4 local = compose(locals[n].translation, locals[n].rotation, locals[n].scale);
+			globals[n] = nodes[n].parent == -1 ? local : globals[nodes[n].parent] * local;
+		}
+	}
+
+	void readChannels(const Gltf &gltf, const Json &animation, size_t nodeCount, std::vector<Channel> &channels) {
+		const Json &samplers = animation["samplers"];
+		const Json &targets = animation["channels"];
+		for (size_t c = 0; c < targets.size(); c++) {
+			const Json &target = targets[c]["target"];
+			const Json &sampler = samplers[targets[c]["sampler"].asInt()];
+			const std::string &path = target["path"].asString();
+			Channel channel;
+			channel.node = target["node"].asInt();
+			if (channel.node < 0 || (int)nodeCount <= channel.node || sampler.isNull()) continue;
+			if (path == "translation") channel.path = 0;
+			else if (path == "rotation") channel.path = 1;
+			else if (path == "scale") channel.path = 2;
+			else {
+				JobLog() << "glb: skipping " << path << " channel" << std::endl;
+				continue;
+			}
+
+			const std::string &interpolation = sampler["interpolation"].asString();
+			if (interpolation == "STEP") channel.interpolation = interpolation_step;
+			else if (interpolation == "CUBICSPLINE") channel.interpolation = interpolation_cubic;
+
+			Accessor input = gltf.accessor(sampler["input"].asInt());
+			Accessor output = gltf.accessor(sampler["output"].asInt());
+			size_t perKey = channel.interpolation == interpolation_cubic ? 3 : 1;
+			if (input.count == 0 || output.count != input.count * perKey)
+				throw std::runtime_error("glb: sampler input and output counts differ");
+			for (size_t k = 0; k < input.count; k++)
+				channel.times.push_back(input.read(k, 0));
+			for (size_t k = 0; k < output.count; k++)
+				channel.values.push_back(output.readVec(k));
+			channels.push_back(channel);
+		}
+	}
+
+	// rotations are (x, y, z, w)
+	glm::vec4 sampleChannel(const Channel &channel, float time) {
+		const std::vector<float> &times = channel.times;
+		size_t perKey = channel.interpolation == interpolation_cubic ? 3 : 1;
+		size_t valueOffset = channel.interpolation == interpolation_cubic ? 1 : 0;
+		if (time <= times.front()) return channel.values[valueOffset];
+		if (times.back() <= time) return channel.values[perKey * (times.size() - 1) + valueOffset];
+
+		size_t k1 = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+		size_t k0 = k1 - 1;
+		float span = times[k1] - times[k0];
+		float f = span > 0 ? (time - times[k0]) / span : 0;
+
+		glm::vec4 value;
+		if (channel.interpolation == interpolation_step) {
+			value = channel.values[k0];
+		} else if (channel.interpolation == interpolation_cubic) {
+			// hermite between the values with the keys' out and in tangents
+			float f2 = f * f, f3 = f2 * f;
+			value = (2 * f3 - 3 * f2 + 1) * channel.values[3 * k0 + 1] + (f3 - 2 * f2 + f) * span * channel.values[3 * k0 + 2]
+				+ (-2 * f3 + 3 * f2) * channel.values[3 * k1 + 1] + (f3 - f2) * span * channel.values[3 * k1];
+		} else if (channel.path == 1) {
+			glm::quat q = glm::slerp(toQuat(channel.values[k0]), toQuat(channel.values[k1]), f);
+			return glm::vec4(q.x, q.y, q.z, q.w);
+		} else {
+			value = glm::mix(channel.values[k0], channel.values[k1], f);
+		}
+		return value;
+	}
+}
+
+void AnimatedModel::loadGLB(std::string filePath) {
+	JobLog() << "starting glb read..." << std::endl;
+	auto stageStart = std::chrono::steady_clock::now();
+	times = StageTimes();
+	Gltf gltf;
+	readGlb(filePath, gltf);
+
+	std::vector<Node> nodes;
+	std::vector<int> order;
+	readNodes(gltf, nodes, order);
+
+	const Json &animations = gltf.json["animations"];
+	for (size_t a = 0; a < animations.size(); a++) {
+		const Json &channels = animations[a]["channels"];
+		for (size_t c = 0; c < channels.size(); c++) {
+			int node = channels[c]["target"]["node"].asInt();
+			if (0 <= node && node < (int)nodes.size())
+				nodes[node].animated = true;
+		}
+	}
+	for (int n : order) {
+		if (nodes[n].parent != -1 && nodes[nodes[n].parent].animated)
+			nodes[n].animated = true;
+	}
+
+	std::vector<Transform> restLocals;
+	for (const Node &node : nodes)
+		restLocals.push_back(node.local);
+	std::vector<glm::mat4> restGlobals;
+	globalTransforms(nodes, order, restLocals, restGlobals);
+
+	vertices.clear();
+	indices.clear();
+	clips.clear();
+	bones.clear();
+
+	times.import += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
+	// a bone per (node, inverse bind) pair, skins sharing a joint with the same bind share the bone
+	std::vector<BoneSource> boneSources;
+	auto boneIndex = [&](int node, const glm::mat4 &inverseBind) {
+		for (size_t b = 0; b < boneSources.size(); b++) {
+			if (boneSources[b].node == node && boneSources[b].inverseBind == inverseBind)
+				return (int)b;
+		}
+		if (boneSources.size() >= MAX_BONES) throw std::runtime_error("too many bones");
+		boneSources.push_back({ node, inverseBind });
+		return (int)boneSources.size() - 1;
+	};
+
+	// skin joints to bones
+	const Json &skins = gltf.json["skins"];
+	std::vector<std::vector<int>> skinBones(skins.size());
+	for (size_t s = 0; s < skins.size(); s++) {
+		const Json &joints = skins[s]["joints"];
+		Accessor inverseBinds;
+		if (!skins[s]["inverseBindMatrices"].isNull()) {
+			inverseBinds = gltf.accessor(skins[s]["inverseBindMatrices"].asInt());
+			if (inverseBinds.components != 16 || inverseBinds.count < joints.size())
+				throw std::runtime_error("glb: bad inverse bind matrices");
+		}
+		for (size_t j = 0; j < joints.size(); j++) {
+			int node = joints[j].asInt();
+			if (node < 0 || (int)nodes.size() <= node) throw std::runtime_error("glb: bad skin joint");
+			glm::mat4 inverseBind(1);
+			if (inverseBinds.data) {
+				for (int i = 0; i < 16; i++)
+					inverseBind[i / 4][i % 4] = inverseBinds.read(j, i);
+			}
+			skinBones[s].push_back(boneIndex(node, inverseBind));
+		}
+	}
+
+	times.skin += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
+	// MESH PROCESSING
+
+	const Json &meshes = gltf.json["meshes"];
+	for (int n : order) {
+		const Node &node = nodes[n];
+		const Json &mesh = meshes[node.mesh];
+		if (node.mesh < 0 || mesh.isNull()) continue;
+
+		// skinned vertices are in bind space, rigid meshes under an animated node follow it as a bone
+		bool skinned = 0 <= node.skin && node.skin < (int)skinBones.size();
+		int rigidBone = !skinned && node.animated ? boneIndex(n, glm::inverse(restGlobals[n])) : -1;
+		JobLog() << "mesh name = " << mesh["name"].asString() << (skinned ? " (skinned)" : rigidBone != -1 ? " (rigid)" : "") << std::endl;
+
+		const Json &primitives = mesh["primitives"];
+		for (size_t p = 0; p < primitives.size(); p++) {
+			const Json &primitive = primitives[p];
+			const Json &attributes = primitive["attributes"];
+			if (primitive["mode"].asInt(4) != 4 || attributes["POSITION"].isNull()) {
+				JobLog() << "glb: skipping a primitive that isn't triangles" << std::endl;
+				continue;
+			}
+
+			uint32_t baseVertex = (uint32_t)vertices.size();
+			Accessor positions = gltf.accessor(attributes["POSITION"].asInt());
+			Accessor joints, weights;
+			if (skinned && !attributes["JOINTS_0"].isNull() && !attributes["WEIGHTS_0"].isNull()) {
+				joints = gltf.accessor(attributes["JOINTS_0"].asInt());
+				weights = gltf.accessor(attributes["WEIGHTS_0"].asInt());
+				if (joints.count != positions.count || weights.count != positions.count)
+					throw std::runtime_error("glb: skin attribute counts differ");
+			}
+
+			for (size_t v = 0; v < positions.count; v++) {
+				Vertex vertex;
+				glm::vec4 position = glm::vec4(glm::vec3(positions.readVec(v)), 1);
+				vertex.position = glm::vec4(glm::vec3(skinned ? position : restGlobals[n] * position), 0);
+				if (joints.data) {
+					int w = 0;
+					for (int b = 0; b < 4; b++) {
+						uint32_t joint = joints.readIndex(v, b);
+						float weight = weights.read(v, b);
+						if (weight <= 0) continue;
+						if (skinBones[node.skin].size() <= joint) throw std::runtime_error("glb: vertex joint outside its skin");
+						vertex.boneIndices[w] = skinBones[node.skin][joint];
+						vertex.boneWeights[w] = weight;
+						w++;
+					}
+				} else if (rigidBone != -1) {
+					vertex.boneIndices[0] = rigidBone;
+					vertex.boneWeights[0] = 1;
+				}
+				vertices.push_back(vertex);
+			}
+
+			if (primitive["indices"].isNull()) {
+				for (uint32_t t = 0; t + 2 < positions.count; t += 3)
+					indices.push_back(glm::uvec3(baseVertex + t, baseVertex + t + 1, baseVertex + t + 2));
+			} else {
+				Accessor triangles = gltf.accessor(primitive["indices"].asInt());
+				for (size_t t = 0; t + 2 < triangles.count; t += 3) {
+					glm::uvec3 triangle(triangles.readIndex(t, 0), triangles.readIndex(t + 1, 0), triangles.readIndex(t + 2, 0));
+					if (positions.count <= glm::max(triangle.x, glm::max(triangle.y, triangle.z)))
+						throw std::runtime_error("glb: index outside its primitive");
+					indices.push_back(glm::uvec3(baseVertex) + triangle);
+				}
+			}
+		}
+	}
+	if (indices.empty()) throw std::runtime_error("glb: no triangles found");
+	times.import += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
+	// SKELETON PROCESSING
+
+	boneCount = (uint32_t)boneSources.size();
+	for (const BoneSource &source : boneSources) {
+		Bone bone;
+		bone.name = nodes[source.node].name;
+		bone.bindPose = glm::inverse(source.inverseBind);
+		for (int parent = nodes[source.node].parent; parent != -1 && bone.parentIndex == -1; parent = nodes[parent].parent) {
+			for (size_t b = 0; b < boneSources.size(); b++) {
+				if (boneSources[b].node == parent)
+					bone.parentIndex = (int)b;
+			}
+		}
+		bones.push_back(bone);
+	}
+
+	times.skin += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
+	// ANIMATION PROCESSING
+
+	// only the bones and their parents are posed
+	std::vector<bool> posed(nodes.size(), false);
+	for (const BoneSource &source : boneSources) {
+		for (int n = source.node; n != -1 && !posed[n]; n = nodes[n].parent)
+			posed[n] = true;
+	}
+	std::vector<int> posedOrder;
+	for (int n : order) {
+		if (posed[n])
+			posedOrder.push_back(n);
+	}
+
+	// a rest pose clip for models without animations
+	size_t clipCount = std::max<size_t>(animations.size(), 1);
+	for (size_t a = 0; a < clipCount; a++) {
+		AnimationClip clip;
+		std::vector<Channel> channels;
+		if (animations.size() == 0) {
+			clip.name = "rest";
+		} else {
+			clip.name = animations[a]["name"].asString();
+			if (clip.name.empty()) clip.name = "clip" + std::to_string(a);
+			readChannels(gltf, animations[a], nodes.size(), channels);
+		}
+		for (const Channel &channel : channels)
+			clip.duration = std::max(clip.duration, (double)channel.times.back());
+
+		// keyframes at the frame rate and the end of the clip, every frame is independent so they're baked in parallel
+		size_t frameCount = (size_t)std::ceil(clip.duration * GLB_FRAME_RATE - 1e-6) + 1;
+		clip.keyframes.resize(frameCount);
+		ParallelFor(frameCount, bakeThreads, [&](size_t f) {
+			Keyframe &keyframe = clip.keyframes[f];
+			keyframe.time = std::min(f / GLB_FRAME_RATE, clip.duration);
+
+			std::vector<Transform> pose = restLocals;
+			for (const Channel &channel : channels) {
+				if (!posed[channel.node]) continue;
+				glm::vec4 value = sampleChannel(channel, (float)keyframe.time);
+				if (channel.path == 0) pose[channel.node].translation = glm::vec3(value);
+				else if (channel.path == 1) pose[channel.node].rotation = glm::normalize(toQuat(value));
+				else pose[channel.node].scale = glm::vec3(value);
+			}
+			std::vector<glm::mat4> globals;
+			globalTransforms(nodes, posedOrder, pose, globals);
+
+			for (size_t b = 0; b < boneSources.size(); b++)
+				keyframe.boneTransforms[b] = globals[boneSources[b].node] * boneSources[b].inverseBind;
+		});
+
+		JobLog() << "clip " << clip.name << ": " << clip.duration << " s, " << clip.keyframes.size() << " keyframes" << std::endl;
+		clips.push_back(clip);
+	}
+	times.bake += SecondsSince(stageStart);
+
+	JobLog() << "unique vertices = " << vertices.size() << ", triangles = " << indices.size() << ", bones = " << boneCount << std::endl;
+}
+
+/*
+glTF 2.0 specification: https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html
+*/
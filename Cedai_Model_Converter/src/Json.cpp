@@ -0,0 +1,171 @@
+#include "Json.h"
+
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+	const cd::Json s_Null;
+
+	struct Parser {
+		const char *p;
+		const char *end;
+
+		void fail(const char *what) {
+			throw std::runtime_error(std::string("json parse: ") + what);
+		}
+
+		void skipSpace() {
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+				p++;
+		}
+
+		bool consume(const char *word) {
+			size_t length = strlen(word);
+			if ((size_t)(end - p) < length || strncmp(p, word, length) != 0) return false;
+			p += length;
+			return true;
+		}
+
+		void appendUtf8(std::string &out, unsigned code) {
+			if (code < 0x80) {
+				out += (char)code;
+			} else if (code < 0x800) {
+				out += (char)(0xC0 | code >> 6);
+				out += (char)(0x80 | (code & 0x3F));
+			} else if (code < 0x10000) {
+				out += (char)(0xE0 | code >> 12);
+				out += (char)(0x80 | (code >> 6 & 0x3F));
+				out += (char)(0x80 | (code & 0x3F));
+			} else {
+				out += (char)(0xF0 | code >> 18);
+				out += (char)(0x80 | (code >> 12 & 0x3F));
+				out += (char)(0x80 | (code >> 6 & 0x3F));
+				out += (char)(0x80 | (code & 0x3F));
+			}
+		}
+
+		unsigned hex4() {
+			if (end - p < 4) fail("short unicode escape");
+			unsigned code = 0;
+			for (int i = 0; i < 4; i++, p++) {
+				char c = *p;
+				code <<= 4;
+				if ('0' <= c && c <= '9') code |= c - '0';
+				else if ('a' <= c && c <= 'f') code |= c - 'a' + 10;
+				else if ('A' <= c && c <= 'F') code |= c - 'A' + 10;
+				else fail("bad unicode escape");
+			}
+			return code;
+		}
+
+		std::string parseString() {
+			if (p == end || *p != '"') fail("expected string");
+			p++;
+			std::string out;
+			while (p < end && *p != '"') {
+				char c = *p++;
+				if (c != '\\') {
+					out += c;
+					continue;
+				}
+				if (p == end) break;
+				c = *p++;
+				if (c == 'n') out += '\n';
+				else if (c == 't') out += '\t';
+				else if (c == 'r') out += '\r';
+				else if (c == 'b') out += '\b';
+				else if (c == 'f') out += '\f';
+				else if (c == 'u') {
+					unsigned code = hex4();
+					// surrogate pair
+					if (0xD800 <= code && code < 0xDC00 && consume("\\u"))
+						code = 0x10000 + ((code - 0xD800) << 10) + (hex4() - 0xDC00);
+					appendUtf8(out, code);
+				} else out += c; // \" \\ \/
+			}
+			if (p == end) fail("unterminated string");
+			p++;
+			return out;
+		}
+
+		void parseValue(cd::Json &value, int depth) {
+			if (depth > 256) fail("nested too deep");
+			skipSpace();
+			if (p == end) fail("unexpected end");
+
+			if (*p == '{') {
+				p++;
+				value.type = cd::Json::object_value;
+				skipSpace();
+				if (p < end && *p == '}') { p++; return; }
+				while (true) {
+					skipSpace();
+					value.object.emplace_back(parseString(), cd::Json());
+					skipSpace();
+					if (p == end || *p++ != ':') fail("expected ':'");
+					parseValue(value.object.back().second, depth + 1);
+					skipSpace();
+					if (p < end && *p == ',') { p++; continue; }
+					if (p < end && *p == '}') { p++; return; }
+					fail("expected ',' or '}'");
+				}
+			} else if (*p == '[') {
+				p++;
+				value.type = cd::Json::array_value;
+				skipSpace();
+				if (p < end && *p == ']') { p++; return; }
+				while (true) {
+					value.array.emplace_back();
+					parseValue(value.array.back(), depth + 1);
+					skipSpace();
+					if (p < end && *p == ',') { p++; continue; }
+					if (p < end && *p == ']') { p++; return; }
+					fail("expected ',' or ']'");
+				}
+			} else if (*p == '"') {
+				value.type = cd::Json::string_value;
+				value.string = parseString();
+			} else if (consume("true")) {
+				value.type = cd::Json::bool_value;
+				value.boolean = true;
+			} else if (consume("false")) {
+				value.type = cd::Json::bool_value;
+			} else if (consume("null")) {
+				value.type = cd::Json::null_value;
+			} else {
+				// strtod needs a terminated string, numbers are short
+				char buffer[64];
+				size_t length = 0;
+				while (p + length < end && length < sizeof(buffer) - 1 && strchr("+-.eE0123456789", p[length]))
+					length++;
+				memcpy(buffer, p, length);
+				buffer[length] = 0;
+				char *parsed;
+				value.number = strtod(buffer, &parsed);
+				if (parsed == buffer) fail("unexpected character");
+				value.type = cd::Json::number_value;
+				p += parsed - buffer;
+			}
+		}
+	};
+}
+
+const cd::Json &cd::Json::operator[](const std::string &key) const {
+	for (const auto &member : object) {
+		if (member.first == key)
+			return member.second;
+	}
+	return s_Null;
+}
+
+const cd::Json &cd::Json::operator[](size_t index) const {
+	return index < array.size() ? array[index] : s_Null;
+}
+
+cd::Json cd::Json::Parse(const char *text, size_t length) {
+	Parser parser = { text, text + length };
+	Json root;
+	parser.parseValue(root, 0);
+	return root;
+}
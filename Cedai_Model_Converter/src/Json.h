@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace cd {
+	/*
+	A parsed json value, enough for gltf: lookups of missing keys or indices return a null value so optional
+	properties read with a fallback instead of a check at every level.
+	*/
+	struct Json {
+		enum Type { null_value, bool_value, number_value, string_value, array_value, object_value };
+
+		Type type = null_value;
+		bool boolean = false;
+		double number = 0;
+		std::string string;
+		std::vector<Json> array;
+		std::vector<std::pair<std::string, Json>> object;
+
+		const Json &operator[](const std::string &key) const;
+		const Json &operator[](size_t index) const;
+		inline bool isNull() const { return type == null_value; }
+		inline size_t size() const { return type == array_value ? array.size() : type == object_value ? object.size() : 0; }
+		inline double asNumber(double fallback = 0) const { return type == number_value ? number : fallback; }
+		inline int asInt(int fallback = -1) const { return type == number_value ? (int)number : fallback; }
+		inline const std::string &asString() const { return string; }
+
+		static Json Parse(const char *text, size_t length); // throws std::runtime_error on malformed json
+	};
+}
@@ -0,0 +1,155 @@
+#include "KeyframeReduction.h"
+
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	struct BonePose {
+		glm::quat rotation;
+		glm::vec3 translation;
+		glm::vec3 scale;
+	};
+
+	// as the engine's CompressClip
+	BonePose decompose(const glm::mat4 &m) {
+		BonePose pose;
+		pose.translation = glm::vec3(m[3]);
+		pose.scale = glm::vec3(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2])));
+		if (glm::determinant(glm::mat3(m)) < 0)
+			pose.scale.x = -pose.scale.x;
+		glm::mat3 r(glm::vec3(m[0]) / pose.scale.x, glm::vec3(m[1]) / pose.scale.y, glm::vec3(m[2]) / pose.scale.z);
+		pose.rotation = glm::normalize(glm::quat_cast(r));
+		return pose;
+	}
+
+	glm::mat4 interpolate(const BonePose &a, const BonePose &b, float f) {
+		glm::mat3 r = glm::mat3_cast(glm::slerp(a.rotation, b.rotation, f));
+		glm::vec3 scale = glm::mix(a.scale, b.scale, f);
+		glm::mat4 m;
+		m[0] = glm::vec4(r[0] * scale.x, 0);
+		m[1] = glm::vec4(r[1] * scale.y, 0);
+		m[2] = glm::vec4(r[2] * scale.z, 0);
+		m[3] = glm::vec4(glm::mix(a.translation, b.translation, f), 1);
+		return m;
+	}
+
+	// vertices a bone moves lie within radius of center
+	struct BoneReach {
+		glm::vec3 min = glm::vec3(INFINITY);
+		glm::vec3 max = glm::vec3(-INFINITY);
+		glm::vec3 center = glm::vec3(0);
+		float radius = 0;
+	};
+
+	// furthest any point of the reach moves between the two transforms
+	float distanceBound(const glm::mat4 &a, const glm::mat4 &b, const BoneReach &reach) {
+		float linear = 0;
+		for (int c = 0; c < 3; c++) {
+			glm::vec3 d = glm::vec3(a[c] - b[c]);
+			linear += glm::dot(d, d);
+		}
+		return std::sqrt(linear) * reach.radius + glm::length(glm::vec3((a - b) * glm::vec4(reach.center, 1)));
+	}
+
+	// as the skinning kernel: weighted bones, the remaining weight keeps the bind position
+	glm::vec3 skin(const cd::Vertex &vertex, const glm::mat4 *palette) {
+		glm::mat4 animation(0.0f);
+		float weightRemaining = 1;
+		for (int b = 0; b < 4; b++) {
+			if (0 <= vertex.boneIndices[b] && vertex.boneIndices[b] < MAX_BONES) {
+				animation += palette[vertex.boneIndices[b]] * vertex.boneWeights[b];
+				weightRemaining -= vertex.boneWeights[b];
+			}
+		}
+		animation += glm::mat4(1.0f) * glm::clamp(weightRemaining, 0.0f, 1.0f);
+		return glm::vec3(animation * glm::vec4(glm::vec3(vertex.position), 1));
+	}
+}
+
+float cd::ReduceKeyframes(AnimationClip &clip, const std::vector<Vertex> &vertices, uint32_t boneCount, float tolerance) {
+	size_t keyframeCount = clip.keyframes.size();
+	if (keyframeCount < 3) return 0;
+
+	// the bones that move a vertex, with a sphere around the vertices each moves
+	std::vector<uint32_t> used;
+	std::vector<BoneReach> reach(boneCount);
+	float maxWeight = 1;
+	for (int pass = 0; pass < 2; pass++) {
+		for (const Vertex &vertex : vertices) {
+			float weight = 0;
+			for (int b = 0; b < 4; b++) {
+				int bone = vertex.boneIndices[b];
+				if (bone < 0 || (int)boneCount <= bone || vertex.boneWeights[b] <= 0) continue;
+				glm::vec3 position = glm::vec3(vertex.position);
+				if (pass == 0) {
+					reach[bone].min = glm::min(reach[bone].min, position);
+					reach[bone].max = glm::max(reach[bone].max, position);
+				} else {
+					reach[bone].radius = std::max(reach[bone].radius, glm::length(position - reach[bone].center));
+				}
+				weight += vertex.boneWeights[b];
+			}
+			maxWeight = std::max(maxWeight, weight);
+		}
+		if (pass == 0) {
+			for (BoneReach &bone : reach)
+				bone.center = (bone.min + bone.max) * 0.5f;
+		}
+	}
+	for (uint32_t b = 0; b < boneCount; b++) {
+		if (reach[b].min.x <= reach[b].max.x)
+			used.push_back(b);
+	}
+
+	std::vector<BonePose> poses(keyframeCount * boneCount);
+	for (size_t k = 0; k < keyframeCount; k++) {
+		for (uint32_t b : used)
+			poses[k * boneCount + b] = decompose(clip.keyframes[k].boneTransforms[b]);
+	}
+
+	// a vertex moves at most its largest bone error (times its total weight), so each bone is checked alone
+	auto segmentFits = [&](size_t first, size_t last) {
+		double span = clip.keyframes[last].time - clip.keyframes[first].time;
+		for (size_t k = first + 1; k < last; k++) {
+			float f = span > 0 ? (float)((clip.keyframes[k].time - clip.keyframes[first].time) / span) : 0;
+			for (uint32_t b : used) {
+				glm::mat4 m = interpolate(poses[first * boneCount + b], poses[last * boneCount + b], f);
+				if (tolerance < distanceBound(m, clip.keyframes[k].boneTransforms[b], reach[b]) * maxWeight)
+					return false;
+			}
+		}
+		return true;
+	};
+
+	// each kept keyframe reaches as far as it can to the next
+	std::vector<size_t> kept = { 0 };
+	while (kept.back() + 1 < keyframeCount) {
+		size_t last = kept.back() + 1;
+		while (last + 1 < keyframeCount && segmentFits(kept.back(), last + 1))
+			last++;
+		kept.push_back(last);
+	}
+
+	// the error the engine will see, skinning every vertex at every original keyframe
+	float maxError = 0;
+	std::vector<glm::mat4> palette(MAX_BONES, glm::mat4(1.0f));
+	size_t segment = 0;
+	for (size_t k = 0; k < keyframeCount; k++) {
+		while (kept[segment + 1] < k)
+			segment++;
+		size_t first = kept[segment], last = kept[segment + 1];
+		double span = clip.keyframes[last].time - clip.keyframes[first].time;
+		float f = span > 0 ? (float)((clip.keyframes[k].time - clip.keyframes[first].time) / span) : 0;
+		for (uint32_t b : used)
+			palette[b] = interpolate(poses[first * boneCount + b], poses[last * boneCount + b], f);
+		for (const Vertex &vertex : vertices)
+			maxError = std::max(maxError, glm::length(skin(vertex, palette.data()) - skin(vertex, clip.keyframes[k].boneTransforms.data())));
+	}
+
+	std::vector<Keyframe> keyframes;
+	for (size_t k : kept)
+		keyframes.push_back(clip.keyframes[k]);
+	clip.keyframes.swap(keyframes);
+	return maxError;
+}
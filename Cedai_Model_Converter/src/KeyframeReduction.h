@@ -0,0 +1,12 @@
+#pragma once
+#include "AnimatedModel.h"
+
+namespace cd {
+	/*
+	Drops the keyframes the engine rebuilds from their kept neighbours (slerped rotation, lerped translation and
+	scale, as its CompressedClip) with no skinned vertex moving further than tolerance. Keyframes are shared by
+	every bone in the file so one is only dropped when all the bones that move a vertex allow it. Returns the
+	largest skinned vertex error over the original keyframes.
+	*/
+	float ReduceKeyframes(AnimationClip &clip, const std::vector<Vertex> &vertices, uint32_t boneCount, float tolerance);
+}
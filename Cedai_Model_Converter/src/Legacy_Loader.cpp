@@ -0,0 +1,123 @@
+#include "AnimatedModel.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <map>
+#include <cstring>
+
+using namespace cd;
+
+/*
+Import of the engine's older model files (version 0 to 2), so models whose source is lost can be converted again.
+Version 0 holds a static mesh (vec4 positions, uvec4 polygons of which xyz index the vertices) and gets a rest clip,
+version 1 three vertices per triangle, welded here, and version 2 indexed vertices. Versions 1 and 2 store MAX_BONES
+transforms per keyframe, only the bones the vertices use are kept.
+*/
+
+namespace {
+	struct VertexLess {
+		bool operator()(const Vertex &a, const Vertex &b) const { return std::memcmp(&a, &b, sizeof(Vertex)) < 0; }
+	};
+
+	template <typename T>
+	void read(std::ifstream &input, T *data, size_t count = 1) {
+		input.read((char *)data, sizeof(T) * count);
+		if (!input) throw std::runtime_error("legacy binary: file truncated");
+	}
+}
+
+uint16_t cd::LegacyVersion(const std::string &filePath) {
+	uint16_t version = UINT16_MAX;
+	std::ifstream input(filePath, std::ios::binary);
+	input.read((char *)&version, sizeof(uint16_t));
+	return input && version <= 2 ? version : UINT16_MAX;
+}
+
+void AnimatedModel::loadLegacy(std::string filePath) {
+	auto stageStart = std::chrono::steady_clock::now();
+	std::ifstream input(filePath, std::ios::binary);
+	if (!input) throw std::runtime_error("legacy binary: can't open " + filePath);
+
+	vertices.clear();
+	indices.clear();
+	clips.clear();
+	bones.clear();
+
+	uint16_t version;
+	read(input, &version);
+	AnimationClip clip;
+	clip.name = "rest";
+
+	if (version == 0) {
+		uint32_t num_vertices, num_polygons;
+		read(input, &num_vertices);
+		read(input, &num_polygons);
+		std::vector<glm::vec4> positions(num_vertices);
+		std::vector<glm::uvec4> polygons(num_polygons);
+		read(input, positions.data(), num_vertices);
+		read(input, polygons.data(), num_polygons);
+
+		for (const glm::vec4 &position : positions) {
+			Vertex vertex;
+			vertex.position = glm::vec4(glm::vec3(position), 1);
+			vertices.push_back(vertex);
+		}
+		for (const glm::uvec4 &polygon : polygons)
+			indices.push_back(glm::uvec3(polygon));
+		clip.keyframes.resize(1);
+	} else if (version == 1 || version == 2) {
+		uint32_t num_vertices, num_triangles = 0, num_keyframes, num_bones;
+		read(input, &num_vertices);
+		if (version == 2)
+			read(input, &num_triangles);
+		read(input, &num_keyframes);
+		read(input, &num_bones);
+		if (num_bones != MAX_BONES) throw std::runtime_error("legacy binary: incompatible bone count");
+
+		std::vector<Vertex> stored(num_vertices);
+		read(input, stored.data(), num_vertices);
+		if (version == 1) {
+			// identical copies become one indexed vertex
+			std::map<Vertex, uint32_t, VertexLess> unique;
+			indices.resize(num_vertices / 3);
+			for (size_t c = 0; c < indices.size() * 3; c++) {
+				auto found = unique.emplace(stored[c], (uint32_t)vertices.size());
+				if (found.second)
+					vertices.push_back(stored[c]);
+				indices[c / 3][c % 3] = found.first->second;
+			}
+		} else {
+			vertices.swap(stored);
+			indices.resize(num_triangles);
+			read(input, indices.data(), num_triangles);
+		}
+		read(input, &clip.duration);
+		clip.keyframes.resize(num_keyframes);
+		read(input, clip.keyframes.data(), num_keyframes);
+		clip.name = "animation";
+	} else {
+		throw std::runtime_error("legacy binary: unsupported version " + std::to_string(version));
+	}
+	for (const glm::uvec3 &triangle : indices) {
+		if (vertices.size() <= glm::max(triangle.x, glm::max(triangle.y, triangle.z)))
+			throw std::runtime_error("legacy binary: triangle index out of range");
+	}
+	if (indices.empty()) throw std::runtime_error("legacy binary: no triangles found");
+	times.import += SecondsSince(stageStart);
+	stageStart = std::chrono::steady_clock::now();
+
+	// the bones up to the last one a vertex is weighted to
+	boneCount = 0;
+	for (const Vertex &vertex : vertices) {
+		for (int b = 0; b < 4; b++) {
+			if (0 <= vertex.boneIndices[b] && vertex.boneIndices[b] < MAX_BONES && vertex.boneWeights[b] > 0)
+				boneCount = std::max(boneCount, (uint32_t)vertex.boneIndices[b] + 1);
+		}
+	}
+	clips.push_back(clip);
+	times.skin += SecondsSince(stageStart);
+
+	JobLog() << "version " << version << " binary: unique vertices = " << vertices.size() << ", triangles = " << indices.size()
+		<< ", bones = " << boneCount << ", keyframes = " << clip.keyframes.size() << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "Lz.h"
+
+#include <cstring>
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+#define LZ_LAST_LITERALS 5	/* the block ends with at least this many literals */
+#define LZ_MATCH_LIMIT 12	/* no match starts in the last bytes */
+
+namespace {
+	void writeLength(std::vector<uint8_t> &out, size_t length) {
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back((uint8_t)length);
+	}
+
+	void writeSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t literalCount, size_t offset, size_t match) {
+		size_t matchCode = match ? match - LZ_MIN_MATCH : 0;
+		out.push_back((uint8_t)((literalCount < 15 ? literalCount : 15) << 4 | (matchCode < 15 ? matchCode : 15)));
+		if (literalCount >= 15)
+			writeLength(out, literalCount - 15);
+		out.insert(out.end(), literals, literals + literalCount);
+		if (!match) return;
+		out.push_back((uint8_t)(offset & 255));
+		out.push_back((uint8_t)(offset >> 8));
+		if (matchCode >= 15)
+			writeLength(out, matchCode - 15);
+	}
+
+	bool readLength(const uint8_t *&ip, const uint8_t *end, size_t &length) {
+		if (length != 15) return true;
+		uint8_t add;
+		do {
+			if (ip == end) return false;
+			add = *ip++;
+			length += add;
+		} while (add == 255);
+		return true;
+	}
+}
+
+// greedy single probe hash matching, the sections are small and written once
+void cd::LzCompress(const uint8_t *src, size_t size, std::vector<uint8_t> &out) {
+	std::vector<int64_t> table(1 << LZ_HASH_BITS, -1);
+	size_t anchor = 0;
+	size_t ip = 0;
+
+	while (size >= LZ_MATCH_LIMIT && ip < size - LZ_MATCH_LIMIT) {
+		uint32_t sequence;
+		std::memcpy(&sequence, src + ip, sizeof(uint32_t));
+		uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+		int64_t ref = table[hash];
+		table[hash] = (int64_t)ip;
+		if (ref < 0 || ip - ref > LZ_MAX_OFFSET || std::memcmp(src + ref, src + ip, LZ_MIN_MATCH)) {
+			ip++;
+			continue;
+		}
+
+		size_t match = LZ_MIN_MATCH;
+		while (ip + match < size - LZ_LAST_LITERALS && src[ref + match] == src[ip + match])
+			match++;
+		writeSequence(out, src + anchor, ip - anchor, ip - ref, match);
+		ip += match;
+		anchor = ip;
+	}
+	writeSequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+bool cd::LzDecompress(const uint8_t *src, size_t srcBytes, uint8_t *dst, size_t dstBytes) {
+	const uint8_t *ip = src;
+	const uint8_t *end = src + srcBytes;
+	uint8_t *op = dst;
+	uint8_t *dstEnd = dst + dstBytes;
+
+	while (ip < end) {
+		uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (!readLength(ip, end, literals) || (size_t)(end - ip) < literals || (size_t)(dstEnd - op) < literals)
+			return false;
+		std::memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+		if (ip == end) break;
+
+		if (end - ip < 2) return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		size_t match = token & 15;
+		if (!readLength(ip, end, match)) return false;
+		match += LZ_MIN_MATCH;
+		if (offset == 0 || (size_t)(op - dst) < offset || (size_t)(dstEnd - op) < match)
+			return false;
+
+		const uint8_t *from = op - offset;
+		for (size_t i = 0; i < match; i++)
+			op[i] = from[i];
+		op += match;
+	}
+	return op == dstEnd;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace cd {
+	// lz4 block format, decoded by LzDecompress here and in the engine (model/Lz.cpp)
+	void LzCompress(const uint8_t *src, size_t size, std::vector<uint8_t> &out); // appends one block to out
+	bool LzDecompress(const uint8_t *src, size_t srcBytes, uint8_t *dst, size_t dstBytes);
+}
@@ -0,0 +1,117 @@
+#include "MeshOrder.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// the lowest 10 bits of value spread to every third bit
+	uint32_t spreadBits(uint32_t value) {
+		value &= 0x3FF;
+		value = (value | value << 16) & 0x030000FF;
+		value = (value | value << 8) & 0x0300F00F;
+		value = (value | value << 4) & 0x030C30C3;
+		value = (value | value << 2) & 0x09249249;
+		return value;
+	}
+
+	glm::vec3 centroid(const std::vector<cd::Vertex> &vertices, const glm::uvec3 &triangle) {
+		return (glm::vec3(vertices[triangle.x].position) + glm::vec3(vertices[triangle.y].position) + glm::vec3(vertices[triangle.z].position)) / 3.0f;
+	}
+
+	// 30 bit codes of the centroids on a cubic grid over their bounds
+	std::vector<uint32_t> mortonCodes(const std::vector<cd::Vertex> &vertices, const std::vector<glm::uvec3> &indices) {
+		glm::vec3 min(INFINITY), max(-INFINITY);
+		for (const glm::uvec3 &triangle : indices) {
+			min = glm::min(min, centroid(vertices, triangle));
+			max = glm::max(max, centroid(vertices, triangle));
+		}
+		float extent = glm::max(max.x - min.x, glm::max(max.y - min.y, max.z - min.z));
+		float scale = extent > 0 ? 1023.0f / extent : 0;
+
+		std::vector<uint32_t> codes(indices.size());
+		for (size_t t = 0; t < indices.size(); t++) {
+			glm::uvec3 cell = glm::uvec3(glm::clamp((centroid(vertices, indices[t]) - min) * scale, glm::vec3(0), glm::vec3(1023)));
+			codes[t] = spreadBits(cell.x) | spreadBits(cell.y) << 1 | spreadBits(cell.z) << 2;
+		}
+		return codes;
+	}
+
+	// splits sorted codes [first, first + count) where the highest differing bit flips (the middle when all are equal)
+	void splitClusters(const std::vector<uint32_t> &codes, uint32_t first, uint32_t count, uint32_t clusterSize,
+			std::vector<uint32_t> &firsts) {
+		if (count <= clusterSize) {
+			firsts.push_back(first);
+			return;
+		}
+		uint32_t split = first + count / 2;
+		uint32_t low = codes[first], high = codes[first + count - 1];
+		if (low != high) {
+			// codes in the range share every bit above the highest differing one, the first half has it clear
+			uint32_t bit = 1u << glm::findMSB(low ^ high);
+			split = (uint32_t)(std::upper_bound(codes.begin() + first, codes.begin() + first + count, low | (bit - 1)) - codes.begin());
+		}
+		splitClusters(codes, first, split - first, clusterSize, firsts);
+		splitClusters(codes, split, first + count - split, clusterSize, firsts);
+	}
+}
+
+void cd::ReorderTriangles(std::vector<Vertex> &vertices, std::vector<glm::uvec3> &indices) {
+	// ties keep the source order
+	std::vector<uint32_t> morton = mortonCodes(vertices, indices);
+	std::vector<std::pair<uint32_t, uint32_t>> codes(indices.size());
+	for (uint32_t t = 0; t < indices.size(); t++)
+		codes[t] = { morton[t], t };
+	std::sort(codes.begin(), codes.end());
+
+	std::vector<glm::uvec3> sorted(indices.size());
+	for (size_t t = 0; t < codes.size(); t++)
+		sorted[t] = indices[codes[t].second];
+	indices.swap(sorted);
+	RenumberVertices(vertices, indices);
+}
+
+void cd::RenumberVertices(std::vector<Vertex> &vertices, std::vector<glm::uvec3> &indices) {
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (glm::uvec3 &triangle : indices) {
+		for (int c = 0; c < 3; c++) {
+			if (remap[triangle[c]] == UINT32_MAX) {
+				remap[triangle[c]] = (uint32_t)ordered.size();
+				ordered.push_back(vertices[triangle[c]]);
+			}
+			triangle[c] = remap[triangle[c]];
+		}
+	}
+
+	// unreferenced vertices are dropped
+	if (ordered.size() < vertices.size())
+		cd::JobLog() << "reorder dropped " << vertices.size() - ordered.size() << " unused vertices" << std::endl;
+	vertices.swap(ordered);
+}
+
+void cd::BuildClusters(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &indices, uint32_t clusterSize,
+		std::vector<TriangleCluster> &clusters) {
+	clusters.clear();
+	if (clusterSize == 0 || indices.empty()) return;
+
+	std::vector<uint32_t> codes = mortonCodes(vertices, indices), firsts;
+	if (!std::is_sorted(codes.begin(), codes.end())) {
+		cd::JobLog() << "triangles are not in morton order, no clusters written" << std::endl;
+		return;
+	}
+	splitClusters(codes, 0, (uint32_t)indices.size(), clusterSize, firsts);
+	firsts.push_back((uint32_t)indices.size());
+
+	for (size_t c = 0; c + 1 < firsts.size(); c++) {
+		TriangleCluster cluster = { glm::vec3(INFINITY), firsts[c], glm::vec3(-INFINITY), firsts[c + 1] - firsts[c] };
+		for (uint32_t t = cluster.first; t < cluster.first + cluster.count; t++) {
+			for (int corner = 0; corner < 3; corner++) {
+				cluster.min = glm::min(cluster.min, glm::vec3(vertices[indices[t][corner]].position));
+				cluster.max = glm::max(cluster.max, glm::vec3(vertices[indices[t][corner]].position));
+			}
+		}
+		clusters.push_back(cluster);
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "FBX_Loader.h"
+
+namespace cd {
+	/*
+	Sorts the triangles along a morton curve of their bind pose centroids, so triangles close in space are close in
+	memory, then numbers the vertices in the order the sorted triangles first use them.
+	*/
+	void ReorderTriangles(std::vector<Vertex> &vertices, std::vector<glm::uvec3> &indices);
+
+	// numbers the vertices in the order the triangles first use them, dropping unused vertices
+	void RenumberVertices(std::vector<Vertex> &vertices, std::vector<glm::uvec3> &indices);
+
+	/*
+	Cuts triangles sorted by ReorderTriangles into runs of at most clusterSize, splitting each range where its highest
+	morton bit changes so a run stays within one grid cell, and stores each run's bind pose bounds.
+	*/
+	void BuildClusters(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &indices, uint32_t clusterSize,
+		std::vector<TriangleCluster> &clusters);
+}
@@ -0,0 +1,234 @@
+#include "Simplify.h"
+#include "Bvh.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#define BOUNDARY_WEIGHT 10.0	/* quadric weight of the planes holding open edges in place, per squared edge length */
+#define SKIN_WEIGHT_COST 0.01	/* cost of a collapse onto a vertex with none of the same bone weights, per squared model size and area */
+#define MIN_NORMAL_COS 0.2		/* collapses turning a triangle's normal further than this are rejected */
+
+namespace {
+	// symmetric 4x4 sum of plane products, upper triangle row by row
+	struct Quadric {
+		double q[10] = { 0 };
+		double area = 0; // of the triangles whose planes were added
+
+		void addPlane(glm::dvec3 n, double d, double weight) {
+			double p[4] = { n.x, n.y, n.z, d };
+			for (int r = 0, i = 0; r < 4; r++) {
+				for (int c = r; c < 4; c++)
+					q[i++] += p[r] * p[c] * weight;
+			}
+		}
+
+		// summed squared distance of p to the planes
+		double error(glm::dvec3 p) const {
+			return p.x * p.x * q[0] + 2 * p.x * p.y * q[1] + 2 * p.x * p.z * q[2] + 2 * p.x * q[3]
+				+ p.y * p.y * q[4] + 2 * p.y * p.z * q[5] + 2 * p.y * q[6]
+				+ p.z * p.z * q[7] + 2 * p.z * q[8] + q[9];
+		}
+
+		Quadric operator+(const Quadric &other) const {
+			Quadric sum;
+			for (int i = 0; i < 10; i++)
+				sum.q[i] = q[i] + other.q[i];
+			sum.area = area + other.area;
+			return sum;
+		}
+	};
+
+	// half the summed difference of the two vertices' weight on every bone, 0 = same skinning, 1 = no bone in common
+	double skinDistance(const cd::Vertex &a, const cd::Vertex &b) {
+		int bones[8];
+		double difference[8] = { 0 }; // a's weight minus b's of each bone
+		int count = 0;
+		auto add = [&](int bone, double weight) {
+			if (bone < 0) return;
+			int i = 0;
+			while (i < count && bones[i] != bone)
+				i++;
+			if (i == count)
+				bones[count++] = bone;
+			difference[i] += weight;
+		};
+		for (int i = 0; i < 4; i++) {
+			add(a.boneIndices[i], a.boneWeights[i]);
+			add(b.boneIndices[i], -b.boneWeights[i]);
+		}
+		double sum = 0;
+		for (int i = 0; i < count; i++)
+			sum += std::fabs(difference[i]);
+		return std::min(1.0, sum / 2);
+	}
+
+	std::pair<uint32_t, uint32_t> edge(uint32_t a, uint32_t b) {
+		return { std::min(a, b), std::max(a, b) };
+	}
+
+	struct Collapse {
+		uint32_t from, to;
+		double cost;
+		bool operator<(const Collapse &other) const { return cost < other.cost || (cost == other.cost && from < other.from); }
+	};
+}
+
+void cd::SimplifyMesh(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &indices, size_t targetTriangles,
+		std::vector<glm::uvec3> &simplified, std::vector<uint32_t> &sources) {
+	simplified = indices;
+	std::vector<glm::dvec3> positions(vertices.size());
+	glm::dvec3 min(INFINITY), max(-INFINITY);
+	for (size_t v = 0; v < vertices.size(); v++) {
+		positions[v] = glm::dvec3(vertices[v].position);
+		min = glm::min(min, positions[v]);
+		max = glm::max(max, positions[v]);
+	}
+	double size = vertices.empty() ? 0 : glm::length(max - min);
+
+	// area weighted planes of the triangles around each vertex, and of open edges perpendicular to their triangle
+	std::vector<Quadric> quadrics(vertices.size());
+	std::vector<std::pair<uint32_t, uint32_t>> edges;
+	for (const glm::uvec3 &triangle : indices) {
+		for (int c = 0; c < 3; c++)
+			edges.push_back(edge(triangle[c], triangle[(c + 1) % 3]));
+	}
+	std::sort(edges.begin(), edges.end());
+	for (const glm::uvec3 &triangle : indices) {
+		glm::dvec3 normal = glm::cross(positions[triangle.y] - positions[triangle.x], positions[triangle.z] - positions[triangle.x]);
+		double area = glm::length(normal) / 2;
+		if (area == 0) continue;
+		normal = glm::normalize(normal);
+		for (int c = 0; c < 3; c++) {
+			quadrics[triangle[c]].addPlane(normal, -glm::dot(normal, positions[triangle.x]), area);
+			quadrics[triangle[c]].area += area;
+		}
+
+		for (int c = 0; c < 3; c++) {
+			uint32_t a = triangle[c], b = triangle[(c + 1) % 3];
+			auto uses = std::equal_range(edges.begin(), edges.end(), edge(a, b));
+			glm::dvec3 side = glm::cross(positions[b] - positions[a], normal);
+			if (uses.second - uses.first != 1 || glm::length(side) == 0) continue;
+			side = glm::normalize(side);
+			double weight = BOUNDARY_WEIGHT * glm::dot(positions[b] - positions[a], positions[b] - positions[a]);
+			quadrics[a].addPlane(side, -glm::dot(side, positions[a]), weight);
+			quadrics[b].addPlane(side, -glm::dot(side, positions[a]), weight);
+		}
+	}
+
+	std::vector<std::vector<uint32_t>> around(vertices.size());
+	for (uint32_t t = 0; t < simplified.size(); t++) {
+		for (int c = 0; c < 3; c++)
+			around[simplified[t][c]].push_back(t);
+	}
+	std::vector<bool> removed(simplified.size(), false);
+	size_t live = simplified.size();
+
+	// collapse folding the triangles around from over, degenerate ones have no side to fold
+	auto folds = [&](uint32_t from, uint32_t to) {
+		for (uint32_t t : around[from]) {
+			const glm::uvec3 &triangle = simplified[t];
+			if (removed[t] || triangle.x == to || triangle.y == to || triangle.z == to) continue;
+			glm::dvec3 corners[3], moved[3];
+			for (int c = 0; c < 3; c++) {
+				corners[c] = positions[triangle[c]];
+				moved[c] = positions[triangle[c] == from ? to : triangle[c]];
+			}
+			glm::dvec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+			glm::dvec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+			if (glm::dot(before, before) == 0) continue;
+			if (glm::dot(before, after) <= MIN_NORMAL_COS * glm::length(before) * glm::length(after))
+				return true;
+		}
+		return false;
+	};
+
+	// passes of the cheapest collapses that touch separate triangles, until the target or nothing can collapse
+	while (live > targetTriangles) {
+		edges.clear();
+		for (uint32_t t = 0; t < simplified.size(); t++) {
+			for (int c = 0; c < 3 && !removed[t]; c++)
+				edges.push_back(edge(simplified[t][c], simplified[t][(c + 1) % 3]));
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		std::vector<Collapse> collapses;
+		for (const std::pair<uint32_t, uint32_t> &ends : edges) {
+			Quadric merged = quadrics[ends.first] + quadrics[ends.second];
+			double skin = skinDistance(vertices[ends.first], vertices[ends.second]) * SKIN_WEIGHT_COST * size * size * merged.area;
+			double toSecond = std::max(0.0, merged.error(positions[ends.second]));
+			double toFirst = std::max(0.0, merged.error(positions[ends.first]));
+			if (toSecond <= toFirst)
+				collapses.push_back({ ends.first, ends.second, toSecond + skin });
+			else
+				collapses.push_back({ ends.second, ends.first, toFirst + skin });
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		std::vector<bool> locked(vertices.size(), false);
+		size_t collapsed = 0;
+		for (const Collapse &collapse : collapses) {
+			if (live <= targetTriangles) break;
+			if (locked[collapse.from] || locked[collapse.to] || folds(collapse.from, collapse.to)) continue;
+
+			for (uint32_t t : around[collapse.from]) {
+				if (removed[t]) continue;
+				glm::uvec3 &triangle = simplified[t];
+				for (int c = 0; c < 3; c++)
+					triangle[c] = triangle[c] == collapse.from ? collapse.to : triangle[c];
+				if (triangle.x == triangle.y || triangle.y == triangle.z || triangle.z == triangle.x) {
+					removed[t] = true;
+					live--;
+				} else {
+					around[collapse.to].push_back(t);
+				}
+			}
+			around[collapse.from].clear();
+			quadrics[collapse.to] = quadrics[collapse.to] + quadrics[collapse.from];
+			collapsed++;
+
+			// the costs of every vertex sharing a triangle with to have changed
+			for (uint32_t t : around[collapse.to]) {
+				for (int c = 0; c < 3 && !removed[t]; c++)
+					locked[simplified[t][c]] = true;
+			}
+			locked[collapse.from] = true;
+		}
+		if (collapsed == 0) break;
+	}
+
+	size_t kept = 0;
+	sources.clear();
+	for (uint32_t t = 0; t < simplified.size(); t++) {
+		if (removed[t]) continue;
+		simplified[kept++] = simplified[t];
+		sources.push_back(t);
+	}
+	simplified.resize(kept);
+}
+
+void cd::BuildLods(AnimatedModel &model, uint32_t levels, float ratio, uint32_t minTriangles) {
+	model.lods.clear();
+	size_t triangles = model.indices.size();
+	std::vector<glm::uvec3> full = model.indices, sorted;
+	std::vector<BvhNode> fullNodes, nodes;
+	BuildSahBvh(model.vertices, full, 1, fullNodes);
+
+	for (uint32_t level = 1; level < levels; level++) {
+		size_t target = (size_t)(triangles * ratio);
+		if (target < minTriangles) break;
+
+		MeshLod lod;
+		SimplifyMesh(model.vertices, model.indices, target, lod.indices, lod.sources);
+		// a level without half the reduction asked for isn't worth tracing instead
+		if (triangles * (1 + ratio) / 2 < lod.indices.size()) break;
+
+		sorted = lod.indices;
+		BuildSahBvh(model.vertices, sorted, 1, nodes);
+		lod.error = std::max(MeshDistance(model.vertices, full, sorted, nodes), MeshDistance(model.vertices, sorted, full, fullNodes));
+		cd::JobLog() << "lod " << level << ": " << lod.indices.size() << " triangles, error " << lod.error << std::endl;
+		triangles = lod.indices.size();
+		model.lods.push_back(std::move(lod));
+	}
+}
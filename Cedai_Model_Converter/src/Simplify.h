@@ -0,0 +1,19 @@
+#pragma once
+#include "AnimatedModel.h"
+
+namespace cd {
+	/*
+	Quadric error edge collapse down to about targetTriangles. Each collapse moves a vertex onto a neighbour (half edge
+	collapse), so the simplified triangles index a subset of the same vertices and keep their skin weights exactly.
+	Collapses between vertices with different bone weights cost extra, open edges are held in place and collapses that
+	fold a triangle over are rejected. Every simplified triangle is one of the triangles moved onto fewer vertices,
+	sources holds the index of that triangle in indices.
+	*/
+	void SimplifyMesh(const std::vector<Vertex> &vertices, const std::vector<glm::uvec3> &indices, size_t targetTriangles,
+		std::vector<glm::uvec3> &simplified, std::vector<uint32_t> &sources);
+
+	// up to levels - 1 coarser levels of the model's mesh (model.lods), each simplified from the full mesh to ratio of the
+	// triangles of the level before, stopping at minTriangles or once a level barely shrinks. each level's error is the
+	// largest distance between its surface and the full mesh's, measured both ways
+	void BuildLods(AnimatedModel &model, uint32_t levels, float ratio, uint32_t minTriangles);
+}
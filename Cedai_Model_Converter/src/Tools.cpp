@@ -1,4 +1,8 @@
 
+#include "AnimatedModel.h" // FBX_IMPORT
+
+#ifdef FBX_IMPORT
+
 #include "Tools.h"
 
 #include <iostream>
@@ -87,3 +91,5 @@ void cd::PrintNode(FbxNode* pNode) {
 	numTabs--;
 	//PrintTabs();
 }
+
+#endif
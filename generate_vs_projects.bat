@@ -1,2 +1,2 @@
-call vendor\premake\premake5.exe vs2019
+call vendor\premake\premake5.exe --fbx vs2019
 PAUSE
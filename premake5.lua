@@ -23,12 +23,14 @@ project "Cedai_Engine" -- game engine
 		engine_name .. "/src/**.h",			-- headers
 		engine_name .. "/src/**.cpp",		-- source files
 		engine_name .. "/kernels/**.cl",	-- opencl kernels
+		engine_name .. "/kernels/**.h",		-- headers shared by kernels and host
 		engine_name .. "/shaders/**.vert",	-- vert shaders
 		engine_name .. "/shaders/**.frag",	-- frag shaders
 	}
 
 	includedirs {
 		engine_name .. "/src",
+		engine_name .. "/kernels",						-- render_math.h
 		engine_name .. "/vendor/OpenCL-Headers",		-- opencl
 		engine_name .. "/vendor/glm",					-- glm
 		engine_name .. "/vendor/glfw_custom/include",	-- glfw
@@ -86,6 +88,11 @@ converter_name = "Cedai_Model_Converter"
 
 fbxdir = "C:/Program Files/Autodesk/FBX/FBX SDK/2019.2/"
 
+newoption {
+	trigger = "fbx",
+	description = "Build the converter's fbx importer, needs the fbx sdk (the glb importer has no dependencies)"
+}
+
 project "Cedai_Model_Converter" -- model converter
 	location "Cedai_Model_Converter"
 	kind "ConsoleApp"
@@ -102,21 +109,25 @@ project "Cedai_Model_Converter" -- model converter
 
 	includedirs {
 		converter_name .. "/src",
-		engine_name .. "vendor/glm", -- glm
-		"C:/Program Files/Autodesk/FBX/FBX SDK/2019.2/include" -- fbx sdk
+		engine_name .. "vendor/glm" -- glm
 	}
 
-	libdirs {
-		"C:/Program Files/Autodesk/FBX/FBX SDK/2019.2/lib/vs2017/x64/%{cfg.buildcfg}"
- 	}
+	filter "options:fbx"
+		defines { "FBX_IMPORT", "FBXSDK_SHARED" }
 
-	links { "libfbxsdk.lib" }
+		includedirs {
+			fbxdir .. "include" -- fbx sdk
+		}
+
+		libdirs {
+			fbxdir .. "lib/vs2017/x64/%{cfg.buildcfg}"
+		}
 
-	defines { "FBXSDK_SHARED" }
+		links { "libfbxsdk.lib" }
 
-	postbuildcommands {
-		'{COPY} "C:/Program Files/Autodesk/FBX/FBX SDK/2019.2/lib/vs2017/x64/%{cfg.buildcfg}/libfbxsdk.dll" %{cfg.buildtarget.directory}'
-	}
+		postbuildcommands {
+			'{COPY} "' .. fbxdir .. 'lib/vs2017/x64/%{cfg.buildcfg}/libfbxsdk.dll" %{cfg.buildtarget.directory}'
+		}
 
 	filter "system:windows"
 		cppdialect "C++17" -- note we may need specific compile flag for other systems
@@ -124,6 +135,9 @@ project "Cedai_Model_Converter" -- model converter
 
 		defines { "CD_PLATFORM_WINDOWS" }
 
+	filter "system:linux"
+		links { "pthread" }	-- batch conversion threads
+
 	filter "configurations:debug"
 		defines "DEBUG"
 		symbols "On"